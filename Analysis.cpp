@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <algorithm>
+#include <cstring>
+
+#include "Analysis.h"
+#include "Dispatch.h"
+
+namespace
+{
+    bool isSkip(uint8_t op)
+    {
+        switch (op)
+        {
+            case OP_Jeq: case OP_Jneq: case OP_Jeqr: case OP_Jneqr: case OP_Jkey: case OP_Jnkey:
+                return true;
+        }
+        return false;
+    }
+} // namespace
+
+RomAnalysis::RomAnalysis(const uint8_t *program, size_t size)
+            : end(0x200 + std::min<size_t>(size, 4096 - 0x200)),
+              classes{},
+              instruction{},
+              leader{},
+              visited{}
+{
+    memset(memory, 0, sizeof(memory));
+    memcpy(memory + 0x200, program, end - 0x200);
+
+    std::vector<Path> pending;
+    follow(0x200, 0x200, -1, pending);
+    while (!pending.empty())
+    {
+        Path path = pending.back();
+        pending.pop_back();
+        walk(path, pending);
+    }
+
+    // Code found after a store was seen is code all the same
+    for (const auto &store : stores)
+    {
+        for (uint32_t address = store.I; address < store.I + store.count && address < 4096u; ++address)
+        {
+            if (classes[address] != ByteClass::Code) continue;
+            codeWrites.push_back(store.pc);
+            break;
+        }
+    }
+
+    std::sort(indirectJumps.begin(), indirectJumps.end());
+    std::sort(unknownOpcodes.begin(), unknownOpcodes.end());
+    std::sort(codeWrites.begin(), codeWrites.end());
+    codeWrites.erase(std::unique(codeWrites.begin(), codeWrites.end()), codeWrites.end());
+    std::sort(escapes.begin(), escapes.end());
+    escapes.erase(std::unique(escapes.begin(), escapes.end()), escapes.end());
+    buildBlocks();
+}
+
+uint16_t RomAnalysis::Opcode(uint16_t address) const
+{
+    return memory[address & 0xFFF] << 8 | memory[(address + 1) & 0xFFF];
+}
+
+const BasicBlock *RomAnalysis::BlockAt(uint16_t address) const
+{
+    auto found = std::lower_bound(blocks.begin(), blocks.end(), address,
+                                  [](const BasicBlock &block, uint16_t address) { return block.start < address; });
+    return (found != blocks.end() && found->start == address) ? &*found : NULL;
+}
+
+uint32_t RomAnalysis::Count(ByteClass kind) const
+{
+    return std::count(classes + 0x200, classes + end, kind);
+}
+
+// Straight on from path.pc until the control flow changes or joins a path
+// already walked
+void RomAnalysis::walk(Path path, std::vector<Path> &pending)
+{
+    uint16_t pc = path.pc;
+    int32_t I = path.I;
+    while (!visited[pc])
+    {
+        visited[pc] = instruction[pc] = true;
+        classes[pc] = classes[pc + 1] = ByteClass::Code;
+
+        Instruction ins = Decode(Opcode(pc));
+        if (isSkip(ins.op))
+        {
+            follow(pc, pc + 2, I, pending);
+            follow(pc, pc + 4, I, pending);
+            return;
+        }
+        switch (ins.op)
+        {
+            case OP_Jmp: follow(pc, ins.nnn, I, pending); return;
+            // The callee may change I
+            case OP_Call:
+                follow(pc, ins.nnn, I, pending);
+                follow(pc, pc + 2, -1, pending);
+                return;
+            case OP_Ret: return;
+            case OP_Jumpv0: indirectJumps.push_back(pc); return;
+            case OP_Unknown: unknownOpcodes.push_back(pc); return;
+
+            case OP_Seti:
+                I = ins.nnn;
+                mark(I, 1, ByteClass::Data);
+                break;
+            case OP_Addi: case OP_Spritei: I = -1; break;
+            case OP_Draw: mark(I, ins.n, ByteClass::Sprite); break;
+            // Some quirk profiles move I past the registers
+            case OP_Pop:
+                mark(I, ins.x + 1, ByteClass::Data);
+                I = -1;
+                break;
+            case OP_Push: case OP_Bcd:
+            {
+                uint16_t count = ins.op == OP_Bcd ? 3 : ins.x + 1;
+                mark(I, count, ByteClass::Data);
+                if (I >= 0) stores.push_back({ pc, static_cast<uint16_t>(I), count });
+                if (ins.op == OP_Push) I = -1;
+                break;
+            }
+        }
+
+        if (pc + 4 > end)
+        {
+            escapes.push_back(pc);
+            return;
+        }
+        pc += 2;
+    }
+}
+
+void RomAnalysis::follow(uint16_t from, uint16_t to, int32_t I, std::vector<Path> &pending)
+{
+    if (to < 0x200 || to + 2 > end)
+    {
+        escapes.push_back(from);
+        return;
+    }
+    leader[to] = true;
+    if (!visited[to]) pending.push_back({ to, I });
+}
+
+// Code wins over data, sprites over other data
+void RomAnalysis::mark(int32_t I, uint32_t count, ByteClass kind)
+{
+    if (I < 0) return;
+    for (uint32_t address = I; address < I + count && address < 4096u; ++address)
+    {
+        if (classes[address] == ByteClass::Code) continue;
+        if (kind == ByteClass::Sprite || classes[address] == ByteClass::Unreached) classes[address] = kind;
+    }
+}
+
+void RomAnalysis::buildBlocks()
+{
+    // Block still taking the next instruction
+    bool open = false;
+    for (uint32_t pc = 0x200; pc + 2 <= end; ++pc)
+    {
+        if (!instruction[pc]) continue;
+        if (!open || leader[pc] || blocks.back().end != pc)
+        {
+            if (open && blocks.back().end == pc) blocks.back().successors.push_back(pc);
+            blocks.push_back({ static_cast<uint16_t>(pc), static_cast<uint16_t>(pc), {}, false, false, false });
+        }
+
+        BasicBlock &block = blocks.back();
+        block.end = pc + 2;
+        open = false;
+        Instruction ins = Decode(Opcode(pc));
+        auto add = [&](uint32_t to) { if (to >= 0x200 && to + 2 <= end) block.successors.push_back(to); };
+        if (isSkip(ins.op))
+        {
+            add(pc + 2);
+            add(pc + 4);
+            continue;
+        }
+        switch (ins.op)
+        {
+            case OP_Jmp:
+                add(ins.nnn);
+                block.halts = ins.nnn == pc;
+                break;
+            case OP_Call:
+                add(ins.nnn);
+                add(pc + 2);
+                break;
+            case OP_Ret: block.returns = true; break;
+            case OP_Jumpv0: block.indirect = true; break;
+            case OP_Unknown: block.halts = true; break;
+            default: open = true;
+        }
+    }
+}
+
+std::string Disassemble(uint16_t opcode)
+{
+    Instruction ins = Decode(opcode);
+    char text[32];
+    switch (ins.op)
+    {
+        case OP_Clear:    return "CLS";
+        case OP_Ret:      return "RET";
+        case OP_Jmp:      snprintf(text, sizeof(text), "JP 0x%03X", ins.nnn); break;
+        case OP_Call:     snprintf(text, sizeof(text), "CALL 0x%03X", ins.nnn); break;
+        case OP_Jeq:      snprintf(text, sizeof(text), "SE V%X, 0x%02X", ins.x, ins.kk); break;
+        case OP_Jneq:     snprintf(text, sizeof(text), "SNE V%X, 0x%02X", ins.x, ins.kk); break;
+        case OP_Jeqr:     snprintf(text, sizeof(text), "SE V%X, V%X", ins.x, ins.y); break;
+        case OP_Set:      snprintf(text, sizeof(text), "LD V%X, 0x%02X", ins.x, ins.kk); break;
+        case OP_Add:      snprintf(text, sizeof(text), "ADD V%X, 0x%02X", ins.x, ins.kk); break;
+        case OP_Setr:     snprintf(text, sizeof(text), "LD V%X, V%X", ins.x, ins.y); break;
+        case OP_Or:       snprintf(text, sizeof(text), "OR V%X, V%X", ins.x, ins.y); break;
+        case OP_And:      snprintf(text, sizeof(text), "AND V%X, V%X", ins.x, ins.y); break;
+        case OP_Xor:      snprintf(text, sizeof(text), "XOR V%X, V%X", ins.x, ins.y); break;
+        case OP_Addr:     snprintf(text, sizeof(text), "ADD V%X, V%X", ins.x, ins.y); break;
+        case OP_Sub:      snprintf(text, sizeof(text), "SUB V%X, V%X", ins.x, ins.y); break;
+        case OP_Shr:      snprintf(text, sizeof(text), "SHR V%X, V%X", ins.x, ins.y); break;
+        case OP_Subb:     snprintf(text, sizeof(text), "SUBN V%X, V%X", ins.x, ins.y); break;
+        case OP_Shl:      snprintf(text, sizeof(text), "SHL V%X, V%X", ins.x, ins.y); break;
+        case OP_Jneqr:    snprintf(text, sizeof(text), "SNE V%X, V%X", ins.x, ins.y); break;
+        case OP_Seti:     snprintf(text, sizeof(text), "LD I, 0x%03X", ins.nnn); break;
+        case OP_Jumpv0:   snprintf(text, sizeof(text), "JP V0, 0x%03X", ins.nnn); break;
+        case OP_Rand:     snprintf(text, sizeof(text), "RND V%X, 0x%02X", ins.x, ins.kk); break;
+        case OP_Draw:     snprintf(text, sizeof(text), "DRW V%X, V%X, %u", ins.x, ins.y, ins.n); break;
+        case OP_Jkey:     snprintf(text, sizeof(text), "SKP V%X", ins.x); break;
+        case OP_Jnkey:    snprintf(text, sizeof(text), "SKNP V%X", ins.x); break;
+        case OP_Getdelay: snprintf(text, sizeof(text), "LD V%X, DT", ins.x); break;
+        case OP_Waitkey:  snprintf(text, sizeof(text), "LD V%X, K", ins.x); break;
+        case OP_Setdelay: snprintf(text, sizeof(text), "LD DT, V%X", ins.x); break;
+        case OP_Setsound: snprintf(text, sizeof(text), "LD ST, V%X", ins.x); break;
+        case OP_Addi:     snprintf(text, sizeof(text), "ADD I, V%X", ins.x); break;
+        case OP_Spritei:  snprintf(text, sizeof(text), "LD F, V%X", ins.x); break;
+        case OP_Bcd:      snprintf(text, sizeof(text), "LD B, V%X", ins.x); break;
+        case OP_Push:     snprintf(text, sizeof(text), "LD [I], V%X", ins.x); break;
+        case OP_Pop:      snprintf(text, sizeof(text), "LD V%X, [I]", ins.x); break;
+        default:          snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+    }
+    return text;
+}
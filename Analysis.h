@@ -0,0 +1,100 @@
+#ifndef _ANALYSIS_H_
+#define _ANALYSIS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What the analysis found a byte of memory to be
+enum class ByteClass : uint8_t
+{
+    Unreached,  // nothing leads to it
+    Code,       // part of a reachable instruction
+    Sprite,     // drawn by DXYN with I known
+    Data        // read or written through I (ANNN targets, FX33, FX55, FX65)
+};
+
+// Straight-line run of instructions entered only at its start
+struct BasicBlock
+{
+    uint16_t start;
+    uint16_t end;       // first address after the last instruction
+    // Start of the blocks control can go to next, calls first then their return
+    std::vector<uint16_t> successors;
+    bool indirect;      // ends with BNNN: successors depend on V0
+    bool returns;       // ends with 00EE
+    bool halts;         // jumps to itself, or an unknown opcode
+};
+
+// Static analysis of an original Chip8 program loaded at 0x200. Every path
+// is followed from the entry point: jumps, calls (assumed to return), both
+// ways of the skips. BNNN is flagged as an indirect jump and not followed.
+// I is tracked along each path from ANNN, so sprites drawn and bytes loaded
+// or stored through it are told apart from code.
+class RomAnalysis
+{
+public:
+    RomAnalysis(const uint8_t *program, size_t size);
+
+    // First address after the program
+    uint16_t End() const { return end; }
+    ByteClass Class(uint16_t address) const { return classes[address & 0xFFF]; }
+    // A reachable instruction starts there
+    bool IsInstruction(uint16_t address) const { return instruction[address & 0xFFF]; }
+    uint16_t Opcode(uint16_t address) const;
+
+    // Sorted by start address
+    const std::vector<BasicBlock> &Blocks() const { return blocks; }
+    // NULL when no block starts there
+    const BasicBlock *BlockAt(uint16_t address) const;
+
+    // Addresses of the instructions worth a look when reviewing a program
+    const std::vector<uint16_t> &IndirectJumps() const { return indirectJumps; }
+    const std::vector<uint16_t> &UnknownOpcodes() const { return unknownOpcodes; }
+    // FX33 and FX55 storing into reachable code
+    const std::vector<uint16_t> &CodeWrites() const { return codeWrites; }
+    // Jumps, calls and skips going to an address outside the program
+    const std::vector<uint16_t> &Escapes() const { return escapes; }
+
+    // Bytes of each class within the program
+    uint32_t Count(ByteClass kind) const;
+
+private:
+    struct Path
+    {
+        uint16_t pc;
+        int32_t I;      // -1 when unknown
+    };
+
+    struct Store
+    {
+        uint16_t pc;
+        uint16_t I;
+        uint16_t count;
+    };
+
+    void walk(Path path, std::vector<Path> &pending);
+    void follow(uint16_t from, uint16_t to, int32_t I, std::vector<Path> &pending);
+    void mark(int32_t I, uint32_t count, ByteClass kind);
+    void buildBlocks();
+
+    uint8_t memory[4096];
+    uint16_t end;
+    ByteClass classes[4096];
+    bool instruction[4096];
+    bool leader[4096];
+    bool visited[4096];
+    std::vector<BasicBlock> blocks;
+    std::vector<uint16_t> indirectJumps;
+    std::vector<uint16_t> unknownOpcodes;
+    std::vector<uint16_t> codeWrites;
+    std::vector<uint16_t> escapes;
+    // Stores through I, checked against the code once it is all known
+    std::vector<Store> stores;
+};
+
+// One instruction in the usual assembly syntax: "LD V1, 0x0A", "DRW V0, V1, 5"
+std::string Disassemble(uint16_t opcode);
+
+#endif // _ANALYSIS_H_
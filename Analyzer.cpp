@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <cstring>
+#include <string>
+
+#include "Analysis.h"
+#include "Memory.h"
+#include "Rom.h"
+
+// Static analysis of a ROM, for reviewing programs before running them.
+// Usage: chip8-analyze [--listing] [--dot file] <ROM file>
+// Prints what was found, --listing disassembles the reachable code and shows
+// the data, --dot writes the control flow graph for Graphviz. Exits with 2
+// when the program reaches unknown opcodes, writes into its own code or
+// jumps outside of itself.
+
+namespace
+{
+    const char *class_names[] = { "unreached", "code", "sprite", "data" };
+
+    void printSummary(const RomAnalysis &analysis)
+    {
+        uint32_t edges = 0;
+        for (const auto &block : analysis.Blocks()) edges += block.successors.size();
+
+        printf("%u bytes: %u code, %u sprite, %u data, %u unreached\n", analysis.End() - 0x200,
+               analysis.Count(ByteClass::Code), analysis.Count(ByteClass::Sprite),
+               analysis.Count(ByteClass::Data), analysis.Count(ByteClass::Unreached));
+        printf("%zu basic blocks, %u edges\n", analysis.Blocks().size(), edges);
+    }
+
+    void printFindings(const RomAnalysis &analysis, const char *what, const std::vector<uint16_t> &addresses)
+    {
+        for (auto address : addresses)
+            printf("%s at 0x%03X: %s\n", what, address, Disassemble(analysis.Opcode(address)).c_str());
+    }
+
+    // Sprite rows as pixels, other bytes 8 to a line
+    void printListing(const RomAnalysis &analysis)
+    {
+        printf("\n");
+        for (uint32_t address = 0x200; address < analysis.End(); )
+        {
+            if (analysis.IsInstruction(address))
+            {
+                if (analysis.BlockAt(address)) printf("L%03X:\n", address);
+                uint16_t opcode = analysis.Opcode(address);
+                printf("    %03X  %04X  %s\n", address, opcode, Disassemble(opcode).c_str());
+                address += 2;
+                continue;
+            }
+
+            ByteClass kind = analysis.Class(address);
+            if (kind == ByteClass::Sprite)
+            {
+                uint8_t row = analysis.Opcode(address) >> 8;
+                char pixels[9];
+                for (auto bit=0; bit<8; ++bit) pixels[bit] = (row & (0x80 >> bit)) ? '#' : '.';
+                pixels[8] = '\0';
+                printf("    %03X  %02X    %s\n", address, row, pixels);
+                ++address;
+                continue;
+            }
+
+            printf("    %03X  ", address);
+            uint32_t first = address;
+            while (address < analysis.End() && address - first < 8 && analysis.Class(address) == kind &&
+                   !analysis.IsInstruction(address))
+                printf("%02X ", analysis.Opcode(address++) >> 8);
+            printf("%*s; %s\n", 3 * (8 - (address - first)), "", class_names[static_cast<int>(kind)]);
+        }
+    }
+
+    bool writeDot(const RomAnalysis &analysis, const char *filename)
+    {
+        FILE *file = fopen(filename, "w");
+        if (!file) return false;
+
+        fprintf(file, "digraph rom {\n    node [shape=box, fontname=monospace];\n");
+        for (const auto &block : analysis.Blocks())
+        {
+            fprintf(file, "    L%03X [label=\"", block.start);
+            for (uint32_t address = block.start; address < block.end; address += 2)
+                fprintf(file, "%03X  %s\\l", address, Disassemble(analysis.Opcode(address)).c_str());
+            fprintf(file, "\"%s];\n", block.indirect ? ", style=dashed" : block.halts ? ", style=bold" : "");
+            for (auto to : block.successors) fprintf(file, "    L%03X -> L%03X;\n", block.start, to);
+        }
+        fprintf(file, "}\n");
+        return fclose(file) == 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool listing = false;
+    const char *dot = NULL;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (strcmp(argv[arg], "--listing") == 0) listing = true;
+        else if (strcmp(argv[arg], "--dot") == 0 && arg + 1 < argc) dot = argv[++arg];
+        else break;
+    }
+
+    if (arg >= argc)
+    {
+        printf("Usage: %s [--listing] [--dot file] <ROM file>\n\n", argv[0]);
+        return 1;
+    }
+
+    RomImage rom(argv[arg], Memory<4096>::PROGRAM_SIZE);
+    if (!rom.Valid())
+    {
+        printf("%s %s\n", argv[arg], rom.Error());
+        return 1;
+    }
+
+    RomAnalysis analysis(rom.Data(), rom.Size());
+    printSummary(analysis);
+    printFindings(analysis, "Indirect jump", analysis.IndirectJumps());
+    printFindings(analysis, "Unknown opcode", analysis.UnknownOpcodes());
+    printFindings(analysis, "Write into code", analysis.CodeWrites());
+    printFindings(analysis, "Leaves the program", analysis.Escapes());
+    if (listing) printListing(analysis);
+
+    if (dot && !writeDot(analysis, dot))
+    {
+        printf("Can't write %s\n", dot);
+        return 1;
+    }
+
+    bool suspicious = !analysis.UnknownOpcodes().empty() || !analysis.CodeWrites().empty() || !analysis.Escapes().empty();
+    return suspicious ? 2 : 0;
+}
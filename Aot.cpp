@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+#include "AotRuntime.h"
+#include "Scheduler.h"
+
+AotCode::AotCode(const AotProgram &program)
+       : compiled(0),
+         interpreted(0),
+         program(program),
+         handlers(NULL),
+         stale(program.count, false)
+{
+    switch (program.quirks)
+    {
+#define CHIP8_AOT_HANDLERS(name) case QuirkProfile::name: handlers = Dispatch::Handlers<name##Quirks>(); break;
+        CHIP8_QUIRK_PROFILES(CHIP8_AOT_HANDLERS)
+#undef CHIP8_AOT_HANDLERS
+    }
+
+    memset(index, 0xFF, sizeof(index));
+    memset(code, 0, sizeof(code));
+    for (uint32_t i=0; i<program.count; ++i)
+    {
+        const AotBlock &block = program.blocks[i];
+        for (uint32_t address = block.start; address < block.end && address < 4096u; ++address)
+        {
+            if ((address - block.start) % 2 == 0) index[address] = i;
+            code[address] = true;
+        }
+    }
+}
+
+bool AotCode::intact(uint32_t block, const uint8_t *memory) const
+{
+    const AotBlock &b = program.blocks[block];
+    if (b.start < 0x200 || b.end > 0x200 + program.size) return false;
+    return memcmp(memory + b.start, program.rom + (b.start - 0x200), b.end - b.start) == 0;
+}
+
+void AotCode::Validate(const uint8_t *memory)
+{
+    for (uint32_t i=0; i<program.count; ++i) stale[i] = !intact(i, memory);
+}
+
+bool AotCode::Stored(uint32_t address, uint32_t count, const uint8_t *memory)
+{
+    bool hit = false;
+    for (uint32_t a = address; a < address + count && a < 4096u; ++a) hit = hit || code[a];
+    if (!hit) return true;
+
+    // Rare: only self-modifying programs get here
+    for (uint32_t i=0; i<program.count; ++i)
+    {
+        const AotBlock &block = program.blocks[i];
+        if (block.start < address + count && address < block.end) stale[i] = !intact(i, memory);
+    }
+    return false;
+}
+
+bool Aot::Interpret(Chip8 &cpu, uint16_t pc, uint16_t opcode)
+{
+    const Instruction &ins = DecodeTable()[opcode];
+    uint16_t address = cpu.I;
+    cpu.pc = pc;
+    cpu.opcode = opcode;
+    cpu.aot->Handlers()[ins.op](cpu, ins);
+
+    if (ins.op == OP_Push) return cpu.aot->Stored(address, ins.x + 1, cpu.memory.Data());
+    if (ins.op == OP_Bcd) return cpu.aot->Stored(address, 3, cpu.memory.Data());
+    return true;
+}
+
+void Chip8::SetAotProgram(const AotProgram *program)
+{
+    aot.reset(program ? new AotCode(*program) : NULL);
+    if (aot) aot->Validate(memory.Data());
+}
+
+// Compiled blocks where there are some for pc, the interpreter one
+// instruction at a time elsewhere
+void Chip8::runAot(uint32_t cycles)
+{
+    while (cycles)
+    {
+        // pc runs past 0xFFE after the last instruction of memory
+        pc &= 0xFFF;
+        const AotBlock *block = aot->Lookup(pc);
+        if (!block)
+        {
+            uint16_t at = pc;
+            Aot::Interpret(*this, at, memory.Read(at) << 8 | memory.Read(at + 1));
+            CHIP8_STAT(stats.Count(at, DecodeTable()[opcode].op));
+            ++aot->interpreted;
+            --cycles;
+            continue;
+        }
+
+        if (block->idle)
+        {
+            CHIP8_STAT(stats.Count(pc, OP_Jmp, cycles));
+            opcode = memory.Read(pc) << 8 | memory.Read(pc + 1);
+            aot->compiled += cycles;
+            return;
+        }
+
+        CHIP8_STAT(uint16_t start = pc);
+        uint32_t count = block->run(*this, cycles);
+        CHIP8_STAT(for (uint32_t i=0; i<count; ++i) stats.Count(start + 2 * i, DecodeTable()[memory.Read(start + 2 * i) << 8 | memory.Read(start + 2 * i + 1)].op));
+        aot->compiled += count;
+        cycles -= count;
+    }
+}
+
+namespace
+{
+    void runFrames(Chip8 &cpu, uint32_t instructionsPerFrame, uint32_t frames)
+    {
+        Scheduler scheduler(cpu, instructionsPerFrame);
+        scheduler.SetTurbo(true);
+        for (uint32_t i=0; i<frames; ++i) scheduler.RunFrame();
+    }
+}
+
+int AotMain(const AotProgram &program, int argc, char *argv[])
+{
+    uint32_t instructionsPerFrame = Scheduler::DEFAULT_INSTRUCTIONS_PER_FRAME;
+    uint64_t seed = time(NULL);
+    bool verify = false;
+    // 10 minutes of emulated time
+    uint32_t frames = 36000;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (strcmp(argv[arg], "--ipf") == 0 && arg + 1 < argc) instructionsPerFrame = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc) seed = strtoull(argv[++arg], NULL, 0);
+        else if (strcmp(argv[arg], "--verify") == 0) verify = true;
+        else break;
+    }
+    if (arg < argc) frames = atoi(argv[arg++]);
+    if (arg < argc || instructionsPerFrame == 0)
+    {
+        printf("Usage: %s [--ipf N] [--seed N] [--verify] [frames]\n\n", argv[0]);
+        return 1;
+    }
+
+    Chip8 cpu;
+    cpu.SetQuirks(program.quirks);
+    if (!cpu.LoadROM(program.rom, program.size))
+    {
+        printf("%s doesn't fit in memory\n", program.name);
+        return 1;
+    }
+    cpu.SetAotProgram(&program);
+    cpu.Seed(seed);
+
+    auto start = std::chrono::steady_clock::now();
+    runFrames(cpu, instructionsPerFrame, frames);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const AotCode &code = *cpu.GetAotCode();
+    printf("%s, compiled ahead of time with %s quirks: %u frames, %llu instructions in %.1f ms (%.1f MIPS)\n",
+           program.name, QuirkProfileName(program.quirks), frames, (unsigned long long) cpu.Cycle(), ms,
+           ms > 0 ? cpu.Cycle() / ms / 1000.0 : 0.0);
+    printf("%.2f%% of the instructions ran in compiled blocks, %llu interpreted\n",
+           cpu.Cycle() ? 100.0 * code.compiled / cpu.Cycle() : 0.0, (unsigned long long) code.interpreted);
+
+    if (!verify) return 0;
+
+    Chip8 reference;
+    reference.SetEngine(Engine::Switch);
+    reference.SetQuirks(program.quirks);
+    reference.LoadROM(program.rom, program.size);
+    reference.Seed(seed);
+    runFrames(reference, instructionsPerFrame, frames);
+    if (!reference.SameState(cpu))
+    {
+        printf("Final state differs from the interpreter's (seed %llu)\n", (unsigned long long) seed);
+        return 2;
+    }
+    printf("Same final state as the interpreter\n");
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef _AOT_H_
+#define _AOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Dispatch.h"
+#include "Quirks.h"
+
+class Chip8;
+
+// Basic block of a program translated to C++ by chip8-aot. V and I live in
+// locals of the function, written back when it returns. run starts at the
+// instruction pc points to, any in the block, and executes budget of them at
+// most (at least one). Returns how many it executed, with pc pointing to the
+// next one.
+struct AotBlock
+{
+    uint16_t start;
+    uint16_t end;       // first address after the block
+    bool idle;          // single jump to itself
+    uint32_t (*run)(Chip8 &cpu, uint32_t budget);
+};
+
+// Everything chip8-aot generates for a ROM
+struct AotProgram
+{
+    const char *name;
+    const uint8_t *rom;
+    uint32_t size;
+    uint64_t hash;          // RomHash of rom
+    QuirkProfile quirks;    // the blocks implement this profile only
+    const AotBlock *blocks;
+    uint32_t count;
+};
+
+// Run time side of a compiled program, attached to a Chip8 (SetAotProgram).
+// A block only runs while memory still holds the bytes it was compiled
+// from: stores into them (self-modifying code), another program or a
+// restored snapshot fall back to the interpreter, as do addresses outside of
+// the blocks (targets of BNNN the analysis couldn't follow).
+class AotCode
+{
+public:
+    explicit AotCode(const AotProgram &program);
+    AotCode (const AotCode &) = delete;
+    AotCode & operator=(const AotCode &) = delete;
+
+    const AotProgram &Program() const { return program; }
+    // Block with an instruction at pc, NULL when none or it was overwritten
+    const AotBlock *Lookup(uint16_t pc) const
+    {
+        uint16_t idx = index[pc & 0xFFF];
+        return (idx != NONE && !stale[idx]) ? &program.blocks[idx] : NULL;
+    }
+    // Handlers of the profile the program was compiled for
+    const Dispatch::Handler *Handlers() const { return handlers; }
+
+    // Compares every block with memory (the 4 KB of the machine)
+    void Validate(const uint8_t *memory);
+    // Called after count bytes were stored at address: false when they hit
+    // compiled code, the running block has to stop there
+    bool Stored(uint32_t address, uint32_t count, const uint8_t *memory);
+
+    // Instructions run by compiled blocks and by the interpreter
+    uint64_t compiled;
+    uint64_t interpreted;
+
+private:
+    bool intact(uint32_t block, const uint8_t *memory) const;
+
+    static const uint16_t NONE = 0xFFFF;
+
+    const AotProgram &program;
+    const Dispatch::Handler *handlers;
+    // block index by address of its instructions
+    uint16_t index[4096];
+    // bytes some block was compiled from
+    bool code[4096];
+    std::vector<bool> stale;
+};
+
+#endif // _AOT_H_
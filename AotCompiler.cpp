@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <cstring>
+#include <string>
+
+#include "Analysis.h"
+#include "Dispatch.h"
+#include "Memory.h"
+#include "Quirks.h"
+#include "Rom.h"
+
+// Ahead of time compiler: translates a ROM into a C++ file to build and link
+// with the core library, for hosts where the JIT can't get executable memory.
+// Usage: chip8-aot [--quirks legacy|vip|schip] [--symbol name] <ROM file> <output file>
+// Every basic block the static analysis finds becomes a function keeping V
+// and I in locals. The quirk profile is built into the code (detected from
+// the ROM by default). The output has a main() running the program headless
+// (see AotMain), unless --symbol names the AotProgram to export instead, for
+// linking into another frontend with Chip8::SetAotProgram.
+
+namespace
+{
+    // Drawing, memory and key waits run through the interpreter
+    bool interpreted(uint8_t op)
+    {
+        switch (op)
+        {
+            case OP_Clear: case OP_Draw: case OP_Bcd: case OP_Push: case OP_Pop: case OP_Waitkey: case OP_Unknown:
+                return true;
+        }
+        return false;
+    }
+
+    // Writes one block as a function
+    class BlockWriter
+    {
+    public:
+        BlockWriter(FILE *out, const RomAnalysis &analysis, const QuirkFlags &quirks)
+                   : out(out), analysis(analysis), quirks(quirks), indent("") {}
+
+        void Write(const BasicBlock &block)
+        {
+            memset(used, 0, sizeof(used));
+            memset(dirty, 0, sizeof(dirty));
+            usedI = dirtyI = false;
+            for (uint32_t address = block.start; address < block.end; address += 2) uses(Decode(analysis.Opcode(address)));
+
+            // The budget only matters to blocks that can stop before their end
+            bool early = length(block) > 1;
+            fprintf(out, "    uint32_t block_%03X(Chip8 &cpu, uint32_t%s)\n    {\n", block.start, early ? " budget" : "");
+            bool any = false;
+            for (auto reg=0; reg<16; ++reg) any = any || used[reg];
+            if (any) fprintf(out, "        uint8_t *V = Aot::V(cpu);\n");
+            for (auto reg=0; reg<16; ++reg)
+                if (used[reg]) fprintf(out, "        uint8_t v%X = V[0x%X];\n", reg, reg);
+            if (usedI) fprintf(out, "        uint16_t i = Aot::I(cpu);\n");
+            fprintf(out, "        const uint32_t first = (Aot::PC(cpu) - 0x%03X) / 2;\n", block.start);
+            if (early) fprintf(out, "        const uint32_t last = first + budget;\n");
+            fprintf(out, "        switch (first)\n        {\n");
+
+            uint32_t executed = 0;
+            for (uint32_t address = block.start; address < block.end; address += 2)
+            {
+                uint16_t opcode = analysis.Opcode(address);
+                // Out of cycles before this one
+                if (executed)
+                {
+                    fprintf(out, "        if (last == %u)\n        {\n", executed);
+                    bool written[16];
+                    bool writtenI = dirtyI;
+                    memcpy(written, dirty, sizeof(dirty));
+                    indent = "    ";
+                    leave(hex(address), analysis.Opcode(address - 2), executed);
+                    indent = "";
+                    memcpy(dirty, written, sizeof(dirty));
+                    dirtyI = writtenI;
+                    fprintf(out, "        }\n");
+                    fprintf(out, "        // fall through\n");
+                }
+                fprintf(out, "        case %u:\n", executed);
+                fprintf(out, "        // %03X  %04X  %s\n", address, opcode, Disassemble(opcode).c_str());
+                if (!instruction(address, opcode, ++executed)) break;
+            }
+            // Runs into the next block
+            if (!ends(Decode(analysis.Opcode(block.end - 2)).op)) leave(hex(block.end), analysis.Opcode(block.end - 2), executed);
+            fprintf(out, "        }\n        return 0;\n    }\n\n");
+        }
+
+    private:
+        static std::string hex(uint32_t value)
+        {
+            char text[16];
+            snprintf(text, sizeof(text), "0x%03X", value);
+            return text;
+        }
+
+        static std::string reg(uint8_t r)
+        {
+            char text[8];
+            snprintf(text, sizeof(text), "v%X", r);
+            return text;
+        }
+
+        // Control flow leaves the block after these
+        static bool ends(uint8_t op)
+        {
+            switch (op)
+            {
+                case OP_Jmp: case OP_Call: case OP_Ret: case OP_Jumpv0: case OP_Unknown:
+                case OP_Jeq: case OP_Jneq: case OP_Jeqr: case OP_Jneqr: case OP_Jkey: case OP_Jnkey:
+                    return true;
+            }
+            return false;
+        }
+
+        // Instructions written for the block, up to the first one leaving it
+        uint32_t length(const BasicBlock &block) const
+        {
+            uint32_t count = 0;
+            for (uint32_t address = block.start; address < block.end; address += 2)
+            {
+                ++count;
+                uint8_t op = Decode(analysis.Opcode(address)).op;
+                if (ends(op) || op == OP_Unknown) break;
+            }
+            return count;
+        }
+
+        // Registers held in locals: the ones instructions generated inline touch
+        void uses(const Instruction &ins)
+        {
+            if (interpreted(ins.op)) return;
+            switch (ins.op)
+            {
+                case OP_Shr: case OP_Shl:
+                    used[0xF] = used[ins.x] = true;
+                    if (quirks.shiftVY) used[ins.y] = true;
+                    break;
+                case OP_Addr: case OP_Sub: case OP_Subb:
+                    used[0xF] = true;
+                    // fall through
+                case OP_Jeqr: case OP_Jneqr: case OP_Setr: case OP_Or: case OP_And: case OP_Xor:
+                    used[ins.y] = true;
+                    // fall through
+                case OP_Jeq: case OP_Jneq: case OP_Set: case OP_Add: case OP_Rand: case OP_Jkey: case OP_Jnkey:
+                case OP_Getdelay: case OP_Setdelay: case OP_Setsound:
+                    used[ins.x] = true;
+                    break;
+                case OP_Seti: usedI = true; break;
+                case OP_Addi:
+                    if (quirks.addiVF) used[0xF] = true;
+                    // fall through
+                case OP_Spritei:
+                    used[ins.x] = usedI = true;
+                    break;
+                case OP_Jumpv0: used[quirks.jumpVX ? (ins.nnn >> 8) & 0xF : 0] = true; break;
+            }
+        }
+
+        void line(const std::string &code) { fprintf(out, "        %s%s\n", indent, code.c_str()); }
+
+        void set(uint8_t r, const std::string &value)
+        {
+            line(reg(r) + " = " + value + ";");
+            dirty[r] = true;
+        }
+
+        // Locals written since the last sync back to the machine
+        void sync()
+        {
+            for (auto r=0; r<16; ++r)
+                if (dirty[r]) fprintf(out, "        %sV[0x%X] = v%X;\n", indent, r, r);
+            if (dirtyI) line("Aot::I(cpu) = i;");
+            memset(dirty, 0, sizeof(dirty));
+            dirtyI = false;
+        }
+
+        // After the interpreter ran an instruction
+        void reload()
+        {
+            for (auto r=0; r<16; ++r)
+                if (used[r]) fprintf(out, "        v%X = V[0x%X];\n", r, r);
+            if (usedI) line("i = Aot::I(cpu);");
+        }
+
+        void leave(const std::string &pc, uint16_t opcode, uint32_t executed)
+        {
+            sync();
+            line("Aot::PC(cpu) = " + pc + ";");
+            fprintf(out, "        %sAot::Opcode(cpu) = 0x%04X;\n", indent, opcode);
+            ret(executed);
+        }
+
+        // Counted from the instruction the block was entered at
+        void ret(uint32_t executed) { fprintf(out, "        %sreturn %u - first;\n", indent, executed); }
+
+        void skip(uint32_t address, const std::string &condition, uint16_t opcode, uint32_t executed)
+        {
+            leave("(" + condition + ") ? " + hex(address + 4) + " : " + hex(address + 2), opcode, executed);
+        }
+
+        // Same statements as the interpreter, on the locals.
+        // False once the block has returned.
+        bool instruction(uint32_t address, uint16_t opcode, uint32_t executed)
+        {
+            Instruction ins = Decode(opcode);
+            std::string x = reg(ins.x), y = reg(ins.y);
+            std::string src = (quirks.shiftVY ? y : x);
+            char kk[8];
+            snprintf(kk, sizeof(kk), "0x%02X", ins.kk);
+
+            if (interpreted(ins.op))
+            {
+                sync();
+                char call[64];
+                snprintf(call, sizeof(call), "Aot::Interpret(cpu, 0x%03X, 0x%04X)", address, opcode);
+                if (ins.op == OP_Unknown)
+                {
+                    line(std::string(call) + ";");
+                    ret(executed);
+                    return false;
+                }
+                // Stored into compiled code, maybe this very block
+                if (ins.op == OP_Push || ins.op == OP_Bcd) fprintf(out, "        if (!%s) return %u - first;\n", call, executed);
+                else line(std::string(call) + ";");
+                // No key pressed: waits on the same instruction
+                if (ins.op == OP_Waitkey) fprintf(out, "        if (Aot::PC(cpu) == 0x%03X) return %u - first;\n", address, executed);
+                reload();
+                return true;
+            }
+
+            switch (ins.op)
+            {
+                case OP_Ret:
+                    leave("Aot::Stack(cpu)[Aot::SP(cpu) = (Aot::SP(cpu) - 1) & 0xF] + 2", opcode, executed);
+                    return false;
+                case OP_Jmp:
+                    leave(hex(ins.nnn), opcode, executed);
+                    return false;
+                case OP_Call:
+                    line("Aot::Stack(cpu)[Aot::SP(cpu)] = " + hex(address) + ";");
+                    line("Aot::SP(cpu) = (Aot::SP(cpu) + 1) & 0xF;");
+                    leave(hex(ins.nnn), opcode, executed);
+                    return false;
+                case OP_Jeq: skip(address, x + " == " + kk, opcode, executed); return false;
+                case OP_Jneq: skip(address, x + " != " + kk, opcode, executed); return false;
+                case OP_Jeqr: skip(address, x + " == " + y, opcode, executed); return false;
+                case OP_Jneqr: skip(address, x + " != " + y, opcode, executed); return false;
+                case OP_Jkey: skip(address, "cpu.keyboard[" + x + "] != 0", opcode, executed); return false;
+                case OP_Jnkey: skip(address, "cpu.keyboard[" + x + "] == 0", opcode, executed); return false;
+                case OP_Jumpv0:
+                    leave("(" + hex(ins.nnn) + " + " + reg(quirks.jumpVX ? (ins.nnn >> 8) & 0xF : 0) + ") & 0xFFF", opcode, executed);
+                    return false;
+
+                case OP_Set: set(ins.x, kk); break;
+                case OP_Add: set(ins.x, x + " + " + kk); break;
+                case OP_Setr: set(ins.x, y); break;
+                case OP_Or: set(ins.x, x + " | " + y); break;
+                case OP_And: set(ins.x, x + " & " + y); break;
+                case OP_Xor: set(ins.x, x + " ^ " + y); break;
+                case OP_Addr:
+                    set(0xF, "(0xFF - " + x + ") < " + y);
+                    set(ins.x, x + " + " + y);
+                    break;
+                case OP_Sub:
+                    set(0xF, x + " < " + y);
+                    set(ins.x, x + " - " + y);
+                    break;
+                case OP_Subb:
+                    set(0xF, x + " > " + y);
+                    set(ins.x, y + " - " + x);
+                    break;
+                case OP_Shr:
+                    set(0xF, src + " & 0x1");
+                    set(ins.x, src + " >> 1");
+                    break;
+                case OP_Shl:
+                    set(0xF, src + " >> 7");
+                    set(ins.x, src + " << 1");
+                    break;
+                case OP_Seti:
+                    line("i = " + hex(ins.nnn) + ";");
+                    dirtyI = true;
+                    break;
+                case OP_Addi:
+                    if (quirks.addiVF) set(0xF, "(i + " + x + ") > 0xFFF");
+                    line("i += " + x + ";");
+                    dirtyI = true;
+                    break;
+                case OP_Spritei:
+                    line("i = " + x + " * 0x5;");
+                    dirtyI = true;
+                    break;
+                case OP_Rand: set(ins.x, std::string(kk) + " & Aot::RandomByte(cpu)"); break;
+                case OP_Getdelay: set(ins.x, "Aot::DelayTimer(cpu)"); break;
+                case OP_Setdelay: line("Aot::DelayTimer(cpu) = " + x + ";"); break;
+                case OP_Setsound: line("Aot::SoundTimer(cpu) = " + x + ";"); break;
+            }
+            return true;
+        }
+
+        FILE *out;
+        const RomAnalysis &analysis;
+        const QuirkFlags &quirks;
+        bool used[16];
+        bool dirty[16];
+        bool usedI;
+        bool dirtyI;
+        // Of the lines written, inside the early returns
+        const char *indent;
+    };
+
+    QuirkFlags flagsOf(QuirkProfile profile)
+    {
+        switch (profile)
+        {
+#define CHIP8_AOT_FLAGS(name) case QuirkProfile::name: return QuirkFlags::Of<name##Quirks>();
+            CHIP8_QUIRK_PROFILES(CHIP8_AOT_FLAGS)
+#undef CHIP8_AOT_FLAGS
+        }
+        return QuirkFlags::Of<LegacyQuirks>();
+    }
+
+    // Enumerator of profile, for the generated code
+    const char *enumerator(QuirkProfile profile)
+    {
+        switch (profile)
+        {
+#define CHIP8_AOT_ENUMERATOR(name) case QuirkProfile::name: return #name;
+            CHIP8_QUIRK_PROFILES(CHIP8_AOT_ENUMERATOR)
+#undef CHIP8_AOT_ENUMERATOR
+        }
+        return "Legacy";
+    }
+
+    bool writeProgram(const char *filename, const std::string &name, const RomImage &rom,
+                      QuirkProfile profile, const char *symbol)
+    {
+        FILE *out = fopen(filename, "w");
+        if (!out) return false;
+
+        RomAnalysis analysis(rom.Data(), rom.Size());
+        QuirkFlags quirks = flagsOf(profile);
+        uint32_t instructions = 0;
+        for (const auto &block : analysis.Blocks()) instructions += (block.end - block.start) / 2;
+
+        fprintf(out, "// Generated by chip8-aot from %s, do not edit.\n", name.c_str());
+        fprintf(out, "// %zu bytes (hash %016llx), %s quirks: %zu blocks, %u instructions.\n\n",
+                rom.Size(), (unsigned long long) rom.Hash(), QuirkProfileName(profile),
+                analysis.Blocks().size(), instructions);
+        fprintf(out, "#include \"AotRuntime.h\"\n\nnamespace\n{\n    const uint8_t rom[] =\n    {");
+        for (size_t i=0; i<rom.Size(); ++i)
+            fprintf(out, "%s0x%02X,", i % 12 ? " " : "\n        ", rom.Data()[i]);
+        fprintf(out, "\n    };\n\n");
+
+        BlockWriter writer(out, analysis, quirks);
+        for (const auto &block : analysis.Blocks()) writer.Write(block);
+
+        fprintf(out, "    const AotBlock blocks[] =\n    {\n");
+        for (const auto &block : analysis.Blocks())
+        {
+            bool idle = block.end - block.start == 2 && analysis.Opcode(block.start) == (0x1000 | block.start);
+            fprintf(out, "        { 0x%03X, 0x%03X, %s, block_%03X },\n", block.start, block.end,
+                    idle ? "true" : "false", block.start);
+        }
+        fprintf(out, "    };\n}\n\n");
+
+        std::string exported = symbol ? symbol : "aot_program";
+        fprintf(out, "extern const AotProgram %s;\n", exported.c_str());
+        fprintf(out, "const AotProgram %s = { \"%s\", rom, sizeof(rom), 0x%016llxull, QuirkProfile::%s,\n"
+                     "                        blocks, sizeof(blocks) / sizeof(blocks[0]) };\n",
+                exported.c_str(), name.c_str(), (unsigned long long) rom.Hash(), enumerator(profile));
+        if (!symbol)
+            fprintf(out, "\nint main(int argc, char *argv[])\n{\n    return AotMain(%s, argc, argv);\n}\n", exported.c_str());
+        return fclose(out) == 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *quirks = NULL;
+    const char *symbol = NULL;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc) quirks = argv[++arg];
+        else if (strcmp(argv[arg], "--symbol") == 0 && arg + 1 < argc) symbol = argv[++arg];
+        else break;
+    }
+
+    if (arg + 2 != argc)
+    {
+        printf("Usage: %s [--quirks legacy|vip|schip] [--symbol name] <ROM file> <output file>\n\n", argv[0]);
+        return 1;
+    }
+
+    RomImage rom(argv[arg], Memory<4096>::PROGRAM_SIZE);
+    if (!rom.Valid())
+    {
+        printf("%s %s\n", argv[arg], rom.Error());
+        return 1;
+    }
+
+    QuirkProfile profile = QuirkProfileForROM(rom.Data(), rom.Size());
+    if (quirks && !QuirkProfileFromName(quirks, profile))
+    {
+        printf("Unknown quirk profile %s\n", quirks);
+        return 1;
+    }
+
+    std::string path = argv[arg];
+    if (!writeProgram(argv[arg + 1], path.substr(path.find_last_of('/') + 1), rom, profile, symbol))
+    {
+        printf("Can't write %s\n", argv[arg + 1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef _AOT_RUNTIME_H_
+#define _AOT_RUNTIME_H_
+
+#include <cstdint>
+#include "Aot.h"
+#include "Chip8.h"
+
+// What the C++ generated by chip8-aot uses to reach the machine. Accessors
+// are inline so the blocks compile down to plain loads and stores.
+struct Aot
+{
+    static uint8_t *V(Chip8 &cpu) { return cpu.V; }
+    static uint16_t &I(Chip8 &cpu) { return cpu.I; }
+    static uint16_t &PC(Chip8 &cpu) { return cpu.pc; }
+    static uint16_t &Opcode(Chip8 &cpu) { return cpu.opcode; }
+    static uint16_t &SP(Chip8 &cpu) { return cpu.sp; }
+    static uint16_t *Stack(Chip8 &cpu) { return cpu.stack; }
+    static uint8_t &DelayTimer(Chip8 &cpu) { return cpu.delay_timer; }
+    static uint8_t &SoundTimer(Chip8 &cpu) { return cpu.sound_timer; }
+    static uint8_t RandomByte(Chip8 &cpu) { return cpu.random.NextByte(); }
+
+    // Runs the instruction at pc through the interpreter: drawing, memory
+    // and key waits aren't worth generating. Registers are read from and
+    // left in the machine. False when it stored into compiled code, the
+    // block has to return right after it.
+    static bool Interpret(Chip8 &cpu, uint16_t pc, uint16_t opcode);
+};
+
+// main() of a compiled program: runs it headless and reports the speed.
+// Usage: <program> [--ipf N] [--seed N] [--verify] [frames]
+// --verify runs the interpreter alongside and compares the final states.
+int AotMain(const AotProgram &program, int argc, char *argv[]);
+
+#endif // _AOT_RUNTIME_H_
@@ -0,0 +1,425 @@
+#include <cstring>
+#include <time.h>
+#include "Batch.h"
+#include "Memory.h"
+#include "Random.h"
+#include "Rom.h"
+
+namespace
+{
+    const uint32_t MEMORY_SIZE = 4096;
+    const uint32_t ADDRESS_MASK = MEMORY_SIZE - 1;
+    // Instances 4 KB apart would all land in the same cache sets: every fetch
+    // of a lockstep cycle would evict the previous ones. One line of padding
+    // spreads them.
+    const uint32_t MEMORY_STRIDE = MEMORY_SIZE + 64;
+} // namespace
+
+Batch::Batch(uint32_t count)
+        : count(count),
+          memory(count * MEMORY_STRIDE, 0),
+          V(16 * count, 0),
+          stack(16 * count, 0),
+          pc(count, 0x200),
+          I(count, 0),
+          sp(count, 0),
+          keys(count, 0),
+          rows(32 * count, 0),
+          random(count),
+          unknown(count, 0),
+          delay(count, 0),
+          sound(count, 0),
+          drawn(count, 1),
+          opcodes(count, 0),
+          kinds(count, 0),
+          groups(count, 0),
+          cycle(0),
+          uniformCycles(0)
+{
+    for (uint32_t i=0; i<count; ++i)
+    {
+        memcpy(&memory[i * MEMORY_STRIDE], chip8_fontset, sizeof(chip8_fontset));
+        Seed(i, time(NULL) + i);
+    }
+    SetQuirks(QuirkProfile::Legacy);
+}
+
+bool Batch::LoadROM(const char *filename)
+{
+    RomImage rom(filename, MEMORY_SIZE - 0x200);
+    if (!rom.Valid()) return false;
+
+    for (uint32_t i=0; i<count; ++i) LoadROM(i, rom.Data(), rom.Size());
+    return true;
+}
+
+bool Batch::LoadROM(uint32_t instance, const uint8_t *rom, size_t size)
+{
+    if (size > MEMORY_SIZE - 0x200) return false;
+    memcpy(&memory[instance * MEMORY_STRIDE + 0x200], rom, size);
+    return true;
+}
+
+void Batch::Seed(uint32_t instance, uint64_t seed)
+{
+    random[instance] = Xorshift(seed).State();
+}
+
+void Batch::SetQuirks(QuirkProfile profile)
+{
+    quirks = profile;
+    switch (profile)
+    {
+#define CHIP8_BIND_QUIRKS(name) case QuirkProfile::name: runLoop = &Batch::run<name##Quirks>; break;
+        CHIP8_QUIRK_PROFILES(CHIP8_BIND_QUIRKS)
+#undef CHIP8_BIND_QUIRKS
+    }
+}
+
+void Batch::UpdateTimers()
+{
+    for (uint32_t i=0; i<count; ++i)
+    {
+        delay[i] -= delay[i] > 0;
+        sound[i] -= sound[i] > 0;
+    }
+}
+
+void Batch::Save(uint32_t instance, Snapshot &snapshot) const
+{
+    snapshot.magic = Snapshot::MAGIC;
+    snapshot.version = Snapshot::VERSION;
+    snapshot.size = sizeof(Snapshot);
+    snapshot.reserved = 0;
+
+    for (uint32_t y=0; y<32; ++y) snapshot.display[y] = rows[y * count + instance];
+    memcpy(snapshot.memory, &memory[instance * MEMORY_STRIDE], sizeof(snapshot.memory));
+    for (uint32_t r=0; r<16; ++r) snapshot.stack[r] = stack[r * count + instance];
+    snapshot.pc = pc[instance];
+    snapshot.opcode = opcodes[instance];
+    snapshot.I = I[instance];
+    snapshot.sp = sp[instance];
+    for (uint32_t r=0; r<16; ++r) snapshot.V[r] = V[r * count + instance];
+    for (uint32_t k=0; k<16; ++k) snapshot.keyboard[k] = (keys[instance] >> k) & 1;
+    snapshot.delay_timer = delay[instance];
+    snapshot.sound_timer = sound[instance];
+    snapshot.drawF = drawn[instance];
+    memset(snapshot.padding, 0, sizeof(snapshot.padding));
+    snapshot.cycle = cycle;
+    snapshot.random = random[instance];
+}
+
+// The cycle count is shared by the whole batch and isn't restored
+bool Batch::Restore(uint32_t instance, const Snapshot &snapshot)
+{
+    if (!snapshot.Valid()) return false;
+
+    for (uint32_t y=0; y<32; ++y) rows[y * count + instance] = snapshot.display[y];
+    memcpy(&memory[instance * MEMORY_STRIDE], snapshot.memory, sizeof(snapshot.memory));
+    for (uint32_t r=0; r<16; ++r) stack[r * count + instance] = snapshot.stack[r];
+    pc[instance] = snapshot.pc;
+    opcodes[instance] = snapshot.opcode;
+    I[instance] = snapshot.I;
+    sp[instance] = snapshot.sp;
+    for (uint32_t r=0; r<16; ++r) V[r * count + instance] = snapshot.V[r];
+    keys[instance] = 0;
+    for (uint32_t k=0; k<16; ++k) keys[instance] |= (snapshot.keyboard[k] != 0) << k;
+    delay[instance] = snapshot.delay_timer;
+    sound[instance] = snapshot.sound_timer;
+    random[instance] = Xorshift(snapshot.random).State();
+    drawn[instance] = 1;
+    return true;
+}
+
+Batch::Lanes Batch::lanes()
+{
+    Lanes l;
+    l.memory = memory.data();
+    l.V = V.data();
+    l.stack = stack.data();
+    l.pc = pc.data();
+    l.I = I.data();
+    l.sp = sp.data();
+    l.keys = keys.data();
+    l.rows = rows.data();
+    l.random = random.data();
+    l.unknown = unknown.data();
+    l.delay = delay.data();
+    l.sound = sound.data();
+    l.drawn = drawn.data();
+    l.count = count;
+    return l;
+}
+
+template <class Q>
+void Batch::run(uint32_t cycles)
+{
+    const Lanes l = lanes();
+    const Instruction *table = DecodeTable();
+    uint16_t *ops = opcodes.data();
+    uint8_t *kind = kinds.data();
+    uint32_t *group = groups.data();
+
+    while (cycles--)
+    {
+        // fetch: a gather, every instance reads its own memory
+        uint16_t differ = 0;
+        for (uint32_t i=0; i<count; ++i)
+        {
+            const uint8_t *m = l.memory + i * MEMORY_STRIDE;
+            // pc runs past 0xFFE after the last instruction of memory
+            l.pc[i] &= ADDRESS_MASK;
+            ops[i] = m[l.pc[i]] << 8 | m[(l.pc[i] + 1) & ADDRESS_MASK];
+            differ |= ops[i] ^ ops[0];
+        }
+
+        if (!differ)
+        {
+            const Instruction &ins = table[ops[0]];
+            switch (ins.op)
+            {
+#define CHIP8_BATCH_ALL(name) case OP_##name: runAll<Q, OP_##name>(l, ins); break;
+                CHIP8_OPS(CHIP8_BATCH_ALL)
+#undef CHIP8_BATCH_ALL
+            }
+            ++uniformCycles;
+        }
+        else
+        {
+            // counting sort of the instances by operation, start[op] is where its group begins
+            uint32_t start[OP_COUNT + 1] = {0};
+            for (uint32_t i=0; i<count; ++i)
+            {
+                kind[i] = table[ops[i]].op;
+                ++start[kind[i] + 1];
+            }
+            for (uint32_t op=0; op<OP_COUNT; ++op) start[op + 1] += start[op];
+            uint32_t next[OP_COUNT];
+            memcpy(next, start, sizeof(next));
+            for (uint32_t i=0; i<count; ++i) group[next[kind[i]]++] = i;
+
+            for (uint32_t op=0; op<OP_COUNT; ++op)
+            {
+                uint32_t size = start[op + 1] - start[op];
+                if (!size) continue;
+                switch (op)
+                {
+#define CHIP8_BATCH_GROUP(name) case OP_##name: runGroup<Q, OP_##name>(l, group + start[op], size, ops); break;
+                    CHIP8_OPS(CHIP8_BATCH_GROUP)
+#undef CHIP8_BATCH_GROUP
+                }
+            }
+        }
+        ++cycle;
+    }
+}
+
+template <class Q, uint8_t OP>
+void Batch::runAll(const Lanes &l, const Instruction &ins)
+{
+    for (uint32_t i=0; i<l.count; ++i) step<Q, OP>(l, i, ins);
+}
+
+template <class Q, uint8_t OP>
+void Batch::runGroup(const Lanes &l, const uint32_t *group, uint32_t size, const uint16_t *opcodes)
+{
+    const Instruction *table = DecodeTable();
+    for (uint32_t k=0; k<size; ++k) step<Q, OP>(l, group[k], table[opcodes[group[k]]]);
+}
+
+// Same operations as Chip8Ops.h, on lane i. Registers are read in the same
+// order, so VF as an operand gives the same results.
+template <class Q, uint8_t OP>
+void Batch::step(const Lanes &l, uint32_t i, const Instruction &ins)
+{
+    const uint32_t n = l.count;
+    uint8_t *V = l.V + i;
+    uint8_t &VX = V[ins.x * n];
+    uint8_t &VY = V[ins.y * n];
+    uint8_t &VF = V[0xF * n];
+    uint8_t *m = l.memory + i * MEMORY_STRIDE;
+
+    switch (OP)
+    {
+        case OP_Unknown:
+            ++l.unknown[i];
+            break;
+        case OP_Clear:
+            for (uint32_t y=0; y<32; ++y) l.rows[y * n + i] = 0;
+            l.drawn[i] = 1;
+            l.pc[i] += 2;
+            break;
+        case OP_Ret:
+            l.sp[i] = (l.sp[i] - 1) & 0xF;
+            l.pc[i] = l.stack[l.sp[i] * n + i] + 2;
+            break;
+        case OP_Jmp:
+            l.pc[i] = ins.nnn;
+            break;
+        case OP_Call:
+            l.stack[l.sp[i] * n + i] = l.pc[i];
+            l.sp[i] = (l.sp[i] + 1) & 0xF;
+            l.pc[i] = ins.nnn;
+            break;
+        case OP_Jeq:
+            l.pc[i] += VX == ins.kk ? 4 : 2;
+            break;
+        case OP_Jneq:
+            l.pc[i] += VX != ins.kk ? 4 : 2;
+            break;
+        case OP_Jeqr:
+            l.pc[i] += VX == VY ? 4 : 2;
+            break;
+        case OP_Set:
+            VX = ins.kk;
+            l.pc[i] += 2;
+            break;
+        case OP_Add:
+            VX += ins.kk;
+            l.pc[i] += 2;
+            break;
+        case OP_Setr:
+            VX = VY;
+            l.pc[i] += 2;
+            break;
+        case OP_Or:
+            VX |= VY;
+            l.pc[i] += 2;
+            break;
+        case OP_And:
+            VX &= VY;
+            l.pc[i] += 2;
+            break;
+        case OP_Xor:
+            VX ^= VY;
+            l.pc[i] += 2;
+            break;
+        case OP_Addr:
+            VF = (0xFF - VX) < VY;
+            VX += VY;
+            l.pc[i] += 2;
+            break;
+        case OP_Sub:
+            VF = VX < VY;
+            VX -= VY;
+            l.pc[i] += 2;
+            break;
+        case OP_Shr:
+        {
+            uint8_t &from = Q::shiftVY ? VY : VX;
+            VF = from & 0x1;
+            VX = from >> 1;
+            l.pc[i] += 2;
+            break;
+        }
+        case OP_Subb:
+            VF = VX > VY;
+            VX = VY - VX;
+            l.pc[i] += 2;
+            break;
+        case OP_Shl:
+        {
+            uint8_t &from = Q::shiftVY ? VY : VX;
+            VF = from >> 7;
+            VX = from << 1;
+            l.pc[i] += 2;
+            break;
+        }
+        case OP_Jneqr:
+            l.pc[i] += VX != VY ? 4 : 2;
+            break;
+        case OP_Seti:
+            l.I[i] = ins.nnn;
+            l.pc[i] += 2;
+            break;
+        case OP_Jumpv0:
+            l.pc[i] = (ins.nnn + (Q::jumpVX ? VX : V[0])) & ADDRESS_MASK;
+            break;
+        case OP_Rand:
+        {
+            Xorshift generator(l.random[i]);
+            VX = ins.kk & generator.NextByte();
+            l.random[i] = generator.State();
+            l.pc[i] += 2;
+            break;
+        }
+        case OP_Draw:
+            draw(l, i, ins);
+            l.pc[i] += 2;
+            break;
+        case OP_Jkey:
+            l.pc[i] += (l.keys[i] >> (VX & 0xF)) & 1 ? 4 : 2;
+            break;
+        case OP_Jnkey:
+            l.pc[i] += (l.keys[i] >> (VX & 0xF)) & 1 ? 2 : 4;
+            break;
+        case OP_Getdelay:
+            VX = l.delay[i];
+            l.pc[i] += 2;
+            break;
+        case OP_Waitkey:
+            // the highest pressed key, as Chip8 scans them all
+            if (l.keys[i])
+            {
+                VX = 31 - __builtin_clz(l.keys[i]);
+                l.pc[i] += 2;
+            }
+            break;
+        case OP_Setdelay:
+            l.delay[i] = VX;
+            l.pc[i] += 2;
+            break;
+        case OP_Setsound:
+            l.sound[i] = VX;
+            l.pc[i] += 2;
+            break;
+        case OP_Addi:
+            if (Q::addiVF) VF = (l.I[i] + VX) > 0xFFF;
+            l.I[i] += VX;
+            l.pc[i] += 2;
+            break;
+        case OP_Spritei:
+            l.I[i] = VX * 0x5;
+            l.pc[i] += 2;
+            break;
+        case OP_Bcd:
+            m[l.I[i] & ADDRESS_MASK] = VX / 100;
+            m[(l.I[i] + 1) & ADDRESS_MASK] = (VX / 10) % 10;
+            m[(l.I[i] + 2) & ADDRESS_MASK] = VX % 10;
+            l.pc[i] += 2;
+            break;
+        case OP_Push:
+            for (uint32_t r=0; r<=ins.x; ++r) m[(l.I[i] + r) & ADDRESS_MASK] = V[r * n];
+            if (Q::loadStoreI) l.I[i] += ins.x + 1;
+            l.pc[i] += 2;
+            break;
+        case OP_Pop:
+            for (uint32_t r=0; r<=ins.x; ++r) V[r * n] = m[(l.I[i] + r) & ADDRESS_MASK];
+            if (Q::loadStoreI) l.I[i] += ins.x + 1;
+            l.pc[i] += 2;
+            break;
+    }
+}
+
+void Batch::draw(const Lanes &l, uint32_t i, const Instruction &ins)
+{
+    const uint32_t n = l.count;
+    const uint8_t *m = l.memory + i * MEMORY_STRIDE;
+    uint8_t x = l.V[ins.x * n + i] & 63;
+    uint8_t y = l.V[ins.y * n + i];
+    uint8_t collision = 0;
+    for (uint32_t j=0; j<ins.n; ++j)
+    {
+        uint64_t sprite = static_cast<uint64_t>(m[(l.I[i] + j) & ADDRESS_MASK]) << 56;
+        uint64_t bits = (sprite >> x) | (x ? sprite << (64 - x) : 0);
+        uint64_t &row = l.rows[((y + j) & 31) * n + i];
+        collision |= (row & bits) != 0;
+        row ^= bits;
+    }
+    l.V[0xF * n + i] = collision;
+    l.drawn[i] = 1;
+}
+
+#define CHIP8_INSTANTIATE(name) template void Batch::run<name##Quirks>(uint32_t cycles);
+CHIP8_QUIRK_PROFILES(CHIP8_INSTANTIATE)
+#undef CHIP8_INSTANTIATE
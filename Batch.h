@@ -0,0 +1,124 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Dispatch.h"
+#include "Quirks.h"
+#include "Snapshot.h"
+
+// Many original machines stepped in lockstep, for training agents and mass
+// regression runs. State is stored as a struct of arrays, one array per
+// register with one lane per instance: about 4.5 KB per instance against
+// more than 100 KB for a Chip8 and its block cache, which is what makes it
+// faster than separate Chip8 machines from a few hundred instances on
+// (chip8-bench --batch N compares them). An instruction shared by every
+// instance is one loop over the lanes, but once their input differs that's
+// rare (see UniformShare): diverging instances are grouped by operation and
+// every group runs its own loop, instead of dispatching once per instance.
+//
+// Instances have no audio, no engines nor profiler: they give the same
+// results as Chip8, except that addresses wrap at 4 KB instead of reading
+// past the memory of the instance.
+class Batch
+{
+public:
+    explicit Batch(uint32_t count);
+    ~Batch() = default;
+    Batch (const Batch &) = delete;
+    Batch & operator=(const Batch &) = delete;
+
+    uint32_t Size() const { return count; }
+
+    // Same program in every instance
+    bool LoadROM(const char *filename);
+    bool LoadROM(uint32_t instance, const uint8_t *rom, size_t size);
+    void SetQuirks(QuirkProfile profile);
+    QuirkProfile GetQuirks() const { return quirks; }
+    void Seed(uint32_t instance, uint64_t seed);
+    // One bit per key, bit N for key N
+    void SetKeys(uint32_t instance, uint16_t pressed) { keys[instance] = pressed; }
+
+    // Runs cycles instructions on every instance
+    void Run(uint32_t cycles) { (this->*runLoop)(cycles); }
+    // Delay and sound timers of every instance count down at 60 Hz: call it once per frame
+    void UpdateTimers();
+    void RunFrame(uint32_t instructions) { Run(instructions); UpdateTimers(); }
+    // Instructions executed by every instance since power on
+    uint64_t Cycle() const { return cycle; }
+
+    // Row y of instance, leftmost pixel in the most significant bit
+    uint64_t Row(uint32_t instance, uint32_t y) const { return rows[y * count + instance]; }
+    // Screen of instance drawn since the last ClearDrawn
+    bool Drawn(uint32_t instance) const { return drawn[instance] != 0; }
+    void ClearDrawn(uint32_t instance) { drawn[instance] = 0; }
+    bool Beeping(uint32_t instance) const { return sound[instance] > 0; }
+    uint64_t UnknownOpcodes(uint32_t instance) const { return unknown[instance]; }
+
+    // Moves instances in and out of the batch, in the Chip8 snapshot format
+    void Save(uint32_t instance, Snapshot &snapshot) const;
+    bool Restore(uint32_t instance, const Snapshot &snapshot);
+
+    // Share of the cycles run with every instance on the same instruction
+    double UniformShare() const { return cycle ? static_cast<double>(uniformCycles) / cycle : 0.0; }
+
+private:
+    // Pointers to the lanes, copied to a local by the run loop: the compiler
+    // then knows a store to one array doesn't move the others
+    struct Lanes
+    {
+        uint8_t *memory;
+        uint8_t *V;         // 16 arrays of count lanes, VX of instance i at V[X * count + i]
+        uint16_t *stack;    // 16 arrays as well
+        uint16_t *pc;
+        uint16_t *I;
+        uint16_t *sp;
+        uint16_t *keys;
+        uint64_t *rows;     // 32 arrays, row Y of instance i at rows[Y * count + i]
+        uint64_t *random;
+        uint64_t *unknown;
+        uint8_t *delay;
+        uint8_t *sound;
+        uint8_t *drawn;
+        uint32_t count;
+    };
+
+    template <class Q> void run(uint32_t cycles);
+    // Every instance on the same instruction
+    template <class Q, uint8_t OP> static void runAll(const Lanes &l, const Instruction &ins);
+    // Instances listed in group, all on operation OP
+    template <class Q, uint8_t OP> static void runGroup(const Lanes &l, const uint32_t *group, uint32_t size, const uint16_t *opcodes);
+    template <class Q, uint8_t OP> static inline void step(const Lanes &l, uint32_t i, const Instruction &ins);
+    static inline void draw(const Lanes &l, uint32_t i, const Instruction &ins);
+
+    Lanes lanes();
+
+private:
+    uint32_t count;
+
+    std::vector<uint8_t> memory;
+    std::vector<uint8_t> V;
+    std::vector<uint16_t> stack;
+    std::vector<uint16_t> pc;
+    std::vector<uint16_t> I;
+    std::vector<uint16_t> sp;
+    std::vector<uint16_t> keys;
+    std::vector<uint64_t> rows;
+    std::vector<uint64_t> random;
+    std::vector<uint64_t> unknown;
+    std::vector<uint8_t> delay;
+    std::vector<uint8_t> sound;
+    std::vector<uint8_t> drawn;
+    // Last opcode of every instance, and the scratch lists of the grouping
+    std::vector<uint16_t> opcodes;
+    std::vector<uint8_t> kinds;
+    std::vector<uint32_t> groups;
+
+    uint64_t cycle;
+    uint64_t uniformCycles;
+    QuirkProfile quirks;
+    void (Batch::*runLoop)(uint32_t cycles);
+};
+
+#endif // _BATCH_H_
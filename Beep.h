@@ -1,70 +1,153 @@
 #ifndef _BEEP_H_
 #define _BEEP_H_
 
-#include <SDL/SDL_audio.h>
+#include <SDL2/SDL.h>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "Sink.h"
 
-namespace
-{
-    void audio_callback(void *beep, uint8_t *stream, int lenght);
-}
-
-class Beep
+// 1 kHz tone on an SDL2 audio device of its own. The frontend opens the
+// device from the main thread the first time it sees the beep started (FX18
+// with a nonzero value), so programs that never beep don't open one and the
+// emulation thread never waits on it. It then keeps playing: its callback
+// outputs the tone or silence according to a lock-free flag, so starting and
+// stopping the beep only flips that flag.
+// Samples come from a table holding one period of a band-limited square
+// wave, stepped through with a fixed point phase. Once an XO-CHIP program
+// sets an audio pattern, its 128 one bit samples are played instead.
+class Beep : public AudioSink
 {
 public:
-    Beep(): pos(0.0), inc(2 * M_PI * 1000 / FREQUENCY)
+    Beep() : device(0), phase(0), step(static_cast<uint32_t>(TONE * 4294967296.0 / FREQUENCY)), playing(false),
+             pattern{{0}, {0}}, patternPhase(0), patternStep(0), patterned(false)
     {
-        SDL_AudioSpec desiredSpec;
+        // Odd harmonics of the square wave, up to the Nyquist frequency
+        for (auto i=0; i<TABLE_SIZE; ++i)
+        {
+            double t = 2 * M_PI * i / TABLE_SIZE, sum = 0.0;
+            for (auto k=1; k * TONE < FREQUENCY / 2; k += 2) sum += std::sin(k * t) / k;
+            table[i] = static_cast<int16_t>(AMPLITUDE * 4 / M_PI * sum);
+        }
+    }
 
+    // SDL_Quit may have closed the device already
+    ~Beep()
+    {
+        if (!device || !SDL_WasInit(SDL_INIT_AUDIO)) return;
+        SDL_CloseAudioDevice(device);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+
+    Beep (const Beep &) = delete;
+    Beep & operator=(const Beep &) = delete;
+
+    // Main thread only, once: without an audio device the beep stays
+    // silent. A beep started before plays from then on.
+    void Open()
+    {
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) return;
+
+        SDL_AudioSpec desiredSpec;
+        SDL_zero(desiredSpec);
         desiredSpec.freq = FREQUENCY;
-        desiredSpec.format = AUDIO_U8;
+        desiredSpec.format = AUDIO_S16SYS;
         desiredSpec.channels = CHANNELS;
         desiredSpec.samples = SAMPLES;
-        desiredSpec.callback = audio_callback;
+        desiredSpec.callback = &Beep::callback;
         desiredSpec.userdata = this;
 
         SDL_AudioSpec obtainedSpec;
-        SDL_OpenAudio(&desiredSpec, &obtainedSpec);
+        device = SDL_OpenAudioDevice(NULL, 0, &desiredSpec, &obtainedSpec, 0);
+        if (device) SDL_PauseAudioDevice(device, 0);
+        else SDL_QuitSubSystem(SDL_INIT_AUDIO);
     }
 
-    ~Beep()
+    // Whether the beep is on, for the main thread to open the device
+    bool Started() const { return playing.load(std::memory_order_relaxed); }
+
+    // Emulation thread
+    void StartBeep() override
     {
-        SDL_CloseAudio();
+        playing.store(true, std::memory_order_relaxed);
     }
 
-    void StartBeep()
+    void StopBeep() override
     {
-        SDL_PauseAudio(0);
+        playing.store(false, std::memory_order_relaxed);
     }
 
-    void StopBeep()
+    void SetPattern(const uint8_t *samples, uint8_t pitch) override
     {
-        SDL_PauseAudio(1);
+        uint64_t words[2] = { 0, 0 };
+        for (auto i=0; i<16; ++i) words[i / 8] |= static_cast<uint64_t>(samples[i]) << (56 - 8 * (i % 8));
+        pattern[0].store(words[0], std::memory_order_relaxed);
+        pattern[1].store(words[1], std::memory_order_relaxed);
+        // The 32 bits of patternPhase span the 128 samples
+        double rate = PATTERN_RATE * std::pow(2.0, (pitch - 64) / 48.0);
+        patternStep.store(static_cast<uint32_t>(rate * 33554432.0 / FREQUENCY), std::memory_order_relaxed);
+        patterned.store(true, std::memory_order_release);
     }
 
-public:
-    double pos;
-    double inc;
-
 private:
-    static const int AMPLITUDE = 2;
-    static const int FREQUENCY = 44100;
-    static const int CHANNELS = 1;
-    static const int SAMPLES = 2048;
-};
-
-namespace
-{
-    void audio_callback(void *beep, uint8_t *stream, int lenght)
+    // Runs on the SDL audio thread
+    static void callback(void *userdata, Uint8 *stream, int length)
     {
-        Beep *beeper = (Beep*) beep;
-        if (!beeper) return;
-        for (auto i=0; i<lenght;++i)
+        Beep *beep = static_cast<Beep *>(userdata);
+        int16_t *samples = reinterpret_cast<int16_t *>(stream);
+        int count = length / sizeof(int16_t);
+
+        if (!beep->playing.load(std::memory_order_relaxed))
+        {
+            memset(stream, 0, length);
+            return;
+        }
+        // A pattern set while the buffer is filled may come half old, half
+        // new: it is only for the next 23 ms
+        if (beep->patterned.load(std::memory_order_acquire))
         {
-            stream[i] = std::sin(beeper->pos) + 127;
-            beeper->pos += beeper->inc;
+            uint64_t words[2] = { beep->pattern[0].load(std::memory_order_relaxed),
+                                  beep->pattern[1].load(std::memory_order_relaxed) };
+            uint32_t patternStep = beep->patternStep.load(std::memory_order_relaxed);
+            for (auto i=0; i<count; ++i)
+            {
+                uint32_t sample = beep->patternPhase >> 25;
+                bool on = (words[sample >> 6] >> (63 - (sample & 63))) & 1;
+                samples[i] = on ? AMPLITUDE : -AMPLITUDE;
+                beep->patternPhase += patternStep;
+            }
+            return;
+        }
+        for (auto i=0; i<count; ++i)
+        {
+            samples[i] = beep->table[beep->phase >> (32 - TABLE_BITS)];
+            beep->phase += beep->step;
         }
     }
-}
+
+private:
+    static const int TONE = 1000;
+    // XO-CHIP pattern samples per second at pitch 64
+    static const int PATTERN_RATE = 4000;
+    static const int AMPLITUDE = 4000;
+    static const int FREQUENCY = 44100;
+    static const int CHANNELS = 1;
+    static const int SAMPLES = 1024;
+    static const int TABLE_BITS = 8;
+    static const int TABLE_SIZE = 1 << TABLE_BITS;
+
+    SDL_AudioDeviceID device;
+    int16_t table[TABLE_SIZE];
+    // Position in the period, the whole 32 bits are one period
+    uint32_t phase;
+    uint32_t step;
+    std::atomic<bool> playing;
+    // XO-CHIP pattern, 64 samples per word, set by the emulation thread
+    std::atomic<uint64_t> pattern[2];
+    uint32_t patternPhase;
+    std::atomic<uint32_t> patternStep;
+    std::atomic<bool> patterned;
+};
 
 #endif //_BEEP_H_
@@ -0,0 +1,933 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dirent.h>
+
+#include "Analysis.h"
+#include "Batch.h"
+#include "Chip8.h"
+#include "Environment.h"
+#include "Expand.h"
+#include "Extended.h"
+#include "Pack.h"
+#include "Rewind.h"
+#include "Rom.h"
+#include "Scheduler.h"
+
+// Compares the execution engines on every ROM found in a directory.
+// Usage: chip8-bench [--engine name] [--quirks profile] [--ipf N] [--repeat N] [--warmup N] [--json file] [ROM dir] [cycles]
+//        chip8-bench --verify [ROM dir]  checks every engine against the reference interpreter, with every quirk profile
+//                                        and with blocks prebuilt from a static analysis, and runs the SUPER-CHIP
+//                                        and XO-CHIP test programs
+//        chip8-bench --expand [frames]   compares the pixel expansion kernels
+//        chip8-bench --snapshot [ROM dir] measures save and restore of the machine state
+//        chip8-bench --rewind [ROM dir]   measures the rewind history cost and checks it plays back
+//        chip8-bench --batch N [ROM dir] [cycles] runs N instances of every ROM in lockstep, cycles in total,
+//                                        then as N separate Chip8 machines
+//        chip8-bench --env N [--threads N] [ROM dir] [cycles] steps N environments of every ROM on a thread pool
+//        chip8-bench --load <ROM pack> [ROM dir] compares loading ROMs from their files and from a pack
+
+namespace
+{
+    std::vector<std::string> listROMs(const char *dir)
+    {
+        std::vector<std::string> roms;
+        DIR *d = opendir(dir);
+        if (!d) return roms;
+
+        while (struct dirent *entry = readdir(d))
+        {
+            std::string name(entry->d_name);
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, ".c8") == 0)
+                roms.push_back(std::string(dir) + "/" + name);
+        }
+        closedir(d);
+        std::sort(roms.begin(), roms.end());
+        return roms;
+    }
+
+    struct Options
+    {
+        uint32_t cycles;
+        uint32_t instructionsPerFrame;
+        uint32_t repetitions;
+        uint32_t warmup;
+        // profile detected from each ROM when not set
+        bool autoQuirks;
+        QuirkProfile quirks;
+        // for --env, 0 is one per hardware thread
+        uint32_t threads;
+    };
+
+    struct Result
+    {
+        std::string rom;
+        Engine engine;
+        // MIPS over the repetitions
+        double mean;
+        double stddev;
+        double min;
+        double max;
+        uint64_t frames;
+        double framesPerSecond;
+        // profiled run
+        uint64_t totalNs;
+        uint64_t drawNs;
+    };
+
+    // Same key presses on every run, so every engine gets the same workload:
+    // every few frames the keypad is released and maybe one key pressed.
+    class InputScript
+    {
+    public:
+        explicit InputScript(uint64_t seed = 0x5C817) : rng(seed) {}
+
+        void Apply(Chip8 &cpu, uint64_t frame)
+        {
+            if (frame % FRAMES_PER_KEY) return;
+            memset(cpu.keyboard, 0, sizeof(cpu.keyboard));
+            uint8_t r = rng.NextByte();
+            if (r & 0x80) cpu.keyboard[r & 0xF] = 1;
+        }
+
+        void Apply(Batch &batch, uint32_t instance, uint64_t frame)
+        {
+            uint16_t pressed = 0;
+            if (Apply(pressed, frame)) batch.SetKeys(instance, pressed);
+        }
+
+        // Keys as a bit mask, false when they don't change on this frame
+        bool Apply(uint16_t &pressed, uint64_t frame)
+        {
+            if (frame % FRAMES_PER_KEY) return false;
+            uint8_t r = rng.NextByte();
+            pressed = (r & 0x80) ? 1 << (r & 0xF) : 0;
+            return true;
+        }
+
+    private:
+        static const uint32_t FRAMES_PER_KEY = 6;
+        Xorshift rng;
+    };
+
+    uint64_t framesFor(const Options &options)
+    {
+        return (options.cycles + options.instructionsPerFrame - 1) / options.instructionsPerFrame;
+    }
+
+    // Runs the ROM for the given cycles in frames with scripted input, returns the elapsed ns
+    double runScripted(const std::string &rom, Engine engine, const Options &options, uint64_t *drawNs)
+    {
+        static const uint64_t SEED = 0xC8;
+
+        Chip8 processor;
+        processor.SetEngine(engine);
+        processor.Seed(SEED);
+        if (!processor.LoadROM(rom.c_str())) return 0.0;
+        processor.SetQuirks(options.autoQuirks ? processor.DetectQuirks() : options.quirks);
+        processor.TimeDraws(drawNs);
+
+        Scheduler scheduler(processor, options.instructionsPerFrame);
+        scheduler.SetTurbo(true);
+        InputScript script;
+        uint64_t frames = framesFor(options);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t f=0; f<frames; ++f)
+        {
+            script.Apply(processor, f);
+            scheduler.RunFrame();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    Result benchmark(const std::string &rom, Engine engine, const Options &options)
+    {
+        Result result;
+        result.rom = rom.substr(rom.find_last_of('/') + 1);
+        result.engine = engine;
+        result.frames = framesFor(options);
+        uint64_t instructions = result.frames * options.instructionsPerFrame;
+
+        for (uint32_t i=0; i<options.warmup; ++i) runScripted(rom, engine, options, NULL);
+
+        std::vector<double> mips;
+        for (uint32_t i=0; i<options.repetitions; ++i)
+        {
+            double ns = runScripted(rom, engine, options, NULL);
+            mips.push_back(ns > 0 ? instructions * 1000.0 / ns : 0.0);
+        }
+
+        double sum = 0.0;
+        for (auto m : mips) sum += m;
+        result.mean = sum / mips.size();
+        double squares = 0.0;
+        for (auto m : mips) squares += (m - result.mean) * (m - result.mean);
+        result.stddev = mips.size() > 1 ? sqrt(squares / (mips.size() - 1)) : 0.0;
+        result.min = *std::min_element(mips.begin(), mips.end());
+        result.max = *std::max_element(mips.begin(), mips.end());
+        result.framesPerSecond = result.mean * 1e6 / options.instructionsPerFrame;
+
+        // Timing every draw has a cost of its own, so the split comes from an extra run
+        result.drawNs = 0;
+        result.totalNs = runScripted(rom, engine, options, &result.drawNs);
+        return result;
+    }
+
+    double drawShare(const Result &r)
+    {
+        return r.totalNs ? (double) r.drawNs / r.totalNs : 0.0;
+    }
+
+    void printResults(const std::vector<Result> &results)
+    {
+        printf("\n%-16s%8s%10s%9s%8s%10s%12s%8s\n", 
+               "ROM", "engine", "MIPS", "stddev", "cv%", "ns/instr", "frames/s", "draw%");
+        for (const auto &r : results)
+        {
+            printf("%-16s%8s%10.2f%9.2f%8.1f%10.2f%12.0f%8.1f\n", r.rom.c_str(), EngineName(r.engine),
+                   r.mean, r.stddev, r.mean > 0 ? 100.0 * r.stddev / r.mean : 0.0, 
+                   r.mean > 0 ? 1000.0 / r.mean : 0.0, r.framesPerSecond, 100.0 * drawShare(r));
+        }
+    }
+
+    // Geometric mean of the MIPS of every ROM, one figure per engine
+    void printSummary(const std::vector<Result> &results, const std::vector<Engine> &engines)
+    {
+        printf("\n%-16s%8s%10s\n", "all ROMs", "engine", "MIPS");
+        for (auto engine : engines)
+        {
+            double logs = 0.0;
+            int count = 0;
+            for (const auto &r : results)
+            {
+                if (r.engine != engine || r.mean <= 0) continue;
+                logs += log(r.mean);
+                ++count;
+            }
+            if (count) printf("%-16s%8s%10.2f\n", "geomean", EngineName(engine), exp(logs / count));
+        }
+    }
+
+    std::string jsonString(const std::string &text)
+    {
+        std::string out = "\"";
+        for (auto c : text)
+        {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    bool writeJSON(const char *filename, const std::vector<Result> &results, const Options &options)
+    {
+        FILE *file = fopen(filename, "w");
+        if (!file) return false;
+
+        fprintf(file, "{\n  \"version\": 1,\n  \"cycles\": %u,\n  \"instructions_per_frame\": %u,\n"
+                      "  \"repetitions\": %u,\n  \"warmup\": %u,\n  \"results\": [\n",
+                options.cycles, options.instructionsPerFrame, options.repetitions, options.warmup);
+        for (size_t i=0; i<results.size(); ++i)
+        {
+            const Result &r = results[i];
+            fprintf(file, "    {\"rom\": %s, \"engine\": \"%s\", "
+                          "\"mips\": {\"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"max\": %.3f}, "
+                          "\"ns_per_instruction\": %.3f, \"frames\": %lu, \"frames_per_second\": %.1f, "
+                          "\"draw_ns\": %lu, \"dispatch_ns\": %lu, \"draw_share\": %.4f}%s\n",
+                    jsonString(r.rom).c_str(), EngineName(r.engine), r.mean, r.stddev, r.min, r.max,
+                    r.mean > 0 ? 1000.0 / r.mean : 0.0, (unsigned long) r.frames, r.framesPerSecond,
+                    (unsigned long) r.drawNs, (unsigned long) (r.totalNs - r.drawNs), drawShare(r),
+                    i + 1 < results.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+        return fclose(file) == 0;
+    }
+
+    void runFrames(Chip8 &processor, uint32_t frames)
+    {
+        Scheduler scheduler(processor);
+        scheduler.SetTurbo(true);
+        for (uint32_t i=0; i<frames; ++i) scheduler.RunFrame();
+    }
+
+    // Same, pressing the keys of a fresh script: machines run with the same
+    // seed get the same key presses
+    void runScriptedFrames(Chip8 &processor, uint32_t frames)
+    {
+        Scheduler scheduler(processor);
+        scheduler.SetTurbo(true);
+        InputScript script;
+        uint16_t pressed = 0;
+        for (uint32_t i=0; i<frames; ++i)
+        {
+            if (script.Apply(pressed, i)) processor.SetKeys(pressed);
+            scheduler.RunFrame();
+        }
+    }
+
+    // Differential test: runs the ROM with the reference interpreter and with
+    // engine from the same seed, quirk profile and key presses, both must end in exactly the same state.
+    // With an analysis of the ROM, the candidate starts with its blocks prebuilt.
+    bool verify(const std::string &rom, Engine engine, QuirkProfile quirks, const RomAnalysis *analysis = NULL)
+    {
+        static const uint32_t checkpoints[] = { 1, 10, 100, 1000, 10000, 100000 };
+        static const uint64_t SEED = 0xC8;
+
+        for (auto frames : checkpoints)
+        {
+            Chip8 reference;
+            Chip8 candidate;
+            reference.SetEngine(Engine::Switch);
+            candidate.SetEngine(engine);
+            reference.SetQuirks(quirks);
+            candidate.SetQuirks(quirks);
+            if (!reference.LoadROM(rom.c_str()) || !candidate.LoadROM(rom.c_str())) return false;
+            if (analysis) candidate.Prebuild(*analysis);
+
+            reference.Seed(SEED);
+            runScriptedFrames(reference, frames);
+            candidate.Seed(SEED);
+            runScriptedFrames(candidate, frames);
+
+            if (!reference.SameState(candidate))
+            {
+                printf("%s: %s engine%s diverges after %u frames with %s quirks\n", 
+                       rom.c_str(), EngineName(engine), analysis ? " (prebuilt)" : "", frames, QuirkProfileName(quirks));
+                return false;
+            }
+
+            // The state must also survive a snapshot round trip
+            Snapshot snapshot;
+            Chip8 restored;
+            candidate.Save(snapshot);
+            if (!restored.Restore(snapshot) || !restored.SameState(candidate))
+            {
+                printf("%s: snapshot after %u frames doesn't restore the same state\n", 
+                       rom.c_str(), frames);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Runs a batch of instances, each with its own seed, next to one reference
+    // interpreter per instance: they must stay in the same state. The seeds
+    // make the instances diverge, so grouped execution gets checked too.
+    bool verifyBatch(const std::string &rom, QuirkProfile quirks)
+    {
+        static const uint32_t checkpoints[] = { 1, 10, 100, 1000, 10000 };
+        static const uint32_t INSTANCES = 8;
+        static const uint64_t SEED = 0xC8;
+
+        Batch batch(INSTANCES);
+        batch.SetQuirks(quirks);
+        if (!batch.LoadROM(rom.c_str())) return false;
+        std::vector<std::unique_ptr<Chip8>> references;
+        for (uint32_t i=0; i<INSTANCES; ++i)
+        {
+            references.emplace_back(new Chip8);
+            references[i]->SetEngine(Engine::Switch);
+            references[i]->SetQuirks(quirks);
+            if (!references[i]->LoadROM(rom.c_str())) return false;
+            references[i]->Seed(SEED + i);
+            batch.Seed(i, SEED + i);
+        }
+
+        uint32_t frames = 0;
+        for (auto checkpoint : checkpoints)
+        {
+            for (uint32_t i=0; i<INSTANCES; ++i) runFrames(*references[i], checkpoint - frames);
+            for (; frames < checkpoint; ++frames) batch.RunFrame(Scheduler::DEFAULT_INSTRUCTIONS_PER_FRAME);
+
+            for (uint32_t i=0; i<INSTANCES; ++i)
+            {
+                Snapshot expected, actual;
+                references[i]->Save(expected);
+                batch.Save(i, actual);
+                if (SnapshotHash(expected) != SnapshotHash(actual))
+                {
+                    printf("%s: batch instance %u diverges after %u frames with %s quirks\n",
+                           rom.c_str(), i, frames, QuirkProfileName(quirks));
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Steps environments on several threads and every instance on its own
+    // reference interpreter: thread scheduling must not change any result
+    bool verifyEnvironment(const std::string &rom)
+    {
+        static const uint32_t INSTANCES = 16;
+        static const uint32_t THREADS = 4;
+        static const uint32_t STEPS = 1000;
+        static const uint64_t SEED = 0xC8;
+
+        VectorEnvironment environment(INSTANCES, THREADS);
+        if (!environment.LoadROM(rom.c_str())) return false;
+        environment.Reset(SEED);
+        std::vector<std::unique_ptr<Chip8>> references;
+        for (uint32_t i=0; i<INSTANCES; ++i)
+        {
+            references.emplace_back(new Chip8);
+            if (!references[i]->LoadROM(rom.c_str())) return false;
+            references[i]->SetQuirks(references[i]->DetectQuirks());
+            references[i]->Seed(SEED + i);
+        }
+
+        std::vector<uint16_t> actions(INSTANCES);
+        for (uint32_t s=0; s<STEPS; ++s)
+        {
+            for (uint32_t i=0; i<INSTANCES; ++i) actions[i] = 1 << ((s / 10 + i) & 0xF);
+            environment.Step(actions.data(), 2);
+            for (uint32_t i=0; i<INSTANCES; ++i)
+            {
+                references[i]->SetKeys(actions[i]);
+                runFrames(*references[i], 2);
+            }
+        }
+
+        for (uint32_t i=0; i<INSTANCES; ++i)
+        {
+            if (!references[i]->SameState(environment.Instance(i)))
+            {
+                printf("%s: environment %u diverges from its reference\n", rom.c_str(), i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The SUPER-CHIP and XO-CHIP interpreters have no second implementation
+    // to be compared with: they run test programs with known results
+    // instead. A program checks registers and memory itself and exits with
+    // 00FD when everything matches (it loops on the first check that fails),
+    // then its screen and what it handed to the audio sink are compared with
+    // what the specification gives.
+    struct PixelCheck
+    {
+        uint32_t plane, x, y;
+        bool on;
+    };
+
+    struct ModeCheck
+    {
+        const char *name;
+        MachineMode mode;
+        // Code and data loaded at 0x200
+        std::vector<uint16_t> program;
+        std::vector<PixelCheck> pixels;
+        // Last audio pattern and pitch received, empty when none is expected
+        std::vector<uint8_t> pattern;
+        uint8_t pitch;
+    };
+
+    const ModeCheck MODE_CHECKS[] =
+    {
+        // 16x16 sprite in high resolution, scrolled right 4 and down 2 pixels
+        // then drawn again: the XOR of two overlapping squares
+        { "schip: 16x16 sprite, scroll right and down", MachineMode::Schip,
+          { 0x00FF, 0xA220, 0x6000, 0x6100, 0xD010, 0x3F00, 0x120C, 0x00FB,
+            0x00C2, 0xD010, 0x4F00, 0x1216, 0x00FD, 0x0000, 0x0000, 0x0000,
+            0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+            0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF },
+          { { 0, 0, 0, true }, { 0, 15, 1, true }, { 0, 16, 1, false }, { 0, 4, 2, false }, { 0, 16, 2, true },
+            { 0, 3, 16, false }, { 0, 4, 16, true }, { 0, 19, 17, true }, { 0, 20, 17, false } },
+          {}, 0 },
+        // Big font 8 (FX30) drawn 8x10 at the right edge and in the bottom
+        // right corner: cut at the edges, nothing wraps to the other side
+        { "schip: big font, clipping", MachineMode::Schip,
+          { 0x00FF, 0x6008, 0xF030, 0x6178, 0x6200, 0xD12A, 0x617C, 0x6214,
+            0xD12A, 0x6100, 0x623C, 0xD12A, 0x00FD },
+          { { 0, 120, 0, true }, { 0, 120, 2, true }, { 0, 122, 2, false }, { 0, 127, 2, true },
+            { 0, 124, 20, true }, { 0, 127, 20, true }, { 0, 0, 20, false }, { 0, 125, 22, true },
+            { 0, 126, 22, false }, { 0, 0, 22, false }, { 0, 0, 60, true }, { 0, 0, 0, false } },
+          {}, 0 },
+        // Font 5 in low resolution (2x2 pixels), scrolled left by 4 of them,
+        // then V3 and V7 through the RPL flags (FX75/FX85)
+        { "schip: low resolution, scroll left, RPL flags", MachineMode::Schip,
+          { 0x00FE, 0x6005, 0xF029, 0x610A, 0x6203, 0xD125, 0x00FC, 0x6333,
+            0x6777, 0xF775, 0x6300, 0x6700, 0xF785, 0x3333, 0x121C, 0x3777,
+            0x1220, 0x00FD },
+          { { 0, 12, 6, true }, { 0, 19, 7, true }, { 0, 20, 6, false }, { 0, 11, 6, false },
+            { 0, 12, 8, true }, { 0, 13, 9, true }, { 0, 14, 8, false } },
+          {}, 0 },
+        // F000 NNNN above 4 KB, 5XY2/5XY3 in both orders, a skip over the
+        // whole F000 NNNN, and FX65 reading back from 0x8000
+        { "xochip: long I, register ranges, long skip", MachineMode::XoChip,
+          { 0x6011, 0x6122, 0x6233, 0xF000, 0x8000, 0x5022, 0x6000, 0x6100,
+            0x6200, 0x5203, 0x3033, 0x1216, 0x3211, 0x121A, 0x3033, 0xF000,
+            0x1220, 0xF065, 0x3011, 0x1226, 0x00FD },
+          {}, {}, 0 },
+        // A pixel on the second plane, both planes drawn with one sprite each
+        // (the second plane's pixel goes off), scrolled up 1 (2 pixels), then
+        // an audio pattern and its pitch
+        { "xochip: planes, scroll up, audio pattern", MachineMode::XoChip,
+          { 0xF201, 0xA230, 0x6004, 0x6105, 0xD011, 0xF301, 0xD011, 0x4F00,
+            0x1210, 0x00D1, 0xF201, 0x6000, 0xD001, 0xA240, 0xF002, 0x6270,
+            0xF23A, 0x00FD, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+            0x8080, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+            0x0102, 0x0304, 0x0506, 0x0708, 0x090A, 0x0B0C, 0x0D0E, 0x0F10 },
+          { { 0, 8, 8, true }, { 0, 9, 9, true }, { 0, 8, 10, false }, { 1, 8, 8, false },
+            { 1, 8, 10, false }, { 1, 0, 0, true }, { 1, 1, 1, true }, { 0, 0, 0, false } },
+          { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 }, 0x70 },
+    };
+
+    // Keeps the last pattern and pitch it was given
+    struct PatternSink : public AudioSink
+    {
+        PatternSink() : pitch(0) {}
+        void StartBeep() override {}
+        void StopBeep() override {}
+        void SetPattern(const uint8_t *samples, uint8_t p) override
+        {
+            pattern.assign(samples, samples + 16);
+            pitch = p;
+        }
+
+        std::vector<uint8_t> pattern;
+        uint8_t pitch;
+    };
+
+    template <class Mode>
+    bool checkMode(const ModeCheck &check)
+    {
+        static const uint32_t MAX_CYCLES = 1000;
+
+        std::vector<uint8_t> rom;
+        for (auto word : check.program)
+        {
+            rom.push_back(word >> 8);
+            rom.push_back(word & 0xFF);
+        }
+        ExtendedChip8<Mode> machine;
+        PatternSink sink;
+        machine.SetAudioSink(&sink);
+        if (!machine.LoadROM(rom.data(), rom.size())) return false;
+        for (uint32_t i=0; i<MAX_CYCLES && !machine.Exited(); ++i) machine.RunCicle();
+
+        if (!machine.Exited())
+        {
+            printf("%s: the program's own checks failed\n", check.name);
+            return false;
+        }
+        for (const auto &pixel : check.pixels)
+        {
+            if (machine.GetPlane(pixel.plane).Pixel(pixel.x, pixel.y) != pixel.on)
+            {
+                printf("%s: pixel %u,%u of plane %u should be %s\n", check.name, pixel.x, pixel.y, pixel.plane,
+                       pixel.on ? "on" : "off");
+                return false;
+            }
+        }
+        if (sink.pattern != check.pattern || sink.pitch != check.pitch)
+        {
+            printf("%s: wrong audio pattern or pitch\n", check.name);
+            return false;
+        }
+        return true;
+    }
+
+    // Returns the number of failures
+    int verifyModes()
+    {
+        int failures = 0;
+        for (const auto &check : MODE_CHECKS)
+            failures += !(check.mode == MachineMode::Schip ? checkMode<SchipMode>(check) : checkMode<XoChipMode>(check));
+        printf("%d SUPER-CHIP and XO-CHIP programs checked: %d failures\n",
+               (int) (sizeof(MODE_CHECKS) / sizeof(MODE_CHECKS[0])), failures);
+        return failures;
+    }
+
+    // Expands a full 64x32 frame frames times with kernel, returns ns per frame
+    double measureExpand(ExpandKernel kernel, uint32_t frames, uint32_t *pixels)
+    {
+        uint64_t rows[32];
+        for (auto y=0; y<32; ++y) rows[y] = 0x9E3779B97F4A7C15ull * (y + 1);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i=0; i<frames; ++i)
+        {
+            rows[i & 31] ^= i;
+            kernel(rows, 32, pixels);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::nano>(end - start).count() / frames;
+    }
+
+    // Returns ns per Save and per Restore, averaged over iterations
+    void measureSnapshot(const std::string &rom, Engine engine, uint32_t iterations, double &save, double &restore)
+    {
+        Chip8 processor;
+        processor.SetEngine(engine);
+        save = restore = 0.0;
+        if (!processor.LoadROM(rom.c_str())) return;
+        runFrames(processor, 100);
+
+        Snapshot snapshot;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i=0; i<iterations; ++i) processor.Save(snapshot);
+        auto end = std::chrono::steady_clock::now();
+        save = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i=0; i<iterations; ++i) processor.Restore(snapshot);
+        end = std::chrono::steady_clock::now();
+        restore = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    }
+
+    int benchSnapshot(const std::vector<std::string> &roms, Engine engine)
+    {
+        static const uint32_t ITERATIONS = 100000;
+
+        printf("%-24s%14s%14s\n", "ROM", "save ns", "restore ns");
+        for (const auto &rom : roms)
+        {
+            double save, restore;
+            measureSnapshot(rom, engine, ITERATIONS, save, restore);
+            printf("%-24s%14.1f%14.1f\n", rom.substr(rom.find_last_of('/') + 1).c_str(), save, restore);
+        }
+        printf("snapshot size: %u bytes\n", (unsigned) sizeof(Snapshot));
+        return 0;
+    }
+
+    // Loading every ROM from its own file against copying it out of a pack
+    int benchLoad(const std::vector<std::string> &roms, const char *filename)
+    {
+        static const uint32_t ITERATIONS = 20000;
+
+        auto opening = std::chrono::steady_clock::now();
+        RomPack pack(filename);
+        double openUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - opening).count();
+        if (!pack.Valid())
+        {
+            printf("%s isn't a valid ROM pack, build it with chip8-pack\n", filename);
+            return 1;
+        }
+
+        Chip8 fromFile, fromPack;
+        int failures = 0;
+        double fileSum = 0.0, packSum = 0.0;
+        printf("%-24s%14s%14s\n", "ROM", "file ns", "pack ns");
+        for (const auto &rom : roms)
+        {
+            std::string name = rom.substr(rom.find_last_of('/') + 1);
+            int32_t index = pack.FindName(name.c_str());
+            if (index < 0)
+            {
+                printf("%-24s%14s\n", name.c_str(), "not packed");
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i=0; i<ITERATIONS; ++i) fromFile.LoadROM(rom.c_str());
+            auto end = std::chrono::steady_clock::now();
+            double file = std::chrono::duration<double, std::nano>(end - start).count() / ITERATIONS;
+
+            start = std::chrono::steady_clock::now();
+            for (uint32_t i=0; i<ITERATIONS; ++i) pack.Load(index, fromPack);
+            end = std::chrono::steady_clock::now();
+            double packed = std::chrono::duration<double, std::nano>(end - start).count() / ITERATIONS;
+
+            bool same = memcmp(fromFile.RAM(), fromPack.RAM(), 4096) == 0;
+            failures += !same;
+            fileSum += file;
+            packSum += packed;
+            printf("%-24s%14.1f%14.1f%s\n", name.c_str(), file, packed, same ? "" : "  MISMATCH");
+        }
+        printf("total: %.1f us from files, %.1f us from the pack (opened in %.1f us)\n", fileSum / 1000, packSum / 1000, openUs);
+        return failures ? 1 : 0;
+    }
+
+    // Records frames of history, then steps back through the last CHECKED ones
+    // comparing them with full snapshots taken while running
+    int benchRewind(const std::vector<std::string> &roms)
+    {
+        static const uint32_t FRAMES = 3600;
+        static const uint32_t CHECKED = 600;
+        static const size_t CAPACITY = 16 << 20;
+
+        printf("%-24s%14s%14s%10s\n", "ROM", "ns/record", "KB/s", "");
+        std::vector<Snapshot> expected(CHECKED);
+        int failures = 0;
+        for (const auto &rom : roms)
+        {
+            Chip8 processor;
+            if (!processor.LoadROM(rom.c_str())) continue;
+            Scheduler scheduler(processor);
+            scheduler.SetTurbo(true);
+            RewindBuffer history(FRAMES, CAPACITY);
+
+            double ns = 0.0;
+            for (uint32_t i=0; i<FRAMES; ++i)
+            {
+                scheduler.RunFrame();
+                auto start = std::chrono::steady_clock::now();
+                history.Record(processor);
+                auto end = std::chrono::steady_clock::now();
+                ns += std::chrono::duration<double, std::nano>(end - start).count();
+                if (i >= FRAMES - CHECKED) processor.Save(expected[i - (FRAMES - CHECKED)]);
+            }
+            double bytesPerSecond = history.BytesPerSecond();
+
+            bool ok = true;
+            Snapshot snapshot;
+            for (uint32_t i=CHECKED - 1; i>0 && ok; --i)
+                ok = history.StepBack(snapshot) && memcmp(&snapshot, &expected[i - 1], sizeof(Snapshot)) == 0;
+            failures += !ok;
+
+            printf("%-24s%14.1f%14.1f%10s\n", rom.substr(rom.find_last_of('/') + 1).c_str(), 
+                   ns / FRAMES, bytesPerSecond / 1024, ok ? "" : "MISMATCH");
+        }
+        return failures ? 1 : 0;
+    }
+
+    // Runs instances copies of every ROM in lockstep, each with its own seed
+    // and scripted input, for cycles instructions in total. The same
+    // instances then run as separate Chip8 machines one after the other
+    // with the default engine, for comparison.
+    int benchBatch(const std::vector<std::string> &roms, uint32_t instances, const Options &options)
+    {
+        uint64_t frames = std::max<uint64_t>(1, framesFor(options) / instances);
+        uint64_t instructions = frames * options.instructionsPerFrame * instances;
+
+        printf("%-16s%10s%10s%10s%10s%10s\n", "ROM", "instances", "MIPS", "ns/instr", "uniform%", "scalar");
+        double logs = 0.0;
+        double scalarLogs = 0.0;
+        int count = 0;
+        for (const auto &rom : roms)
+        {
+            Batch batch(instances);
+            Chip8 probe;
+            if (!batch.LoadROM(rom.c_str()) || !probe.LoadROM(rom.c_str())) continue;
+            QuirkProfile quirks = options.autoQuirks ? probe.DetectQuirks() : options.quirks;
+            batch.SetQuirks(quirks);
+            std::vector<InputScript> scripts;
+            for (uint32_t i=0; i<instances; ++i)
+            {
+                scripts.emplace_back(0x5C817 + i);
+                batch.Seed(i, 0xC8 + i);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t f=0; f<frames; ++f)
+            {
+                for (uint32_t i=0; i<instances; ++i) scripts[i].Apply(batch, i, f);
+                batch.RunFrame(options.instructionsPerFrame);
+            }
+            auto end = std::chrono::steady_clock::now();
+            double mips = instructions * 1000.0 / std::chrono::duration<double, std::nano>(end - start).count();
+
+            std::vector<std::unique_ptr<Chip8>> machines;
+            scripts.clear();
+            for (uint32_t i=0; i<instances; ++i)
+            {
+                machines.emplace_back(new Chip8());
+                machines.back()->LoadROM(rom.c_str());
+                machines.back()->SetQuirks(quirks);
+                machines.back()->Seed(0xC8 + i);
+                scripts.emplace_back(0x5C817 + i);
+            }
+
+            start = std::chrono::steady_clock::now();
+            for (uint64_t f=0; f<frames; ++f)
+            {
+                for (uint32_t i=0; i<instances; ++i)
+                {
+                    scripts[i].Apply(*machines[i], f);
+                    machines[i]->Run(options.instructionsPerFrame);
+                    machines[i]->UpdateTimers();
+                }
+            }
+            end = std::chrono::steady_clock::now();
+            double scalar = instructions * 1000.0 / std::chrono::duration<double, std::nano>(end - start).count();
+
+            printf("%-16s%10u%10.2f%10.2f%10.1f%10.2f\n", rom.substr(rom.find_last_of('/') + 1).c_str(), instances,
+                   mips, 1000.0 / mips, 100.0 * batch.UniformShare(), scalar);
+            logs += log(mips);
+            scalarLogs += log(scalar);
+            ++count;
+        }
+        if (count) printf("\n%-16s%10u%10.2f%30.2f\n", "geomean", instances, exp(logs / count), exp(scalarLogs / count));
+        return 0;
+    }
+
+    // Steps environments of every ROM one frame at a time, each with its own
+    // scripted input, for cycles instructions in total
+    int benchEnvironment(const std::vector<std::string> &roms, uint32_t count, Engine engine, const Options &options)
+    {
+        uint64_t steps = std::max<uint64_t>(1, framesFor(options) / count);
+
+        printf("%-16s%10s%10s%14s%10s\n", "ROM", "envs", "threads", "steps/s", "MIPS");
+        double logs = 0.0;
+        int n = 0;
+        for (const auto &rom : roms)
+        {
+            VectorEnvironment environment(count, options.threads);
+            environment.SetEngine(engine);
+            environment.SetInstructionsPerFrame(options.instructionsPerFrame);
+            if (!environment.LoadROM(rom.c_str())) continue;
+            if (!options.autoQuirks) environment.SetQuirks(options.quirks);
+            environment.Reset(0xC8);
+
+            std::vector<InputScript> scripts;
+            for (uint32_t i=0; i<count; ++i) scripts.emplace_back(0x5C817 + i);
+            std::vector<uint16_t> actions(count, 0);
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t s=0; s<steps; ++s)
+            {
+                for (uint32_t i=0; i<count; ++i) scripts[i].Apply(actions[i], s);
+                environment.Step(actions.data(), 1);
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            double ns = std::chrono::duration<double, std::nano>(end - start).count();
+            double stepsPerSecond = steps * count * 1e9 / ns;
+            printf("%-16s%10u%10u%14.0f%10.2f\n", rom.substr(rom.find_last_of('/') + 1).c_str(), count,
+                   environment.Threads(), stepsPerSecond, stepsPerSecond * options.instructionsPerFrame / 1e6);
+            logs += log(stepsPerSecond);
+            ++n;
+        }
+        if (n) printf("\n%-16s%10u%10s%14.0f\n", "geomean", count, "", exp(logs / n));
+        return 0;
+    }
+
+    int benchExpand(uint32_t frames)
+    {
+        std::vector<ExpandKernel> kernels = { ExpandScalar };
+#ifdef CHIP8_EXPAND_X86
+        kernels.push_back(ExpandSSE2);
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) kernels.push_back(ExpandAVX2);
+#endif
+        std::vector<uint32_t> reference(64 * 32), pixels(64 * 32);
+        printf("%-10s%14s%14s\n", "kernel", "ns/frame", "Mpixels/s");
+        for (auto kernel : kernels)
+        {
+            double ns = measureExpand(kernel, frames, pixels.data());
+            if (kernel == ExpandScalar) reference = pixels;
+            printf("%-10s%14.1f%14.1f%s\n", ExpandKernelName(kernel), ns, 2048 * 1000.0 / ns,
+                   pixels == reference ? "" : "  MISMATCH");
+        }
+        printf("selected: %s\n", ExpandKernelName(SelectExpandKernel()));
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "--expand") == 0)
+        return benchExpand((argc > 2) ? strtoul(argv[2], NULL, 0) : 1000000);
+
+    bool verifying = (argc > 1 && strcmp(argv[1], "--verify") == 0);
+    bool snapshots = (argc > 1 && strcmp(argv[1], "--snapshot") == 0);
+    bool rewinding = (argc > 1 && strcmp(argv[1], "--rewind") == 0);
+    uint32_t instances = (argc > 2 && strcmp(argv[1], "--batch") == 0) ? strtoul(argv[2], NULL, 0) : 0;
+    uint32_t environments = (argc > 2 && strcmp(argv[1], "--env") == 0) ? strtoul(argv[2], NULL, 0) : 0;
+    const char *pack = (argc > 2 && strcmp(argv[1], "--load") == 0) ? argv[2] : NULL;
+    int arg = (instances || environments || pack) ? 3 : (verifying || snapshots || rewinding) ? 2 : 1;
+
+    Options options = { 2000000, Scheduler::DEFAULT_INSTRUCTIONS_PER_FRAME, 5, 1, true, QuirkProfile::Legacy, 0 };
+    std::vector<Engine> engines = { Engine::Switch, Engine::Table, Engine::Cached, Engine::Jit };
+    const char *json = NULL;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        if (strcmp(argv[arg], "--engine") == 0)
+        {
+            Engine engine;
+            if (!EngineFromName(argv[arg + 1], engine))
+            {
+                printf("Unknown engine: %s\n", argv[arg + 1]);
+                return 1;
+            }
+            engines = { engine };
+        }
+        else if (strcmp(argv[arg], "--quirks") == 0)
+        {
+            options.autoQuirks = strcmp(argv[arg + 1], "auto") == 0;
+            if (!options.autoQuirks && !QuirkProfileFromName(argv[arg + 1], options.quirks))
+            {
+                printf("Unknown quirk profile: %s\n", argv[arg + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--ipf") == 0) options.instructionsPerFrame = strtoul(argv[arg + 1], NULL, 0);
+        else if (strcmp(argv[arg], "--repeat") == 0) options.repetitions = strtoul(argv[arg + 1], NULL, 0);
+        else if (strcmp(argv[arg], "--warmup") == 0) options.warmup = strtoul(argv[arg + 1], NULL, 0);
+        else if (strcmp(argv[arg], "--json") == 0) json = argv[arg + 1];
+        else if (strcmp(argv[arg], "--threads") == 0) options.threads = strtoul(argv[arg + 1], NULL, 0);
+        else break;
+    }
+
+    const char *dir = (argc > arg) ? argv[arg] : "roms";
+    if (argc > arg + 1) options.cycles = strtoul(argv[arg + 1], NULL, 0);
+    if (options.instructionsPerFrame == 0 || options.repetitions == 0)
+    {
+        printf("Usage: %s [--engine name] [--quirks auto|legacy|vip|schip] [--ipf N] [--repeat N] [--warmup N] [--json file] [ROM dir] [cycles]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> roms = listROMs(dir);
+    if (roms.empty())
+    {
+        printf("No ROMs found in %s\n", dir);
+        return 1;
+    }
+
+    if (snapshots) return benchSnapshot(roms, Engine::CHIP8_DEFAULT_ENGINE);
+    if (rewinding) return benchRewind(roms);
+    if (pack) return benchLoad(roms, pack);
+    if (instances) return benchBatch(roms, instances, options);
+    if (environments) return benchEnvironment(roms, environments, engines.size() == 1 ? engines[0] : Engine::CHIP8_DEFAULT_ENGINE, options);
+
+    if (verifying)
+    {
+        const QuirkProfile profiles[] = { QuirkProfile::Legacy, QuirkProfile::Vip, QuirkProfile::Schip };
+        int failures = 0;
+        for (const auto &rom : roms)
+        {
+            RomImage image(rom.c_str(), Memory<4096>::PROGRAM_SIZE);
+            RomAnalysis analysis(image.Data(), image.Valid() ? image.Size() : 0);
+            for (auto quirks : profiles)
+            {
+                for (auto engine : engines)
+                    if (engine != Engine::Switch) failures += !verify(rom, engine, quirks);
+                for (auto engine : engines)
+                    if (engine == Engine::Cached || engine == Engine::Jit) failures += !verify(rom, engine, quirks, &analysis);
+                failures += !verifyBatch(rom, quirks);
+            }
+            failures += !verifyEnvironment(rom);
+        }
+
+        printf("\n");
+        int modeFailures = verifyModes();
+        printf("%d ROMs checked against the reference: %d failures\n", (int) roms.size(), failures);
+        return (failures || modeFailures) ? 1 : 0;
+    }
+
+    std::vector<Result> results;
+    for (const auto &rom : roms)
+        for (auto engine : engines)
+            results.push_back(benchmark(rom, engine, options));
+
+    printResults(results);
+    printSummary(results, engines);
+
+    if (json && !writeJSON(json, results, options))
+    {
+        printf("Can't write %s\n", json);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include "Chip8Ops.h"
+#include "Analysis.h"
+#include "BlockCache.h"
+
+namespace
+{
+    // Instructions after which the next pc may be outside the block, or that
+    // write into memory (they may overwrite code of the block being executed).
+    // Skips don't end blocks: both ways lead to the next instructions.
+    bool endsBlock(uint8_t op)
+    {
+        switch(op)
+        {
+            case OP_Unknown: case OP_Ret: case OP_Jmp: case OP_Call:
+            case OP_Jumpv0: case OP_Waitkey:
+            case OP_Bcd: case OP_Push:
+                return true;
+        }
+        return false;
+    }
+} // namespace
+
+BlockCache::BlockCache() : handlers(NULL), flushes(0), invalidations(0)
+{
+    memset(index, 0xFF, sizeof(index));
+    blocks.reserve(256);
+    ops.reserve(4096);
+}
+
+void BlockCache::Flush(Memory<4096> &memory)
+{
+    memset(index, 0xFF, sizeof(index));
+    blocks.clear();
+    ops.clear();
+    memory.ClearCodeMap();
+    ++flushes;
+}
+
+void BlockCache::CodeWritten(int address)
+{
+    bool invalidated = false;
+    for (auto &block : blocks)
+    {
+        // The last instruction of a block at 0xFFF wraps to 0x000
+        if (block.valid && ((address - block.start) & 0xFFF) < block.end - block.start)
+        {
+            block.valid = false;
+            index[block.start] = NONE;
+            invalidated = true;
+        }
+    }
+    // Links may lead into the old blocks: they're taken again from scratch
+    if (invalidated)
+    {
+        for (auto &op : ops) op.link = NO_LINK;
+        ++invalidations;
+    }
+}
+
+Block &BlockCache::build(uint16_t pc, Memory<4096> &memory)
+{
+    if (blocks.size() >= MAX_BLOCKS || ops.size() + MAX_BLOCK_LENGTH + 2 > MAX_OPS)
+        Flush(memory);
+
+    Block block;
+    block.start = pc;
+    block.first = ops.size();
+    block.count = 0;
+    block.valid = true;
+    block.idle = false;
+    block.runs = 0;
+    block.native = NULL;
+
+    uint16_t address = pc;
+    while (address < 4096 && block.count < MAX_BLOCK_LENGTH)
+    {
+        MicroOp op;
+        op.opcode = memory.Read(address) << 8 | memory.Read(address + 1);
+        op.ins = DecodeTable()[op.opcode];
+        op.handler = handlers[op.ins.op];
+        op.link = NO_LINK;
+        ops.push_back(op);
+        ++block.count;
+
+        memory.MarkCode(address);
+        memory.MarkCode(address + 1);
+        address += 2;
+
+        if (endsBlock(op.ins.op)) break;
+    }
+
+    // Sentinels ending the block for the threaded runner
+    MicroOp end;
+    memset(&end, 0, sizeof(end));
+    end.ins.op = OP_BlockEnd;
+    end.link = NO_LINK;
+    ops.push_back(end);
+    ops.push_back(end);
+
+    block.end = address;
+    const MicroOp *first = &ops[block.first];
+    block.idle = (block.count == 1 && first[0].ins.op == OP_Jmp && first[0].ins.nnn == pc) ||
+                 (block.count == 3 && first[0].ins.op == OP_Getdelay &&
+                  first[1].ins.op == OP_Jeq && first[1].ins.x == first[0].ins.x && first[1].ins.kk == 0 &&
+                  first[2].ins.op == OP_Jmp && first[2].ins.nnn == pc);
+    index[pc] = blocks.size();
+    blocks.push_back(block);
+    return blocks.back();
+}
+
+bool Chip8::idle(const Block &block, const MicroOp *ops, uint32_t cycles)
+{
+    if (block.count == 1)
+    {
+        CHIP8_STAT(stats.Count(pc, OP_Jmp, cycles));
+        opcode = ops->opcode;
+        return true;
+    }
+
+    // The delay timer only changes between frames: it loops until the end of
+    // this one, or leaves right away
+    if (delay_timer == 0) return false;
+    V[ops->ins.x] = delay_timer;
+#ifdef CHIP8_STATS
+    for (uint32_t i=0; i<3; ++i) stats.Count(pc + 2 * i, ops[i].ins.op, (cycles + 2 - i) / 3);
+#endif
+    opcode = ops[(cycles - 1) % 3].opcode;
+    pc += 2 * (cycles % 3);
+    return true;
+}
+
+// Cached engine: executes predecoded blocks, instructions are only fetched
+// and decoded again when their bytes are overwritten. With GCC/Clang the
+// handlers are threaded with computed gotos: instructions that go on to the
+// next one jump straight to its handler, skips to one of the next two, and
+// jumps, calls and the ends of blocks follow their link to the next block
+// once they've been taken (returns look it up every time).
+template <class Q>
+void Chip8::runBlocks(uint32_t cycles)
+{
+    if (cycles == 0) return;
+
+    const MicroOp *pool;
+    const MicroOp *op;
+    uint32_t from = NO_LINK;
+    uint16_t at;
+
+#if defined(__GNUC__)
+#define CHIP8_OP_LABEL(name) &&op_##name,
+    static const void *labels[OP_COUNT + 1] = { CHIP8_OPS(CHIP8_OP_LABEL) &&block_end };
+#undef CHIP8_OP_LABEL
+#endif
+
+enter:
+    {
+        // pc runs past 0xFFE after the last instruction of memory
+        pc &= 0xFFF;
+        const Block &block = cache.Link(from, pc, memory);
+        pool = cache.Pool();
+        op = pool + block.first;
+
+        // Nothing can change in an idle loop: burn the remaining cycles at once
+        if (block.idle && idle(block, op, cycles)) return;
+    }
+
+#if defined(__GNUC__)
+#define CHIP8_DISPATCH() goto *labels[op->ins.op]
+
+#define CHIP8_FOLLOW()                                          \
+    if (op->link != NO_LINK)                                    \
+    {                                                           \
+        op = pool + op->link;                                   \
+        CHIP8_DISPATCH();                                       \
+    }                                                           \
+    from = op - pool;                                           \
+    goto enter
+
+#define CHIP8_OP_BODY(name)                                     \
+    op_##name:                                                  \
+        CHIP8_STAT(stats.Count(pc, OP_##name));                 \
+        at = pc;                                                \
+        Dispatch::name<Q>(*this, op->ins);                      \
+        if (--cycles == 0) goto done;                           \
+        if (MovesOn(OP_##name)) ++op;                           \
+        else if (Skips(OP_##name)) op += (pc - at) >> 1;        \
+        else if (OP_##name == OP_Jmp || OP_##name == OP_Call)   \
+        {                                                       \
+            CHIP8_FOLLOW();                                     \
+        }                                                       \
+        else                                                    \
+        {                                                       \
+            from = NO_LINK;                                     \
+            goto enter;                                         \
+        }                                                       \
+        CHIP8_DISPATCH();
+
+    CHIP8_DISPATCH();
+    CHIP8_OPS(CHIP8_OP_BODY)
+
+block_end:
+    CHIP8_FOLLOW();
+
+#undef CHIP8_OP_BODY
+#undef CHIP8_FOLLOW
+#undef CHIP8_DISPATCH
+#else
+    for (;;)
+    {
+        if (op->ins.op == OP_BlockEnd) goto enter;
+        CHIP8_STAT(stats.Count(pc, op->ins.op));
+        at = pc;
+        op->handler(*this, op->ins);
+        if (--cycles == 0) break;
+        if (MovesOn(op->ins.op)) ++op;
+        else if (Skips(op->ins.op)) op += (pc - at) >> 1;
+        else goto enter;
+    }
+#endif
+done:
+    opcode = op->opcode;
+}
+
+// Blocks of the cache end at memory writes and every MAX_BLOCK_LENGTH
+// instructions, so a basic block of the analysis may take several
+void Chip8::Prebuild(const RomAnalysis &analysis)
+{
+    if (!UsesBlocks()) return;
+    if (engine == Engine::Jit && !jit) jit.reset(new Jit(*this));
+
+    for (const auto &found : analysis.Blocks())
+    {
+        for (uint32_t address = found.start; address < found.end; )
+        {
+            Block &block = cache.Lookup(address, memory);
+            if (engine == Engine::Jit && jit->Available() && !block.native && !block.idle)
+            {
+                block.native = reinterpret_cast<void *>(jit->Compile(block, cache.Ops(block)));
+                // Code buffer full: the rest is compiled when it runs
+                if (!block.native) return;
+            }
+            address = block.end;
+        }
+    }
+}
+
+#define CHIP8_INSTANTIATE(name) template void Chip8::runBlocks<name##Quirks>(uint32_t cycles);
+CHIP8_QUIRK_PROFILES(CHIP8_INSTANTIATE)
+#undef CHIP8_INSTANTIATE
@@ -0,0 +1,119 @@
+#ifndef _BLOCK_CACHE_H_
+#define _BLOCK_CACHE_H_
+
+#include <cstdint>
+#include <vector>
+#include "Dispatch.h"
+#include "Memory.h"
+
+// Predecoded instruction, ready to be executed
+struct MicroOp
+{
+    Dispatch::Handler handler;
+    Instruction ins;
+    uint16_t opcode;
+    // Micro-op the runner goes on with after a jump, a call or the end of
+    // the block (index in the pool, NO_LINK until it's first taken)
+    uint16_t link;
+};
+
+const uint16_t NO_LINK = 0xFFFF;
+
+// Op of the two micro-ops following the last instruction of every block,
+// reached by going on from it or by skipping it
+const uint8_t OP_BlockEnd = OP_COUNT;
+
+// Instructions that always go on with the next one (pc + 2)
+constexpr bool MovesOn(uint8_t op)
+{
+    return op != OP_Unknown && op != OP_Ret && op != OP_Jmp && op != OP_Call &&
+           op != OP_Jeq && op != OP_Jneq && op != OP_Jeqr && op != OP_Jneqr &&
+           op != OP_Jumpv0 && op != OP_Jkey && op != OP_Jnkey && op != OP_Waitkey;
+}
+
+// Instructions that go on with the next one or the one after it
+constexpr bool Skips(uint8_t op)
+{
+    return op == OP_Jeq || op == OP_Jneq || op == OP_Jeqr || op == OP_Jneqr ||
+           op == OP_Jkey || op == OP_Jnkey;
+}
+
+// Run of instructions starting at a jump/call target (or any other address the
+// program counter lands on). It ends with the first instruction that can leave
+// it or write into memory: skips stay inside, both ways lead to one of its ops.
+struct Block
+{
+    uint16_t start;
+    uint16_t end;   // first address after the block
+    uint32_t first; // index of the first micro-op in the pool
+    uint16_t count;
+    bool valid;
+    // Loop that can't leave before the timers tick: a single jump to itself
+    // (the usual way of halting a program) or a delay timer wait (FX07, 3X00
+    // and a jump back to the FX07)
+    bool idle;
+    // times the JIT engine interpreted it, then its native code
+    uint16_t runs;
+    void *native;
+};
+
+class BlockCache : public CodeWatcher
+{
+public:
+    BlockCache();
+    ~BlockCache() = default;
+    BlockCache (const BlockCache &) = delete;
+    BlockCache & operator=(const BlockCache &) = delete;
+
+    // Returns the block starting at pc (wrapped to memory), decoding it when
+    // it isn't cached yet
+    Block &Lookup(uint16_t pc, Memory<4096> &memory)
+    {
+        pc &= 0xFFF;
+        uint16_t idx = index[pc];
+        if (idx != NONE) return blocks[idx];
+        return build(pc, memory);
+    }
+
+    // Lookup, also linking the micro-op from (index in the pool, NO_LINK for
+    // none) to the block so it's followed without looking it up next time
+    Block &Link(uint32_t from, uint16_t pc, Memory<4096> &memory)
+    {
+        uint32_t before = flushes;
+        Block &block = Lookup(pc, memory);
+        if (from != NO_LINK && flushes == before && !block.idle) ops[from].link = block.first;
+        return block;
+    }
+
+    const MicroOp *Ops(const Block &block) const { return &ops[block.first]; }
+    // Pool of the micro-ops of all blocks, moves when a block is built
+    const MicroOp *Pool() const { return ops.data(); }
+
+    void Flush(Memory<4096> &memory);
+    // Handler table new blocks are built with (see Dispatch::Handlers)
+    void SetHandlers(const Dispatch::Handler *table) { handlers = table; }
+
+    void CodeWritten(int address) override;
+    // Times blocks were dropped because their code was overwritten
+    uint32_t Invalidations() const { return invalidations; }
+
+private:
+    Block &build(uint16_t pc, Memory<4096> &memory);
+
+private:
+    static const uint16_t NONE = 0xFFFF;
+    static const uint16_t MAX_BLOCK_LENGTH = 64;
+    static const uint32_t MAX_BLOCKS = 4096;
+    static const uint32_t MAX_OPS = 32768;
+
+    // block index by start address
+    uint16_t index[4096];
+    std::vector<Block> blocks;
+    std::vector<MicroOp> ops;
+    const Dispatch::Handler *handlers;
+    // Links into the pool are stale after a flush
+    uint32_t flushes;
+    uint32_t invalidations;
+};
+
+#endif // _BLOCK_CACHE_H_
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <cctype>
+#include <cstring>
+
+#include "Catalog.h"
+
+const char DEFAULT_KEYMAP[] = "x123qweasdzc4rfv";
+
+namespace
+{
+    // 16 distinct keys the SDL frontend can map: digits and lowercase letters
+    bool validKeymap(const char *keymap)
+    {
+        if (strlen(keymap) != 16) return false;
+        for (auto i=0; i<16; ++i)
+        {
+            char key = keymap[i];
+            if (!isdigit(key) && !islower(key)) return false;
+            if (strchr(keymap + i + 1, key)) return false;
+        }
+        return true;
+    }
+
+    bool parseLine(const char *line, uint64_t &hash, RomProfile &profile)
+    {
+        unsigned long long value;
+        char quirks[16];
+        char keymap[32];
+        unsigned ipf;
+        int end = 0;
+        if (sscanf(line, "%llx %15s %u %31s %n", &value, quirks, &ipf, keymap, &end) != 4) return false;
+        if (!QuirkProfileFromName(quirks, profile.quirks) || ipf == 0) return false;
+        if (strcmp(keymap, "-") == 0) strcpy(keymap, DEFAULT_KEYMAP);
+        if (!validKeymap(keymap)) return false;
+
+        hash = value;
+        profile.instructionsPerFrame = ipf;
+        strcpy(profile.keymap, keymap);
+        profile.name.assign(line + end);
+        while (!profile.name.empty() && isspace(static_cast<unsigned char>(profile.name.back()))) profile.name.pop_back();
+        return true;
+    }
+}
+
+bool RomCatalog::Load(const char *filename)
+{
+    path = filename;
+    badLine = 0;
+    FILE *file = fopen(filename, "r");
+    if (!file) return false;
+
+    char line[512];
+    for (uint32_t number=1; fgets(line, sizeof(line), file); ++number)
+    {
+        const char *start = line + strspn(line, " \t\r\n");
+        if (*start == '\0' || *start == '#') continue;
+
+        uint64_t hash;
+        RomProfile profile;
+        if (parseLine(start, hash, profile)) profiles[hash] = profile;
+        else if (!badLine) badLine = number;
+    }
+    fclose(file);
+    return badLine == 0;
+}
+
+bool RomCatalog::LoadFor(const char *rom, const char *filename)
+{
+    if (Load(filename ? filename : DefaultCatalogPath(rom).c_str())) return true;
+    return !filename || badLine;
+}
+
+const RomProfile *RomCatalog::Find(uint64_t hash) const
+{
+    auto found = profiles.find(hash);
+    return found != profiles.end() ? &found->second : NULL;
+}
+
+std::string RomCatalog::Format(uint64_t hash, const RomProfile &profile)
+{
+    char line[128];
+    snprintf(line, sizeof(line), "%016llx %-7s %4u  %s", (unsigned long long) hash, QuirkProfileName(profile.quirks),
+             profile.instructionsPerFrame, profile.keymap);
+    return profile.name.empty() ? std::string(line) : line + ("  " + profile.name);
+}
+
+std::string DefaultCatalogPath(const char *rom)
+{
+    const char *slash = strrchr(rom, '/');
+    return slash ? std::string(rom, slash + 1) + "catalog.txt" : std::string("catalog.txt");
+}
@@ -0,0 +1,65 @@
+#ifndef _CATALOG_H_
+#define _CATALOG_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "Quirks.h"
+
+// Host keys of the Chip8 keys 0 to F, the 4x4 block from 1 to V of a QWERTY
+// keyboard
+extern const char DEFAULT_KEYMAP[];
+
+// Settings a ROM was tuned for
+struct RomProfile
+{
+    QuirkProfile quirks;
+    uint32_t instructionsPerFrame;
+    // keymap[N] is the host key of Chip8 key N: a digit or a lowercase letter
+    char keymap[17];
+    std::string name;
+};
+
+// ROM settings indexed by the content hash of the program (RomHash), so a
+// ROM is recognized whatever its file is called. Text file, one ROM per line:
+//
+//   # hash           quirks   ipf  keymap            name
+//   624b3eed64313f42 legacy    10  x123qweasdzc4rfv  Pong
+//
+// A keymap of "-" keeps the default layout, the name is free text. Blank
+// lines and lines starting with # are ignored.
+class RomCatalog
+{
+public:
+    RomCatalog() : badLine(0) {}
+
+    // False when the file can't be read or has lines that don't parse: these
+    // are skipped, the first one is BadLine(). Entries add to the ones
+    // already loaded.
+    bool Load(const char *filename);
+    // Catalog of the ROM file rom: filename when given, it has to be there,
+    // else the optional catalog.txt next to the ROM. False only when the
+    // catalog can't be used, entries that don't parse are in BadLine() of Path().
+    bool LoadFor(const char *rom, const char *filename);
+    uint32_t BadLine() const { return badLine; }
+    // Last file loaded
+    const std::string &Path() const { return path; }
+
+    // NULL when the ROM isn't in the catalog
+    const RomProfile *Find(uint64_t hash) const;
+    size_t Size() const { return profiles.size(); }
+
+    // Line of the file describing a ROM, without the end of line
+    static std::string Format(uint64_t hash, const RomProfile &profile);
+
+private:
+    std::unordered_map<uint64_t, RomProfile> profiles;
+    std::string path;
+    uint32_t badLine;
+};
+
+// Catalog looked up when none is given: catalog.txt next to the ROM
+std::string DefaultCatalogPath(const char *rom);
+
+#endif // _CATALOG_H_
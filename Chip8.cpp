@@ -1,5 +1,29 @@
-#include <cstdlib>
-#include "Chip8.h"
+#include <strings.h>
+#include "Chip8Ops.h"
+#include "Profiler.h"
+
+namespace
+{
+    const char *engine_names[] = { "switch", "table", "cached", "jit" };
+}
+
+const char *EngineName(Engine engine)
+{
+    return engine_names[static_cast<int>(engine)];
+}
+
+bool EngineFromName(const char *name, Engine &engine)
+{
+    for (auto i=0u; i<sizeof(engine_names) / sizeof(engine_names[0]); ++i)
+    {
+        if (strcasecmp(name, engine_names[i]) == 0)
+        {
+            engine = static_cast<Engine>(i);
+            return true;
+        }
+    }
+    return false;
+}
 
 void Chip8::DumpStatus()
 {
@@ -9,6 +33,102 @@ void Chip8::DumpStatus()
     DumpDisplay();
 }
 
+void Chip8::UpdateTimers()
+{
+    if(delay_timer > 0) --delay_timer;
+    if(sound_timer > 0) --sound_timer;
+    updateBeep();
+}
+
+void Chip8::updateBeep()
+{
+    bool on = sound_timer > 0;
+    if (!audio || on == beeping) return;
+    beeping = on;
+    if (on) audio->StartBeep();
+    else audio->StopBeep();
+}
+
+void Chip8::RunFrame(uint32_t instructions)
+{
+    if (profiler) profiler->Run(*this, instructions);
+    else Run(instructions);
+    UpdateTimers();
+}
+
+bool Chip8::TakeScreen(Screen &screen)
+{
+    if (!drawF) return false;
+    screen.Capture(&display, 1);
+    drawF = false;
+    return true;
+}
+
+bool Chip8::SameState(const Chip8 &other) const
+{
+    return memcmp(V, other.V, sizeof(V)) == 0 &&
+           I == other.I && pc == other.pc && sp == other.sp &&
+           memcmp(stack, other.stack, sizeof(stack)) == 0 &&
+           delay_timer == other.delay_timer && sound_timer == other.sound_timer &&
+           cycle == other.cycle && random.State() == other.random.State() &&
+           display == other.display &&
+           memcmp(memory.Data(), other.memory.Data(), 4096) == 0;
+}
+
+bool Chip8::Save(Snapshot &snapshot) const
+{
+    snapshot.magic = Snapshot::MAGIC;
+    snapshot.version = Snapshot::VERSION;
+    snapshot.size = sizeof(Snapshot);
+    snapshot.reserved = 0;
+
+    memcpy(snapshot.display, display.Rows(), sizeof(snapshot.display));
+    memcpy(snapshot.memory, memory.Data(), sizeof(snapshot.memory));
+    memcpy(snapshot.stack, stack, sizeof(stack));
+    snapshot.pc = pc;
+    snapshot.opcode = opcode;
+    snapshot.I = I;
+    snapshot.sp = sp;
+    memcpy(snapshot.V, V, sizeof(V));
+    memcpy(snapshot.keyboard, keyboard, sizeof(keyboard));
+    snapshot.delay_timer = delay_timer;
+    snapshot.sound_timer = sound_timer;
+    snapshot.drawF = drawF;
+    memset(snapshot.padding, 0, sizeof(snapshot.padding));
+    snapshot.cycle = cycle;
+    snapshot.random = random.State();
+    return true;
+}
+
+bool Chip8::Restore(const Snapshot &snapshot)
+{
+    if (!snapshot.Valid()) return false;
+
+    // Blocks and native code were built from the old memory contents
+    cache.Flush(memory);
+    if (jit) jit->Reset();
+
+    display.Restore(snapshot.display);
+    memory.Restore(snapshot.memory);
+    // Compiled blocks stay, for as long as memory holds their code
+    if (aot) aot->Validate(memory.Data());
+    memcpy(stack, snapshot.stack, sizeof(stack));
+    pc = snapshot.pc;
+    opcode = snapshot.opcode;
+    I = snapshot.I;
+    sp = snapshot.sp;
+    memcpy(V, snapshot.V, sizeof(V));
+    memcpy(keyboard, snapshot.keyboard, sizeof(keyboard));
+    delay_timer = snapshot.delay_timer;
+    sound_timer = snapshot.sound_timer;
+    cycle = snapshot.cycle;
+    random.SetState(snapshot.random);
+    updateBeep();
+    // the whole screen has to be presented again
+    drawF = true;
+    return true;
+}
+
 void Chip8::DumpMemory() 
 { 
     printf("\nMEMORY STATUS: \n");
@@ -42,256 +162,35 @@ void Chip8::DumpStack()
 void Chip8::DumpDisplay()
 {
     printf("\nDISPLAY STATUS: \n");
-    for(auto i=0;i<2048;++i)
+    unsigned char row[64];
+    for(auto y=0;y<32;++y)
     {
-        printf("%X ", display[i]);
-        if ((i + 1) % 64 == 0) { printf("\n"); }
+        display.UnpackRow(y, row);
+        for(auto x=0;x<64;++x) printf("%X ", row[x]);
+        printf("\n");
     }
 }
 
-void Chip8::UpdateTimers()
-{
-    if(delay_timer > 0) --delay_timer;
-
-    if(sound_timer > 0)
-    {
-        if (--sound_timer == 0) beeper.StopBeep();
-        else beeper.StartBeep();
-    }
-}
-
-void Chip8::clear()
-{
-    memset(display, 0, 2048);
-    drawF = true;
-}
-
-void Chip8::ret()
-{
-    //We have to restore stuff from stack
-    //so we put into program counter stored return address
-    --sp;
-    pc = stack[sp];
-}
-
-void Chip8::jmp(uint16_t address)
-{
-    pc = address;
-}
-
-void Chip8::call(uint16_t address)
-{
-    // save return address(pc) into the stack
-    stack[sp] = pc;
-    ++sp;
-    pc = address;
-}
-
-void Chip8::jeq(uint8_t reg, uint8_t value)
-{
-    V[reg] == value ? pc += 4 : pc += 2;
-}
-
-void Chip8::jneq(uint8_t reg, uint8_t value)
-{
-    V[reg] != value ? pc += 4 : pc += 2;
-}
-
-void Chip8::jeqr(uint8_t reg1, uint8_t reg2)
-{
-    V[reg1] == V[reg2] ? pc += 4 : pc += 2;
-}
-
-void Chip8::set(uint8_t reg, uint8_t value)
-{
-    V[reg] = value;
-}
-
-void Chip8::add(uint8_t reg, uint8_t value)
-{
-    V[reg] += value;
-}
-
-void Chip8::setr(uint8_t reg1, uint8_t reg2)
-{
-    V[reg1] = V[reg2];
-}
-
-void Chip8::Or(uint8_t reg1, uint8_t reg2)
-{
-    V[reg1] |= V[reg2];
-}
-
-void Chip8::And(uint8_t reg1, uint8_t reg2)
-{
-    V[reg1] &= V[reg2];
-}
-
-void Chip8::Xor(uint8_t reg1, uint8_t reg2)
-{
-    V[reg1] ^= V[reg2];
-}
-
-void Chip8::addr(uint8_t reg1, uint8_t reg2)
-{
-    V[0xF] = (0xFF - V[reg1]) < V[reg2];
-    V[reg1] += V[reg2];
-}
-
-void Chip8::sub(uint8_t reg1, uint8_t reg2)
-{
-    V[0xF] = V[reg1] < V[reg2]; 
-    V[reg1] -= V[reg2];
-}
-
-void Chip8::shr(uint8_t reg)
-{
-    V[0xF] = V[reg] & 0x1;
-    V[reg] >>= 1;
-}
-
-void Chip8::subb(uint8_t reg1, uint8_t reg2)
-{
-    V[0xF] = V[reg1] > V[reg2];
-    V[reg1] = V[reg2] - V[reg1];
-}
-
-void Chip8::shl(uint8_t reg)
-{
-    V[0xF] = V[reg] >> 7;
-    V[reg] <<= 1;
-}
-
-void Chip8::jneqr(uint8_t reg1, uint8_t reg2)
-{
-    V[reg1] != V[reg2] ? pc += 4 : pc += 2;
-}
-
-void Chip8::seti(uint16_t value)
-{
-    I = value;
-}
-
-void Chip8::jumpv0(uint16_t address)
-{
-    pc = address + V[0];
-}
-
-void Chip8::Rand(uint8_t reg,uint8_t value)
-{
-    V[reg] = value & (rand() % 0xFF); 
-}
-
-void Chip8::draw(uint8_t reg1, uint8_t reg2, uint8_t value)
-{
-    uint8_t x = V[reg1];
-    uint8_t y = V[reg2];
-    uint8_t rows = value;
-    V[0xF] = 0;
-    for (auto j=0; j<rows; j++)
-    {
-        uint8_t sprite = memory.Read(I + j);
-        for (auto i=0; i<8; i++)
-        {
-            int px = (x + i) & 63;
-            int py = (y + j) & 31;
-            int pos = 64 * py + px;
-            int pixel = (sprite & (1 << (7-i))) != 0;
-            V[0xF] |= (display[pos] & pixel);
-            display[pos] ^= pixel;
-        }
-    }
-    drawF = true;
-}
-
-void Chip8::jkey(uint8_t reg)
-{
-    keyboard[V[reg]] != 0 ? pc += 4 : pc += 2;
-}
-
-void Chip8::jnkey(uint8_t reg)
-{
-    keyboard[V[reg]] == 0 ? pc += 4 : pc += 2;
-}
-
-void Chip8::getdelay(uint8_t reg)
-{
-    V[reg] = delay_timer;
-}
-
-void Chip8::waitkey(uint8_t reg)
-{
-    bool pressed = false;
-    for (auto i=0; i<16; ++i)
-    {
-        if (keyboard[i] != 0)
-        {
-            V[reg] = i;
-            pressed = true;
-        }
-    }
-    if (!pressed) return;
-    pc += 2;
-}
-
-void Chip8::setdelay(uint8_t reg)
-{
-    delay_timer = V[reg];
-}
-
-void Chip8::setsound(uint8_t reg)
-{
-    sound_timer = V[reg];
-}
-
-void Chip8::addi(uint8_t reg)
-{
-    V[0xF] = (I + V[reg]) > 0xFFF;
-    I += V[reg];
-}
-
-void Chip8::spritei(uint8_t reg)
-{
-    I = V[reg] * 0x5;
-}
-
-void Chip8::bcd(uint8_t reg)
-{
-    memory.Write(I, V[reg] / 100);
-    memory.Write(I + 1, (V[reg] / 10) % 10);
-    memory.Write(I + 2, V[reg] % 10);
-}
-
-void Chip8::push(uint8_t reg)
-{
-    for (auto i=0; i<= reg; ++i) memory.Write(I+i, V[i]);
-    I += reg + 1;
-}
-
-void Chip8::pop(uint8_t reg)
-{
-    for (auto i=0; i<= reg; ++i) V[i] = memory.Read(I+i);
-    I += reg + 1;
-}
-
-void Chip8::unknown(uint16_t opcode)
+// https://en.wikipedia.org/wiki/CHIP-8#Opcode_table
+// http://devernay.free.fr/hacks/chip8/C8TECH10.HTM#2.5 -> Standard chip8 instructions
+void Chip8::RunCicle()
 {
-    printf ("Unknown opcode: 0x%X\n", opcode);
+    ++cycle;
+    (this->*runSwitchLoop)(1);
 }
 
-void Chip8::decodeOpcode()
+// Switch engine: decodes every opcode again with the nested switch
+template <class Q>
+void Chip8::runSwitch(uint32_t cycles)
 {
-    // fetch opcode: Opcode is 2bytes long -> we have to fetch two bytes
-    // Ej: 0xA2       0xA2 << 8 = 0xA200 
-    // Use or bitwase two join it: 0xA200 | 0xF0 = 0xA2F0
-    opcode = memory[pc] << 8 | memory[pc + 1];
+    while (cycles--) step<Q>();
 }
 
-// https://en.wikipedia.org/wiki/CHIP-8#Opcode_table
-// http://devernay.free.fr/hacks/chip8/C8TECH10.HTM#2.5 -> Standard chip8 instructions
-void Chip8::RunCicle()
+template <class Q>
+void Chip8::step()
 {
     decodeOpcode();
+    CHIP8_STAT(stats.Count(pc, DecodeTable()[opcode].op));
 
     // process opcode
     // Check MSB of first byte 
@@ -310,7 +209,7 @@ void Chip8::RunCicle()
                     pc += 2; 
                     break;
                 default:
-                    unknown(opcode);
+                    unknown();
             }
             break;
         case 0x1000: //  0x1NNN: Jumps to address NNN.
@@ -364,7 +263,7 @@ void Chip8::RunCicle()
                     pc += 2;
                     break;
                 case 0x0006: // 0x8XY6: Shifts VX right by one. VF is set to the value of the least significant bit of VX before the shift.
-                    shr((opcode & 0x0F00) >> 8);
+                    shr<Q>((opcode & 0x0F00) >> 8, (opcode & 0x00F0) >> 4);
                     pc += 2;
                     break;
                 case 0x0007: // 0x8XY7: Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
@@ -372,11 +271,11 @@ void Chip8::RunCicle()
                     pc += 2;
                     break;
                 case 0x000E: // 0x8XYE: Shifts VX left by one. VF is set to the value of the most significant bit of VX before the shift.[2]
-                    shl((opcode & 0x0F00) >> 8);
+                    shl<Q>((opcode & 0x0F00) >> 8, (opcode & 0x00F0) >> 4);
                     pc += 2;
                     break;
                 default:
-                    unknown(opcode);
+                    unknown();
             }
             break;
         case 0x9000: // 9XY0: Skips the next instruction if VX doesn't equal VY.
@@ -387,7 +286,7 @@ void Chip8::RunCicle()
             pc += 2;
             break;
         case 0xB000: // 0xBNNN: Jumps to the address NNN plus V0.
-            jumpv0(opcode & 0x0FFF);
+            jumpv0<Q>(opcode & 0x0FFF);
             break;
         case 0xC000: // 0xCXNN: Sets VX to the result of a bitwise and operation on a random number and NN.
             Rand((opcode & 0x0F00) >> 8, opcode & 0x00FF);
@@ -413,7 +312,7 @@ void Chip8::RunCicle()
                     jnkey((opcode & 0x0F00) >> 8);
                     break;
                 default:
-                    unknown(opcode);
+                    unknown();
                     
             }
             break;
@@ -438,7 +337,7 @@ void Chip8::RunCicle()
                 case 0x001E: // 0xFX1E: Adds VX to I.
                     // VF is set to 1 when range overflow (I+VX>0xFFF), and 0 when there isn't. 
                     // This is undocumented feature of the CHIP-8 and used by Spacefight 2091! game.
-                    addi((opcode & 0x0F00) >> 8);
+                    addi<Q>((opcode & 0x0F00) >> 8);
                     pc += 2;
                     break;
                 case 0x0029: // 0xFX29: Sets I to the location of the sprite for the character in VX. 
@@ -457,21 +356,89 @@ void Chip8::RunCicle()
                     break;
                 case 0x0055: // 0xFX55: Stores V0 to VX (including VX) in memory starting at address I.
                              // On the original interpreter, when the operation is done, I=I+X+1. On current implementations, I is left unchanged.
-                    push((opcode & 0x0F00) >> 8);
+                    push<Q>((opcode & 0x0F00) >> 8);
                     pc += 2;
                     break;
                 case 0x0065: // 0xFX65: Fills V0 to VX (including VX) with values from memory starting at address I.
                              // On the original interpreter, when the operation is done, I=I+X+1. On current implementations, I is left unchanged.
-                    pop((opcode & 0x0F00) >> 8);
+                    pop<Q>((opcode & 0x0F00) >> 8);
                     pc += 2;
                     break;
                 default:
-                    unknown(opcode);
+                    unknown();
             }
             break;
         default:
-            unknown(opcode);
+            unknown();
     }
+}
 
-    UpdateTimers();
+template <class Q>
+void Chip8::bindQuirks()
+{
+    runSwitchLoop = &Chip8::runSwitch<Q>;
+    runTableLoop = &Chip8::runTable<Q>;
+    runBlocksLoop = &Chip8::runBlocks<Q>;
+    runTracedLoop = &Chip8::runTraced<Q>;
+    quirkFlags = QuirkFlags::Of<Q>();
+    cache.SetHandlers(Dispatch::Handlers<Q>());
+}
+
+void Chip8::SetQuirks(QuirkProfile profile)
+{
+    quirks = profile;
+    switch (profile)
+    {
+#define CHIP8_BIND_QUIRKS(name) case QuirkProfile::name: bindQuirks<name##Quirks>(); break;
+        CHIP8_QUIRK_PROFILES(CHIP8_BIND_QUIRKS)
+#undef CHIP8_BIND_QUIRKS
+    }
+
+    // Blocks hold handlers of the previous profile, native code its semantics
+    cache.Flush(memory);
+    if (jit) jit->Reset();
+    // Code compiled ahead of time didn't see the stores made under another profile
+    if (aot) aot->Validate(memory.Data());
+}
+
+void Chip8::SetTracer(Tracer *t)
+{
+    tracer = t;
+    // nor the ones made while tracing
+    if (aot) aot->Validate(memory.Data());
+}
+
+void Chip8::Run(uint32_t cycles)
+{
+    if (tracer)
+    {
+        (this->*runTracedLoop)(cycles);
+        cycle += cycles;
+        return;
+    }
+
+    // Compiled ahead of time for the profile in use
+    if (aot && aot->Program().quirks == quirks)
+    {
+        runAot(cycles);
+        cycle += cycles;
+        return;
+    }
+
+    switch(engine)
+    {
+        case Engine::Switch:
+            (this->*runSwitchLoop)(cycles);
+            break;
+        case Engine::Table:
+            (this->*runTableLoop)(cycles);
+            break;
+        case Engine::Cached:
+            (this->*runBlocksLoop)(cycles);
+            break;
+        case Engine::Jit:
+            runJit(cycles);
+            break;
+    }
+    cycle += cycles;
 }
@@ -2,23 +2,67 @@
 #define _CHIP8_H_
 
 #include <stdio.h>
+#include <chrono>
 #include <cstdint>
+#include <cstdlib>
 #include <time.h>
-#include "Beep.h"
+#include <memory>
+#include "Aot.h"
+#include "BlockCache.h"
+#include "Display.h"
+#include "Jit.h"
+#include "Machine.h"
 #include "Memory.h"
+#include "Quirks.h"
+#include "Random.h"
+#include "Sink.h"
+#include "Snapshot.h"
+#include "Stats.h"
 
-class Chip8
+class RomAnalysis;
+
+// Execution engines. All of them give the same results, they only differ in speed.
+enum class Engine
+{
+    Switch, // reference interpreter, nested switch decoding every cycle
+    Table,  // precomputed 64K decode table with threaded dispatch
+    Cached, // predecoded basic blocks, invalidated on self-modifying code
+    Jit     // x86-64 recompiled blocks (Cached on other hosts)
+};
+
+#ifndef CHIP8_DEFAULT_ENGINE
+#define CHIP8_DEFAULT_ENGINE Switch
+#endif
+
+const char *EngineName(Engine engine);
+bool EngineFromName(const char *name, Engine &engine);
+
+class GuestProfiler;
+class Tracer;
+
+// The original machine: 4 KB of memory and a 64x32 monochrome screen.
+// Final, so calls on a Chip8 never go through the Machine vtable.
+class Chip8 final : public Machine
 {
 public:
-    Chip8(): stack{0}, V{0}, 
-             keyboard{0}, display{0}, 
-             drawF(true),
+    Chip8(): drawF(true),
+             keyboard{0},
              pc(0x200), opcode(0),
              I(0), sp(0),
-             delay_timer(0), sound_timer(0) 
+             V{0}, stack{0},
+             delay_timer(0), sound_timer(0),
+             audio(NULL),
+             beeping(false),
+             cycle(0),
+             drawTime(NULL),
+             profiler(NULL),
+             tracer(NULL),
+             unknownOpcodes(0),
+             random(time(NULL)),
+             engine(Engine::CHIP8_DEFAULT_ENGINE)
              {
-                 // init seed for rand()
-                 srand(time(NULL));
+                 memory.SetCodeWatcher(&cache);
+                 SetQuirks(QuirkProfile::Legacy);
              } 
     
     ~Chip8() = default;
@@ -26,18 +70,99 @@ public:
     Chip8 (Chip8 &&) = delete;
     Chip8 & operator=(const Chip8 &) = delete;
 
-    bool LoadROM(const char *filename) { return (memory.loadAppInMemory(filename)); }
+    using Machine::LoadROM;
+    bool LoadROM(const uint8_t *program, size_t size) override
+    { 
+        cache.Flush(memory);
+        bool loaded = memory.LoadProgram(program, size);
+        if (aot) aot->Validate(memory.Data());
+        return loaded;
+    }
+    size_t MaxROMSize() const override { return Memory<4096>::PROGRAM_SIZE; }
+    // Audio output is optional: without a sink the sound timer runs silently
+    void SetAudioSink(AudioSink *sink) override { audio = sink; beeping = false; }
     void DumpStatus();
+    // Compares the whole machine state, used to check engines against each other
+    bool SameState(const Chip8 &other) const;
+    // Full machine state, in the snapshot file format
+    bool Save(Snapshot &snapshot) const override;
+    // Fails on snapshots of another format version. Predecoded and compiled code is discarded.
+    bool Restore(const Snapshot &snapshot) override;
     void RunCicle();
+    // Runs cycles instructions with the selected engine
+    void Run(uint32_t cycles);
+    // Delay and sound timers count down at 60 Hz: call it once per frame
+    void UpdateTimers();
+    // Run and UpdateTimers, through the profiler when one is attached
+    void RunFrame(uint32_t instructions) override;
+    // Frames run through profiler while set (NULL stops profiling)
+    void SetProfiler(GuestProfiler *p) { profiler = p; }
+    // Every instruction is recorded in the trace while set (NULL stops
+    // tracing). Traced instructions are interpreted, whatever the engine.
+    void SetTracer(Tracer *t);
+    void SetKeys(uint16_t pressed) override { for (auto i=0; i<16; ++i) keyboard[i] = (pressed >> i) & 1; }
+    bool TakeScreen(Screen &screen) override;
+    uint32_t ScreenWidth() const override { return display.WIDTH; }
+    uint32_t ScreenHeight() const override { return display.HEIGHT; }
+    void SetEngine(Engine e) { engine = e; }
+    Engine GetEngine() const { return engine; }
+    // Whether the engine runs predecoded blocks, which Prebuild can build
+    bool UsesBlocks() const { return engine == Engine::Cached || engine == Engine::Jit; }
+    // Selects the run loops and handlers instantiated for profile.
+    // Predecoded and compiled code is discarded.
+    void SetQuirks(QuirkProfile profile);
+    QuirkProfile GetQuirks() const { return quirks; }
+    // Profile the loaded program most likely expects
+    QuirkProfile DetectQuirks() const { return QuirkProfileForROM(memory.Data() + 0x200, 4096 - 0x200); }
+    // Random numbers (CXKK) come from a per instance generator, seeded from the
+    // clock. The same seed and input give the same run.
+    void Seed(uint64_t seed) override { random.Seed(seed); }
+    // Instructions executed since power on
+    uint64_t Cycle() const override { return cycle; }
+    // Adds the time spent drawing sprites to *ns, for profiling (NULL stops it)
+    void TimeDraws(uint64_t *ns) { drawTime = ns; }
+    // Predecodes the blocks a static analysis of the loaded program found, and
+    // compiles them with the JIT engine, instead of discovering them while
+    // running. Call it after LoadROM and SetQuirks, both discard them.
+    void Prebuild(const RomAnalysis &analysis);
+    // Runs the blocks chip8-aot compiled from program instead of the
+    // selected engine, while the quirk profile is the one they were compiled
+    // for (NULL goes back to the engine). Code they don't cover is interpreted.
+    void SetAotProgram(const AotProgram *program);
+    // Attached compiled program, NULL when none
+    const AotCode *GetAotCode() const { return aot.get(); }
+    // The 4 KB of memory, read only: scores and lives of a game, for computing rewards
+    const uint8_t *RAM() const { return memory.Data(); }
+    // Unknown opcodes halt the program where they are: counted on every cycle spent there
+    uint64_t UnknownOpcodes() const override { return unknownOpcodes; }
+#ifdef CHIP8_STATS
+    // Executed instructions by operation and by address
+    const CpuStats &Stats() const { return stats; }
+    const CpuStats *Counters() const override { return &stats; }
+    void ResetStats() { stats.Reset(); }
+#endif
 
 private:
     void DumpMemory();
     void DumpResgisters();
     void DumpStack(); 
     void DumpDisplay();
-    void UpdateTimers();
+
+    template <class Q> void bindQuirks();
+    template <class Q> inline void step();
+    template <class Q> void runSwitch(uint32_t cycles);
+    template <class Q> void runTable(uint32_t cycles);
+    template <class Q> void runTraced(uint32_t cycles);
+    template <class Q> void runBlocks(uint32_t cycles);
+    // Burns the cycles left in an idle block, false when it may leave now
+    bool idle(const Block &block, const MicroOp *ops, uint32_t cycles);
+    void runJit(uint32_t cycles);
+    void runAot(uint32_t cycles);
 
     // Opcode operations stuff
+    // Tells the audio sink when the beep starts or stops, never in between
+    void updateBeep();
+
     inline void decodeOpcode();
     inline void clear();
     inline void ret();
@@ -54,12 +179,12 @@ private:
     inline void Xor(uint8_t reg1, uint8_t reg2);
     inline void addr(uint8_t reg1, uint8_t reg2);
     inline void sub(uint8_t reg1, uint8_t reg2);
-    inline void shr(uint8_t reg);
+    template <class Q> inline void shr(uint8_t reg1, uint8_t reg2);
     inline void subb(uint8_t reg1, uint8_t reg2);
-    inline void shl(uint8_t reg);
+    template <class Q> inline void shl(uint8_t reg1, uint8_t reg2);
     inline void jneqr(uint8_t reg1, uint8_t reg2);
     inline void seti(uint16_t value);
-    inline void jumpv0(uint16_t address);
+    template <class Q> inline void jumpv0(uint16_t address);
     inline void Rand(uint8_t reg,uint8_t value);
     inline void draw(uint8_t reg1, uint8_t reg2, uint8_t value);
     inline void jkey(uint8_t reg);
@@ -68,18 +193,19 @@ private:
     inline void waitkey(uint8_t reg);
     inline void setdelay(uint8_t reg);
     inline void setsound(uint8_t reg);
-    inline void addi(uint8_t reg);
+    template <class Q> inline void addi(uint8_t reg);
     inline void spritei(uint8_t reg);
     inline void bcd(uint8_t reg);
-    inline void push(uint8_t reg);
-    inline void pop(uint8_t reg);
-    inline void unknown(uint16_t opcode);
+    template <class Q> inline void push(uint8_t reg);
+    template <class Q> inline void pop(uint8_t reg);
+    inline void unknown();
 
 public:
     bool drawF;
 
     // The original implementation of the Chip-8 language used a 64x32-pixel monochrome display: 2048 pixels
-    unsigned char display[64 * 32];
+    // Packed one bit per pixel: 32 rows of 64 bits.
+    Display<64, 32> display;
     //  The computers which originally used the Chip-8 Language had a 16-key hexadecimal keypad with the following layout:
     // 1   2   3   C
     // 4   5   6   D
@@ -120,7 +246,40 @@ private:
     uint8_t sound_timer;
 
     //To make beep
-    Beep beeper;
+    AudioSink *audio;
+    // State the audio sink was last told about
+    bool beeping;
+
+    uint64_t cycle;
+    uint64_t *drawTime;
+    GuestProfiler *profiler;
+    Tracer *tracer;
+    uint64_t unknownOpcodes;
+    Xorshift random;
+
+    Engine engine;
+    QuirkProfile quirks;
+    QuirkFlags quirkFlags;
+    // Instantiations for the selected profile
+    void (Chip8::*runSwitchLoop)(uint32_t cycles);
+    void (Chip8::*runTableLoop)(uint32_t cycles);
+    void (Chip8::*runBlocksLoop)(uint32_t cycles);
+    void (Chip8::*runTracedLoop)(uint32_t cycles);
+    // Predecoded blocks for the Cached and Jit engines
+    BlockCache cache;
+    // Created on first use of the Jit engine
+    std::unique_ptr<Jit> jit;
+    // Set by SetAotProgram
+    std::unique_ptr<AotCode> aot;
+
+#ifdef CHIP8_STATS
+    CpuStats stats;
+#endif
+
+    friend struct Aot;
+    friend struct Dispatch;
+    friend class GuestProfiler;
+    friend class Jit;
 };
 
 #endif // _CHIP8_H_
@@ -0,0 +1,82 @@
+#include <exception>
+#include <memory>
+
+#include "Chip8Env.h"
+#include "Environment.h"
+
+struct chip8_env
+{
+    chip8_env(uint32_t count, uint32_t threads) : environment(count, threads) {}
+
+    VectorEnvironment environment;
+};
+
+namespace
+{
+    // Exceptions must not cross the C interface: running out of memory, or
+    // of threads for the pool, gives NULL like a ROM that can't be loaded
+    template <class Load>
+    chip8_env *create(uint32_t count, uint32_t threads, Load load)
+    {
+        try
+        {
+            std::unique_ptr<chip8_env> env(new chip8_env(count, threads));
+            return load(env->environment) ? env.release() : NULL;
+        }
+        catch (const std::exception &)
+        {
+            return NULL;
+        }
+    }
+} // namespace
+
+chip8_env *chip8_env_create(const char *rom, uint32_t count, uint32_t threads)
+{
+    return create(count, threads, [rom](VectorEnvironment &environment) { return environment.LoadROM(rom); });
+}
+
+chip8_env *chip8_env_create_from_memory(const uint8_t *program, size_t size, uint32_t count, uint32_t threads)
+{
+    return create(count, threads,
+                  [program, size](VectorEnvironment &environment) { return environment.LoadROM(program, size); });
+}
+
+void chip8_env_destroy(chip8_env *env)
+{
+    delete env;
+}
+
+uint32_t chip8_env_size(const chip8_env *env)
+{
+    return env->environment.Size();
+}
+
+void chip8_env_set_instructions_per_frame(chip8_env *env, uint32_t ipf)
+{
+    env->environment.SetInstructionsPerFrame(ipf);
+}
+
+void chip8_env_reset(chip8_env *env, uint64_t seed)
+{
+    env->environment.Reset(seed);
+}
+
+void chip8_env_reset_one(chip8_env *env, uint32_t instance, uint64_t seed)
+{
+    env->environment.Reset(instance, seed);
+}
+
+void chip8_env_step(chip8_env *env, const uint16_t *actions, uint32_t frames)
+{
+    env->environment.Step(actions, frames);
+}
+
+const uint64_t *chip8_env_observation(const chip8_env *env, uint32_t instance)
+{
+    return env->environment.Observation(instance);
+}
+
+const uint8_t *chip8_env_ram(const chip8_env *env, uint32_t instance)
+{
+    return env->environment.RAM(instance);
+}
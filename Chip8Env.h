@@ -0,0 +1,43 @@
+#ifndef _CHIP8_ENV_H_
+#define _CHIP8_ENV_H_
+
+/* C interface to VectorEnvironment (Environment.h), for training code in
+ * other languages (ctypes, cffi...). Observations and memory are pointers
+ * into the instances: no copy, valid until chip8_env_destroy, updated in
+ * place by every step and reset. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chip8_env chip8_env;
+
+/* count copies of the ROM, threads 0 is one per hardware thread. NULL when the ROM can't be read or the memory or threads can't be allocated. */
+chip8_env *chip8_env_create(const char *rom, uint32_t count, uint32_t threads);
+/* Same with the program bytes, a ROM out of a pack (Pack.h) for instance: copied, no file is read */
+chip8_env *chip8_env_create_from_memory(const uint8_t *program, size_t size, uint32_t count, uint32_t threads);
+void chip8_env_destroy(chip8_env *env);
+
+uint32_t chip8_env_size(const chip8_env *env);
+void chip8_env_set_instructions_per_frame(chip8_env *env, uint32_t ipf);
+
+/* Every instance back to the state after loading, instance i seeded with seed + i */
+void chip8_env_reset(chip8_env *env, uint64_t seed);
+void chip8_env_reset_one(chip8_env *env, uint32_t instance, uint64_t seed);
+
+/* actions[i] holds the pressed keys of instance i, bit N for key N */
+void chip8_env_step(chip8_env *env, const uint16_t *actions, uint32_t frames);
+
+/* 32 rows of 64 pixels, leftmost pixel in the most significant bit */
+const uint64_t *chip8_env_observation(const chip8_env *env, uint32_t instance);
+/* 4096 bytes */
+const uint8_t *chip8_env_ram(const chip8_env *env, uint32_t instance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHIP8_ENV_H_ */
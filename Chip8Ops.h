@@ -0,0 +1,287 @@
+#ifndef _CHIP8_OPS_H_
+#define _CHIP8_OPS_H_
+
+// Opcode operations of the Chip8 CPU and their Dispatch handlers. They live in
+// a header so every execution engine (switch, dispatch table, block cache...)
+// shares the same implementation, inlined into its own loop.
+
+#include <cstdlib>
+#include <cstring>
+#include "Chip8.h"
+
+void Chip8::clear()
+{
+    display.Clear();
+    drawF = true;
+}
+
+void Chip8::ret()
+{
+    //We have to restore stuff from stack
+    //so we put into program counter stored return address.
+    //The stack wraps around, as on the other machines
+    sp = (sp - 1) & 0xF;
+    pc = stack[sp];
+}
+
+void Chip8::jmp(uint16_t address)
+{
+    pc = address;
+}
+
+void Chip8::call(uint16_t address)
+{
+    // save return address(pc) into the stack
+    stack[sp] = pc;
+    sp = (sp + 1) & 0xF;
+    pc = address;
+}
+
+void Chip8::jeq(uint8_t reg, uint8_t value)
+{
+    V[reg] == value ? pc += 4 : pc += 2;
+}
+
+void Chip8::jneq(uint8_t reg, uint8_t value)
+{
+    V[reg] != value ? pc += 4 : pc += 2;
+}
+
+void Chip8::jeqr(uint8_t reg1, uint8_t reg2)
+{
+    V[reg1] == V[reg2] ? pc += 4 : pc += 2;
+}
+
+void Chip8::set(uint8_t reg, uint8_t value)
+{
+    V[reg] = value;
+}
+
+void Chip8::add(uint8_t reg, uint8_t value)
+{
+    V[reg] += value;
+}
+
+void Chip8::setr(uint8_t reg1, uint8_t reg2)
+{
+    V[reg1] = V[reg2];
+}
+
+void Chip8::Or(uint8_t reg1, uint8_t reg2)
+{
+    V[reg1] |= V[reg2];
+}
+
+void Chip8::And(uint8_t reg1, uint8_t reg2)
+{
+    V[reg1] &= V[reg2];
+}
+
+void Chip8::Xor(uint8_t reg1, uint8_t reg2)
+{
+    V[reg1] ^= V[reg2];
+}
+
+void Chip8::addr(uint8_t reg1, uint8_t reg2)
+{
+    V[0xF] = (0xFF - V[reg1]) < V[reg2];
+    V[reg1] += V[reg2];
+}
+
+void Chip8::sub(uint8_t reg1, uint8_t reg2)
+{
+    V[0xF] = V[reg1] < V[reg2]; 
+    V[reg1] -= V[reg2];
+}
+
+template <class Q>
+void Chip8::shr(uint8_t reg1, uint8_t reg2)
+{
+    V[0xF] = V[Q::shiftVY ? reg2 : reg1] & 0x1;
+    V[reg1] = V[Q::shiftVY ? reg2 : reg1] >> 1;
+}
+
+void Chip8::subb(uint8_t reg1, uint8_t reg2)
+{
+    V[0xF] = V[reg1] > V[reg2];
+    V[reg1] = V[reg2] - V[reg1];
+}
+
+template <class Q>
+void Chip8::shl(uint8_t reg1, uint8_t reg2)
+{
+    V[0xF] = V[Q::shiftVY ? reg2 : reg1] >> 7;
+    V[reg1] = V[Q::shiftVY ? reg2 : reg1] << 1;
+}
+
+void Chip8::jneqr(uint8_t reg1, uint8_t reg2)
+{
+    V[reg1] != V[reg2] ? pc += 4 : pc += 2;
+}
+
+void Chip8::seti(uint16_t value)
+{
+    I = value;
+}
+
+template <class Q>
+void Chip8::jumpv0(uint16_t address)
+{
+    pc = (address + V[Q::jumpVX ? (address >> 8) & 0xF : 0]) & 0xFFF;
+}
+
+void Chip8::Rand(uint8_t reg,uint8_t value)
+{
+    V[reg] = value & random.NextByte(); 
+}
+
+void Chip8::draw(uint8_t reg1, uint8_t reg2, uint8_t value)
+{
+    std::chrono::steady_clock::time_point start;
+    if (drawTime) start = std::chrono::steady_clock::now();
+
+    uint8_t x = V[reg1];
+    uint8_t y = V[reg2];
+    uint8_t rows = value;
+    V[0xF] = 0;
+    // Each sprite row is a rotate, a xor and an and for collision on the packed row
+    for (auto j=0; j<rows; j++)
+    {
+        uint8_t sprite = memory.Read(I + j);
+        V[0xF] |= display.DrawRow(x, y + j, sprite);
+    }
+    drawF = true;
+
+    if (drawTime) *drawTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Chip8::jkey(uint8_t reg)
+{
+    keyboard[V[reg]] != 0 ? pc += 4 : pc += 2;
+}
+
+void Chip8::jnkey(uint8_t reg)
+{
+    keyboard[V[reg]] == 0 ? pc += 4 : pc += 2;
+}
+
+void Chip8::getdelay(uint8_t reg)
+{
+    V[reg] = delay_timer;
+}
+
+void Chip8::waitkey(uint8_t reg)
+{
+    bool pressed = false;
+    for (auto i=0; i<16; ++i)
+    {
+        if (keyboard[i] != 0)
+        {
+            V[reg] = i;
+            pressed = true;
+        }
+    }
+    if (!pressed) return;
+    pc += 2;
+}
+
+void Chip8::setdelay(uint8_t reg)
+{
+    delay_timer = V[reg];
+}
+
+void Chip8::setsound(uint8_t reg)
+{
+    sound_timer = V[reg];
+}
+
+template <class Q>
+void Chip8::addi(uint8_t reg)
+{
+    if (Q::addiVF) V[0xF] = (I + V[reg]) > 0xFFF;
+    I += V[reg];
+}
+
+void Chip8::spritei(uint8_t reg)
+{
+    I = V[reg] * 0x5;
+}
+
+void Chip8::bcd(uint8_t reg)
+{
+    memory.Write(I, V[reg] / 100);
+    memory.Write(I + 1, (V[reg] / 10) % 10);
+    memory.Write(I + 2, V[reg] % 10);
+}
+
+template <class Q>
+void Chip8::push(uint8_t reg)
+{
+    for (auto i=0; i<= reg; ++i) memory.Write(I+i, V[i]);
+    if (Q::loadStoreI) I += reg + 1;
+}
+
+template <class Q>
+void Chip8::pop(uint8_t reg)
+{
+    for (auto i=0; i<= reg; ++i) V[i] = memory.Read(I+i);
+    if (Q::loadStoreI) I += reg + 1;
+}
+
+void Chip8::unknown()
+{
+    ++unknownOpcodes;
+}
+
+void Chip8::decodeOpcode()
+{
+    // fetch opcode: Opcode is 2bytes long -> we have to fetch two bytes
+    // Ej: 0xA2       0xA2 << 8 = 0xA200 
+    // Use or bitwase two join it: 0xA200 | 0xF0 = 0xA2F0
+    // pc runs past 0xFFE after the last instruction of memory: wrap it
+    pc &= 0xFFF;
+    opcode = memory.Read(pc) << 8 | memory.Read(pc + 1);
+}
+
+// Handlers are instantiated once per quirk profile, behaviour is resolved at compile time
+#define CHIP8_HANDLER(name) template <class Q> void Dispatch::name(Chip8 &cpu, const Instruction &ins)
+
+CHIP8_HANDLER(Unknown)  { (void) ins; cpu.unknown(); }
+CHIP8_HANDLER(Clear)    { (void) ins; cpu.clear(); cpu.pc += 2; }
+CHIP8_HANDLER(Ret)      { (void) ins; cpu.ret(); cpu.pc += 2; }
+CHIP8_HANDLER(Jmp)      { cpu.jmp(ins.nnn); }
+CHIP8_HANDLER(Call)     { cpu.call(ins.nnn); }
+CHIP8_HANDLER(Jeq)      { cpu.jeq(ins.x, ins.kk); }
+CHIP8_HANDLER(Jneq)     { cpu.jneq(ins.x, ins.kk); }
+CHIP8_HANDLER(Jeqr)     { cpu.jeqr(ins.x, ins.y); }
+CHIP8_HANDLER(Set)      { cpu.set(ins.x, ins.kk); cpu.pc += 2; }
+CHIP8_HANDLER(Add)      { cpu.add(ins.x, ins.kk); cpu.pc += 2; }
+CHIP8_HANDLER(Setr)     { cpu.setr(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(Or)       { cpu.Or(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(And)      { cpu.And(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(Xor)      { cpu.Xor(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(Addr)     { cpu.addr(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(Sub)      { cpu.sub(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(Shr)      { cpu.shr<Q>(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(Subb)     { cpu.subb(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(Shl)      { cpu.shl<Q>(ins.x, ins.y); cpu.pc += 2; }
+CHIP8_HANDLER(Jneqr)    { cpu.jneqr(ins.x, ins.y); }
+CHIP8_HANDLER(Seti)     { cpu.seti(ins.nnn); cpu.pc += 2; }
+CHIP8_HANDLER(Jumpv0)   { cpu.jumpv0<Q>(ins.nnn); }
+CHIP8_HANDLER(Rand)     { cpu.Rand(ins.x, ins.kk); cpu.pc += 2; }
+CHIP8_HANDLER(Draw)     { cpu.draw(ins.x, ins.y, ins.n); cpu.pc += 2; }
+CHIP8_HANDLER(Jkey)     { cpu.jkey(ins.x); }
+CHIP8_HANDLER(Jnkey)    { cpu.jnkey(ins.x); }
+CHIP8_HANDLER(Getdelay) { cpu.getdelay(ins.x); cpu.pc += 2; }
+CHIP8_HANDLER(Waitkey)  { cpu.waitkey(ins.x); }
+CHIP8_HANDLER(Setdelay) { cpu.setdelay(ins.x); cpu.pc += 2; }
+CHIP8_HANDLER(Setsound) { cpu.setsound(ins.x); cpu.pc += 2; }
+CHIP8_HANDLER(Addi)     { cpu.addi<Q>(ins.x); cpu.pc += 2; }
+CHIP8_HANDLER(Spritei)  { cpu.spritei(ins.x); cpu.pc += 2; }
+CHIP8_HANDLER(Bcd)      { cpu.bcd(ins.x); cpu.pc += 2; }
+CHIP8_HANDLER(Push)     { cpu.push<Q>(ins.x); cpu.pc += 2; }
+CHIP8_HANDLER(Pop)      { cpu.pop<Q>(ins.x); cpu.pc += 2; }
+
+#undef CHIP8_HANDLER
+
+#endif // _CHIP8_OPS_H_
@@ -0,0 +1,181 @@
+#include "Chip8Ops.h"
+#include "Dispatch.h"
+
+namespace
+{
+    Instruction make(uint8_t op, uint16_t opcode)
+    {
+        Instruction ins;
+        ins.op  = op;
+        ins.x   = (opcode & 0x0F00) >> 8;
+        ins.y   = (opcode & 0x00F0) >> 4;
+        ins.n   = opcode & 0x000F;
+        ins.kk  = opcode & 0x00FF;
+        ins.nnn = opcode & 0x0FFF;
+        return ins;
+    }
+
+    struct Table
+    {
+        Table()
+        {
+            for (uint32_t opcode=0; opcode<=0xFFFF; ++opcode) 
+                entries[opcode] = Decode(opcode);
+        }
+
+        Instruction entries[0x10000];
+    };
+
+    // The operation only depends on the first nibble and the last byte of
+    // the opcode: 4KB instead of the 512KB of the decoded table
+    struct OpTable
+    {
+        OpTable()
+        {
+            for (uint32_t opcode=0; opcode<=0xFFFF; ++opcode)
+                ops[index(opcode)] = Decode(opcode).op;
+        }
+
+        static uint32_t index(uint16_t opcode) { return (opcode >> 4 & 0xF00) | (opcode & 0xFF); }
+
+        uint8_t ops[0x1000];
+    };
+
+#define CHIP8_OP_NAME(name) #name,
+    const char *op_names[OP_COUNT] = { CHIP8_OPS(CHIP8_OP_NAME) };
+#undef CHIP8_OP_NAME
+} // namespace
+
+const char *OpName(uint8_t op)
+{
+    return op < OP_COUNT ? op_names[op] : "?";
+}
+
+// Same decoding tree as Chip8::RunCicle, run once per opcode instead of once per cycle
+Instruction Decode(uint16_t opcode)
+{
+    switch(opcode & 0xF000)
+    {
+        case 0x0000:
+            switch(opcode & 0x000F)
+            {
+                case 0x0000: return make(OP_Clear, opcode);
+                case 0x000E: return make(OP_Ret, opcode);
+            }
+            break;
+        case 0x1000: return make(OP_Jmp, opcode);
+        case 0x2000: return make(OP_Call, opcode);
+        case 0x3000: return make(OP_Jeq, opcode);
+        case 0x4000: return make(OP_Jneq, opcode);
+        case 0x5000: return make(OP_Jeqr, opcode);
+        case 0x6000: return make(OP_Set, opcode);
+        case 0x7000: return make(OP_Add, opcode);
+        case 0x8000:
+            switch(opcode & 0x000F)
+            {
+                case 0x0000: return make(OP_Setr, opcode);
+                case 0x0001: return make(OP_Or, opcode);
+                case 0x0002: return make(OP_And, opcode);
+                case 0x0003: return make(OP_Xor, opcode);
+                case 0x0004: return make(OP_Addr, opcode);
+                case 0x0005: return make(OP_Sub, opcode);
+                case 0x0006: return make(OP_Shr, opcode);
+                case 0x0007: return make(OP_Subb, opcode);
+                case 0x000E: return make(OP_Shl, opcode);
+            }
+            break;
+        case 0x9000: return make(OP_Jneqr, opcode);
+        case 0xA000: return make(OP_Seti, opcode);
+        case 0xB000: return make(OP_Jumpv0, opcode);
+        case 0xC000: return make(OP_Rand, opcode);
+        case 0xD000: return make(OP_Draw, opcode);
+        case 0xE000:
+            switch(opcode & 0x00FF)
+            {
+                case 0x009E: return make(OP_Jkey, opcode);
+                case 0x00A1: return make(OP_Jnkey, opcode);
+            }
+            break;
+        case 0xF000:
+            switch(opcode & 0x00FF)
+            {
+                case 0x0007: return make(OP_Getdelay, opcode);
+                case 0x000A: return make(OP_Waitkey, opcode);
+                case 0x0015: return make(OP_Setdelay, opcode);
+                case 0x0018: return make(OP_Setsound, opcode);
+                case 0x001E: return make(OP_Addi, opcode);
+                case 0x0029: return make(OP_Spritei, opcode);
+                case 0x0033: return make(OP_Bcd, opcode);
+                case 0x0055: return make(OP_Push, opcode);
+                case 0x0065: return make(OP_Pop, opcode);
+            }
+            break;
+    }
+    return make(OP_Unknown, opcode);
+}
+
+const Instruction *DecodeTable()
+{
+    static const Table table;
+    return table.entries;
+}
+
+template <class Q>
+const Dispatch::Handler *Dispatch::Handlers()
+{
+#define CHIP8_OP_POINTER(name) &Dispatch::name<Q>,
+    static const Handler handlers[OP_COUNT] = { CHIP8_OPS(CHIP8_OP_POINTER) };
+#undef CHIP8_OP_POINTER
+    return handlers;
+}
+
+// Table engine: the operation is looked up in a small table instead of
+// going down the nested switch, and each handler only extracts the operands
+// it uses. With GCC/Clang handlers are threaded with computed gotos, every
+// handler jumps straight to the next one without going back to a loop.
+template <class Q>
+void Chip8::runTable(uint32_t cycles)
+{
+    static const OpTable table;
+    uint16_t code = 0;
+
+#if defined(__GNUC__)
+#define CHIP8_OP_LABEL(name) &&op_##name,
+    static const void *labels[OP_COUNT] = { CHIP8_OPS(CHIP8_OP_LABEL) };
+#undef CHIP8_OP_LABEL
+
+#define CHIP8_NEXT()                                                \
+    if (cycles-- == 0) return;                                      \
+    decodeOpcode();                                                 \
+    code = opcode;                                                  \
+    CHIP8_STAT(stats.Count(pc, table.ops[OpTable::index(code)]));   \
+    goto *labels[table.ops[OpTable::index(code)]]
+
+    CHIP8_NEXT();
+
+#define CHIP8_OP_BODY(name)                                         \
+    op_##name:                                                      \
+        Dispatch::name<Q>(*this, make(OP_##name, code));            \
+        CHIP8_NEXT();
+
+    CHIP8_OPS(CHIP8_OP_BODY)
+
+#undef CHIP8_OP_BODY
+#undef CHIP8_NEXT
+#else
+    while (cycles--)
+    {
+        decodeOpcode();
+        code = opcode;
+        const uint8_t op = table.ops[OpTable::index(code)];
+        CHIP8_STAT(stats.Count(pc, op));
+        Dispatch::Handlers<Q>()[op](*this, make(op, code));
+    }
+#endif
+}
+
+#define CHIP8_INSTANTIATE(name)                                         \
+    template const Dispatch::Handler *Dispatch::Handlers<name##Quirks>(); \
+    template void Chip8::runTable<name##Quirks>(uint32_t cycles);
+CHIP8_QUIRK_PROFILES(CHIP8_INSTANTIATE)
+#undef CHIP8_INSTANTIATE
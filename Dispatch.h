@@ -0,0 +1,60 @@
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+#include <cstdint>
+
+class Chip8;
+
+// Every Chip8 operation, in the same order as the opcode table.
+// Used to generate the op enumeration, the handlers and the jump labels.
+#define CHIP8_OPS(X) \
+    X(Unknown)  X(Clear)    X(Ret)      X(Jmp)      X(Call)     X(Jeq)      \
+    X(Jneq)     X(Jeqr)     X(Set)      X(Add)      X(Setr)     X(Or)       \
+    X(And)      X(Xor)      X(Addr)     X(Sub)      X(Shr)      X(Subb)     \
+    X(Shl)      X(Jneqr)    X(Seti)     X(Jumpv0)   X(Rand)     X(Draw)     \
+    X(Jkey)     X(Jnkey)    X(Getdelay) X(Waitkey)  X(Setdelay) X(Setsound) \
+    X(Addi)     X(Spritei)  X(Bcd)      X(Push)     X(Pop)
+
+#define CHIP8_OP_ENUM(name) OP_##name,
+enum Op : uint8_t
+{
+    CHIP8_OPS(CHIP8_OP_ENUM)
+    OP_COUNT
+};
+#undef CHIP8_OP_ENUM
+
+// Opcode with its operands already extracted: 0x?XYN, 0x??KK, 0x?NNN
+struct Instruction
+{
+    uint8_t op;
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t kk;
+    uint16_t nnn;
+};
+
+// Operation name, as spelled in CHIP8_OPS
+const char *OpName(uint8_t op);
+
+// Decodes a single opcode the same way Chip8::RunCicle does
+Instruction Decode(uint16_t opcode);
+
+// 64K entries, one per possible opcode. Built once on first use.
+const Instruction *DecodeTable();
+
+// Instruction handlers: execute the operation and move the program counter.
+// Q is one of the quirk policies from Quirks.h.
+struct Dispatch
+{
+    typedef void (*Handler)(Chip8 &cpu, const Instruction &ins);
+
+#define CHIP8_OP_HANDLER(name) template <class Q> static void name(Chip8 &cpu, const Instruction &ins);
+    CHIP8_OPS(CHIP8_OP_HANDLER)
+#undef CHIP8_OP_HANDLER
+
+    // Handler table of a quirk profile, indexed by Op
+    template <class Q> static const Handler *Handlers();
+};
+
+#endif // _DISPATCH_H_
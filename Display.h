@@ -0,0 +1,136 @@
+#ifndef _DISPLAY_H_
+#define _DISPLAY_H_
+
+#include <cstdint>
+#include <cstring>
+
+// Monochrome framebuffer packed one bit per pixel, W / 64 words per row.
+// The leftmost pixel of a row is the most significant bit of its first word.
+template <uint32_t W, uint32_t H>
+class Display
+{
+    static_assert(W == 64 || W == 128, "Rows are stored in one or two 64 bit words");
+    static_assert((H & (H - 1)) == 0, "Height must be a power of two");
+    static_assert(H <= 64, "Screens compare rows in a 64 bit mask");
+
+public:
+    static const uint32_t WIDTH = W;
+    static const uint32_t HEIGHT = H;
+    static const uint32_t WORDS = W / 64;
+
+    Display() : rows{0} {}
+
+    void Clear()
+    {
+        memset(rows, 0, sizeof(rows));
+    }
+
+    // XORs an 8 pixel wide sprite row at (x, y), wrapping around the screen.
+    // Returns true when a lit pixel gets erased (collision).
+    bool DrawRow(uint8_t x, uint8_t y, uint8_t sprite)
+    {
+        if (WORDS > 1) return DrawBits(x, y, static_cast<uint64_t>(sprite) << 56, 8, false);
+
+        uint64_t bits = rotr(static_cast<uint64_t>(sprite) << 56, x & 63);
+        uint64_t &row = rows[y & (H - 1)];
+        bool collision = (row & bits) != 0;
+        row ^= bits;
+        return collision;
+    }
+
+    // XORs the width leftmost bits of bits at (x, y). The origin wraps around
+    // the screen, pixels past the right edge wrap to the left one unless clip
+    // is set, then they are dropped.
+    bool DrawBits(uint32_t x, uint32_t y, uint64_t bits, uint32_t width, bool clip)
+    {
+        x &= W - 1;
+        y &= H - 1;
+        uint32_t word = x / 64, offset = x % 64;
+        uint64_t *row = &rows[y * WORDS];
+
+        uint64_t first = bits >> offset;
+        bool collision = (row[word] & first) != 0;
+        row[word] ^= first;
+
+        // part spilling into the next word (or back into the first one)
+        if (offset + width > 64 && !(clip && word + 1 == WORDS))
+        {
+            uint64_t second = bits << (64 - offset);
+            uint64_t &next = row[(word + 1) % WORDS];
+            collision |= (next & second) != 0;
+            next ^= second;
+        }
+        return collision;
+    }
+
+    // Moves the picture n rows down or up, n columns right or left.
+    // Pixels scrolled in are blank.
+    void ScrollDown(uint32_t n)
+    {
+        if (n > H) n = H;
+        memmove(rows + n * WORDS, rows, (H - n) * WORDS * sizeof(uint64_t));
+        memset(rows, 0, n * WORDS * sizeof(uint64_t));
+    }
+
+    void ScrollUp(uint32_t n)
+    {
+        if (n > H) n = H;
+        memmove(rows, rows + n * WORDS, (H - n) * WORDS * sizeof(uint64_t));
+        memset(rows + (H - n) * WORDS, 0, n * WORDS * sizeof(uint64_t));
+    }
+
+    // n < 64
+    void ScrollRight(uint32_t n)
+    {
+        if (!n) return;
+        for (uint32_t y=0; y<H; ++y)
+        {
+            uint64_t *row = &rows[y * WORDS];
+            for (uint32_t w=WORDS - 1; w>0; --w) row[w] = (row[w] >> n) | (row[w - 1] << (64 - n));
+            row[0] >>= n;
+        }
+    }
+
+    // n < 64
+    void ScrollLeft(uint32_t n)
+    {
+        if (!n) return;
+        for (uint32_t y=0; y<H; ++y)
+        {
+            uint64_t *row = &rows[y * WORDS];
+            for (uint32_t w=0; w + 1<WORDS; ++w) row[w] = (row[w] << n) | (row[w + 1] >> (64 - n));
+            row[WORDS - 1] <<= n;
+        }
+    }
+
+    // Words of row y, leftmost first
+    uint64_t Row(int y, int word = 0) const { return rows[y * WORDS + word]; }
+    // All rows, WORDS words each
+    const uint64_t *Rows() const { return rows; }
+    // Replaces the whole screen
+    void Restore(const uint64_t *from)
+    {
+        memcpy(rows, from, sizeof(rows));
+    }
+
+    bool Pixel(int x, int y) const { return (rows[y * WORDS + x / 64] >> (63 - x % 64)) & 1; }
+
+    // Expands row y into W bytes, 1 for lit pixels and 0 otherwise
+    void UnpackRow(int y, unsigned char *out) const
+    {
+        for (uint32_t x=0; x<W; ++x) out[x] = Pixel(x, y);
+    }
+
+    bool operator==(const Display &other) const { return memcmp(rows, other.rows, sizeof(rows)) == 0; }
+
+private:
+    static uint64_t rotr(uint64_t value, uint32_t n)
+    {
+        return (value >> n) | (value << ((64 - n) & 63));
+    }
+
+private:
+    uint64_t rows[H * WORDS];
+};
+
+#endif // _DISPLAY_H_
@@ -0,0 +1,76 @@
+#include "EmulationThread.h"
+#include "InputLog.h"
+#include "Machine.h"
+#include "Rewind.h"
+#include "Scheduler.h"
+
+EmulationThread::EmulationThread(Machine &cpu, Scheduler &scheduler)
+            : cpu(cpu),
+              scheduler(scheduler),
+              running(false),
+              keys(0),
+              turbo(false),
+              rewinding(false),
+              rewind(NULL),
+              input(NULL)
+{
+}
+
+EmulationThread::~EmulationThread()
+{
+    Stop();
+}
+
+void EmulationThread::Start()
+{
+    if (running.exchange(true)) return;
+    thread = std::thread(&EmulationThread::loop, this);
+}
+
+void EmulationThread::Stop()
+{
+    running.store(false);
+    if (thread.joinable()) thread.join();
+}
+
+void EmulationThread::SetKey(uint8_t key, bool pressed)
+{
+    if (pressed) keys.fetch_or(1 << key, std::memory_order_relaxed);
+    else keys.fetch_and(~(1 << key), std::memory_order_relaxed);
+}
+
+void EmulationThread::loop()
+{
+    while (running.load(std::memory_order_relaxed))
+    {
+        uint16_t pressed = keys.load(std::memory_order_relaxed);
+        cpu.SetKeys(pressed);
+        scheduler.SetTurbo(turbo.load(std::memory_order_relaxed));
+
+        if (rewind && rewinding.load(std::memory_order_relaxed))
+        {
+            // One frame back per frame, stays on the oldest one when history runs out
+            if (rewind->StepBack(past))
+            {
+                cpu.Restore(past);
+                if (input) input->Truncate(cpu.Cycle());
+            }
+        }
+        else
+        {
+            if (input) input->Record(cpu.Cycle(), pressed);
+            scheduler.RunFrame();
+            if (rewind) rewind->Record(cpu);
+        }
+
+        Frame &frame = frames.Back();
+        if (cpu.TakeScreen(frame.screen))
+        {
+            frame.number = scheduler.Frames();
+            frame.cycle = cpu.Cycle();
+            frames.Publish();
+        }
+
+        scheduler.WaitNextFrame();
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef _EMULATION_THREAD_H_
+#define _EMULATION_THREAD_H_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include "Screen.h"
+#include "Snapshot.h"
+#include "TripleBuffer.h"
+
+class InputLog;
+class Machine;
+class RewindBuffer;
+class Scheduler;
+
+// Completed frame, as published to the render thread
+struct Frame
+{
+    Screen screen;
+    uint64_t number;
+    // instructions executed so far
+    uint64_t cycle;
+};
+
+// Runs the CPU on its own thread, paced by the scheduler. Frames are published
+// through a triple buffer, and the key state flows back through atomics, so
+// rendering never stalls emulation and vice versa.
+class EmulationThread
+{
+public:
+    EmulationThread(Machine &cpu, Scheduler &scheduler);
+    ~EmulationThread();
+    EmulationThread (const EmulationThread &) = delete;
+    EmulationThread & operator=(const EmulationThread &) = delete;
+
+    void Start();
+    void Stop();
+
+    // Called from any thread, applied at the next frame boundary
+    void SetKey(uint8_t key, bool pressed);
+    void SetTurbo(bool on) { turbo.store(on, std::memory_order_relaxed); }
+    // While on, frames are played backwards from the rewind history
+    void SetRewinding(bool on) { rewinding.store(on, std::memory_order_relaxed); }
+
+    // Records every frame into buffer (NULL disables it). Call before Start.
+    // Only for machines with snapshots.
+    void SetRewindBuffer(RewindBuffer *buffer) { rewind = buffer; }
+    // Logs every key change (NULL disables it). Call before Start.
+    void SetInputLog(InputLog *log) { input = log; }
+
+    // The CPU can only be looked at while the thread is stopped
+    const Machine &Cpu() const { return cpu; }
+
+    // Render thread: true when a new frame is available in LatestFrame()
+    bool ConsumeFrame() { return frames.Consume(); }
+    const Frame &LatestFrame() const { return frames.Front(); }
+
+private:
+    void loop();
+
+private:
+    Machine &cpu;
+    Scheduler &scheduler;
+    std::thread thread;
+    std::atomic<bool> running;
+    // one bit per Chip8 key
+    std::atomic<uint16_t> keys;
+    std::atomic<bool> turbo;
+    std::atomic<bool> rewinding;
+    TripleBuffer<Frame> frames;
+    RewindBuffer *rewind;
+    InputLog *input;
+    // Frame being restored while rewinding
+    Snapshot past;
+};
+
+#endif // _EMULATION_THREAD_H_
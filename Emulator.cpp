@@ -1,8 +1,22 @@
 #include <SDL2/SDL.h>
+#include <cstring>
+#include <memory>
 #include <unistd.h>
 
+#include "Analysis.h"
+#include "Beep.h"
+#include "Catalog.h"
 #include "Chip8.h"
+#include "EmulationThread.h"
 #include "Graphics.h"
+#include "InputLog.h"
+#include "Machine.h"
+#include "Profiler.h"
+#include "Rewind.h"
+#include "Rom.h"
+#include "Scheduler.h"
+#include "Startup.h"
+#include "Trace.h"
 
 #ifdef DEBUG
 #include "Debug.h"
@@ -11,20 +25,114 @@
 class Emulator
 {
 public:
-    Emulator() : graphics(processor) {}
+    explicit Emulator(MachineMode mode) 
+            : machine(CreateMachine(mode)),
+              processor(mode == MachineMode::Chip8 ? static_cast<Chip8 *>(machine.get()) : NULL),
+              scheduler(*machine), 
+              emulation(*machine, scheduler), 
+              graphics(emulation, machine->ScreenWidth(), machine->ScreenHeight()),
+              romHash(0)
+    {
+        machine->SetAudioSink(&beeper);
+        graphics.SetBeep(&beeper);
+    }
 
     ~Emulator() = default;
 
-    bool LoadROM(const char *filename) { return (processor.LoadROM(filename)); }
+    // Bytes available to the program, to map its file
+    size_t MaxROMSize() const { return machine->MaxROMSize(); }
+
+    void SetEngine(Engine engine)
+    {
+        if (processor) processor->SetEngine(engine);
+    }
+
+    // Quirk profile detected from the program when autoQuirks is set. With
+    // the cached and JIT engines the blocks of the program are built before
+    // it runs, the other engines don't need the analysis.
+    bool LoadROM(const RomImage &rom, bool autoQuirks, QuirkProfile quirks)
+    {
+        if (!machine->LoadROM(rom.Data(), rom.Size())) return false;
+        romHash = rom.Hash();
+        if (processor)
+        {
+            processor->SetQuirks(autoQuirks ? processor->DetectQuirks() : quirks);
+            if (processor->UsesBlocks()) processor->Prebuild(RomAnalysis(rom.Data(), rom.Size()));
+        }
+        return true;
+    }
 
     void Dump()
     {
-        processor.DumpStatus();
+        if (processor) processor->DumpStatus();
     }
 
-    void Run()
+    void SetStartupTimer(StartupTimer *timer) { graphics.SetStartupTimer(timer); }
+    void SetKeymap(const char *keymap) { graphics.SetKeymap(keymap); }
+
+    // Rewinding, recording, profiling and tracing need the original machine.
+    // The window opens here, once the program is loaded. A trace follows
+    // the run from start to end: rewinding is off while tracing.
+    void Run(uint32_t instructionsPerFrame, bool turbo, uint32_t rewindSeconds, const char *record, const char *profile,
+             const char *trace)
     {
+        graphics.Init();
+        if (!processor || trace) rewindSeconds = 0;
+        if (trace)
+        {
+            if (tracer.Open(trace, romHash, processor->GetQuirks(), processor->Cycle())) processor->SetTracer(&tracer);
+            else printf("Can't write the trace %s\n", trace);
+        }
+        if (profile)
+        {
+            profiler.reset(new GuestProfiler(PROFILE_INTERVAL));
+            processor->SetProfiler(profiler.get());
+        }
+        scheduler.SetInstructionsPerFrame(instructionsPerFrame);
+        if (record)
+        {
+            uint64_t seed = time(NULL);
+            processor->Seed(seed);
+            input.Start(seed, instructionsPerFrame, processor->GetQuirks());
+            emulation.SetInputLog(&input);
+        }
+        emulation.SetTurbo(turbo);
+        if (rewindSeconds)
+        {
+            uint32_t frames = rewindSeconds * Scheduler::FRAMES_PER_SECOND;
+            history.reset(new RewindBuffer(frames, frames * REWIND_BYTES_PER_FRAME));
+            emulation.SetRewindBuffer(history.get());
+        }
         graphics.mainLoop();
+
+        if (history)
+        {
+            printf("Rewind: %.1f s of history, %.1f KB per second, %zu of %zu KB used\n",
+                   (double) history->Frames() / Scheduler::FRAMES_PER_SECOND, history->BytesPerSecond() / 1024,
+                   history->UsedBytes() / 1024, history->Capacity() / 1024);
+        }
+
+        if (record)
+        {
+            Snapshot snapshot;
+            processor->Save(snapshot);
+            input.Finish(processor->Cycle(), SnapshotHash(snapshot));
+            if (input.Save(record)) printf("Input log: %zu key events in %s\n", input.Events().size(), record);
+            else printf("Can't write the input log %s\n", record);
+        }
+
+        if (tracer.IsOpen())
+        {
+            processor->SetTracer(NULL);
+            if (tracer.Close()) printf("Trace: %lu records in %s\n", (unsigned long) tracer.Records(), trace);
+            else printf("Can't write the trace %s\n", trace);
+        }
+
+        if (profiler)
+        {
+            if (profiler->Write(profile)) printf("Profile: %lu samples in %s\n", (unsigned long) profiler->Samples(), profile);
+            else printf("Can't write the profile %s\n", profile);
+        }
     }
 
 #ifdef DEBUG
@@ -35,28 +143,145 @@ public:
         {
             key = getche();
             Dump();
-            if (key == 0x20) processor.RunCicle();
+            if (key == 0x20 && processor) processor->RunCicle();
         } while (key == 0x20);
     }
 #endif
 
 private:
-    Chip8 processor;
+    // Budget of the rewind buffer. Frames usually take much less (only the
+    // changes since the last keyframe are kept), the report at exit tells.
+    static const size_t REWIND_BYTES_PER_FRAME = 512;
+    // Instructions between profiler samples, prime so they don't lock onto loops
+    static const uint32_t PROFILE_INTERVAL = 101;
+
+    Beep beeper;
+    std::unique_ptr<Machine> machine;
+    // The machine when it is the original one, NULL otherwise
+    Chip8 *processor;
+    // Outlive the emulation thread recording into them
+    std::unique_ptr<RewindBuffer> history;
+    InputLog input;
+    std::unique_ptr<GuestProfiler> profiler;
+    Tracer tracer;
+    Scheduler scheduler;
+    EmulationThread emulation;
     Graphics graphics;
+    // Of the program loaded, for the trace
+    uint64_t romHash;
 };
 
 int main(int argc, char *argv[])
 {
-    if(argc < 2)
+    StartupTimer startup;
+    bool startupReport = false;
+    uint32_t instructionsPerFrame = Scheduler::DEFAULT_INSTRUCTIONS_PER_FRAME;
+    bool ipfSet = false;
+    bool turbo = false;
+    uint32_t rewindSeconds = 10;
+    const char *record = NULL;
+    const char *profile = NULL;
+    const char *trace = NULL;
+    bool autoQuirks = true;
+    bool quirksSet = false;
+    QuirkProfile quirks = QuirkProfile::Legacy;
+    const char *catalogFile = NULL;
+    MachineMode mode = MachineMode::Chip8;
+    Engine engine = Engine::CHIP8_DEFAULT_ENGINE;
+    bool chip8Only = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (strcmp(argv[arg], "--ipf") == 0 && arg + 1 < argc)
+        {
+            instructionsPerFrame = strtoul(argv[++arg], NULL, 0);
+            ipfSet = true;
+        }
+        else if (strcmp(argv[arg], "--catalog") == 0 && arg + 1 < argc) catalogFile = argv[++arg];
+        else if (strcmp(argv[arg], "--turbo") == 0) turbo = true;
+        else if (strcmp(argv[arg], "--startup-report") == 0) startupReport = true;
+        else if (strcmp(argv[arg], "--rewind") == 0 && arg + 1 < argc) rewindSeconds = strtoul(argv[++arg], NULL, 0);
+        else if (strcmp(argv[arg], "--record") == 0 && arg + 1 < argc) { record = argv[++arg]; chip8Only = true; }
+        else if (strcmp(argv[arg], "--profile") == 0 && arg + 1 < argc) { profile = argv[++arg]; chip8Only = true; }
+        else if (strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc) { trace = argv[++arg]; chip8Only = true; }
+        else if (strcmp(argv[arg], "--mode") == 0 && arg + 1 < argc)
+        {
+            if (!MachineModeFromName(argv[++arg], mode))
+            {
+                printf("Unknown mode: %s\n", argv[arg]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--engine") == 0 && arg + 1 < argc)
+        {
+            chip8Only = true;
+            if (!EngineFromName(argv[++arg], engine))
+            {
+                printf("Unknown engine: %s\n", argv[arg]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            chip8Only = true;
+            quirksSet = true;
+            autoQuirks = strcmp(argv[++arg], "auto") == 0;
+            if (!autoQuirks && !QuirkProfileFromName(argv[arg], quirks))
+            {
+                printf("Unknown quirk profile: %s\n", argv[arg]);
+                return 1;
+            }
+        }
+        else break;
+    }
+
+    if(arg >= argc || instructionsPerFrame == 0)
+    {
+        printf("Usage: %s [--ipf instructions per frame] [--catalog ROM catalog] [--turbo] [--rewind seconds] [--record input log] [--profile folded stacks file] [--trace trace file] [--engine switch|table|cached|jit] [--quirks auto|legacy|vip|schip] [--mode chip8|schip|xochip] [--startup-report] <ROM file>\n\n", argv[0]);
+        return 1;
+    }
+
+    if (chip8Only && mode != MachineMode::Chip8)
     {
-        printf("Usage: %s <ROM file>\n\n", argv[0]);
+        printf("--record, --profile, --trace, --engine and --quirks need --mode chip8\n");
         return 1;
     }
 
-    Emulator emu;
+    startup.Mark("arguments");
+    Emulator emu(mode);
+    emu.SetEngine(engine);
+    startup.Mark("machine");
+
+    // The catalog entry of the ROM fills in what the command line leaves out
+    RomImage rom(argv[arg], emu.MaxROMSize());
+    if (!rom.Valid())
+    {
+        printf("%s %s\n", argv[arg], rom.Error());
+        return 1;
+    }
+    RomCatalog catalog;
+    if (!catalog.LoadFor(argv[arg], catalogFile))
+    {
+        printf("Can't read the catalog %s\n", catalogFile);
+        return 1;
+    }
+    if (catalog.BadLine()) printf("%s:%u: bad catalog entry, skipped\n", catalog.Path().c_str(), catalog.BadLine());
+    if (const RomProfile *tuned = catalog.Find(rom.Hash()))
+    {
+        if (!quirksSet)
+        {
+            autoQuirks = false;
+            quirks = tuned->quirks;
+        }
+        if (!ipfSet) instructionsPerFrame = tuned->instructionsPerFrame;
+        emu.SetKeymap(tuned->keymap);
+        printf("Catalog: %s\n", tuned->name.empty() ? argv[arg] : tuned->name.c_str());
+    }
 
-    if(!emu.LoadROM(argv[1]))       
+    if(!emu.LoadROM(rom, autoQuirks, quirks))
         return 1;
+    startup.Mark("ROM");
+    if (startupReport) emu.SetStartupTimer(&startup);
 
 #ifdef DEBUG
     emu.Dump();
@@ -67,7 +292,7 @@ int main(int argc, char *argv[])
 #ifdef DEBUG
     emu.Debug();
 #else
-    emu.Run();
+    emu.Run(instructionsPerFrame, turbo, rewindSeconds, record, profile, trace);
 #endif
 
     return 0;
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include "Environment.h"
+#include "Rom.h"
+#include "Scheduler.h"
+
+VectorEnvironment::VectorEnvironment(uint32_t count, uint32_t threads)
+            : instructionsPerFrame(Scheduler::DEFAULT_INSTRUCTIONS_PER_FRAME),
+              pool(threads)
+{
+    for (uint32_t i=0; i<count; ++i) instances.emplace_back(new Chip8);
+    if (count) instances[0]->Save(initial);
+}
+
+bool VectorEnvironment::LoadROM(const char *filename)
+{
+    RomImage rom(filename, Memory<4096>::PROGRAM_SIZE);
+    return rom.Valid() && LoadROM(rom.Data(), rom.Size());
+}
+
+bool VectorEnvironment::LoadROM(const uint8_t *program, size_t size)
+{
+    if (instances.empty()) return false;
+
+    // Loaded once, copied through a snapshot
+    Chip8 &first = *instances[0];
+    if (!first.LoadROM(program, size)) return false;
+    first.Save(initial);
+    SetQuirks(first.DetectQuirks());
+    for (uint32_t i=1; i<Size(); ++i) instances[i]->Restore(initial);
+    return true;
+}
+
+void VectorEnvironment::SetEngine(Engine engine)
+{
+    for (auto &instance : instances) instance->SetEngine(engine);
+}
+
+void VectorEnvironment::SetQuirks(QuirkProfile quirks)
+{
+    for (auto &instance : instances) instance->SetQuirks(quirks);
+}
+
+void VectorEnvironment::Reset(uint64_t seed)
+{
+    pool.ParallelFor(Size(), grain(), [this, seed](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i=begin; i<end; ++i) Reset(i, seed + i);
+    });
+}
+
+void VectorEnvironment::Reset(uint32_t instance, uint64_t seed)
+{
+    instances[instance]->Restore(initial);
+    instances[instance]->Seed(seed);
+}
+
+void VectorEnvironment::Step(const uint16_t *actions, uint32_t frames)
+{
+    pool.ParallelFor(Size(), grain(), [this, actions, frames](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i=begin; i<end; ++i)
+        {
+            Chip8 &instance = *instances[i];
+            instance.SetKeys(actions[i]);
+            for (uint32_t f=0; f<frames; ++f) instance.RunFrame(instructionsPerFrame);
+        }
+    });
+}
+
+uint32_t VectorEnvironment::grain() const
+{
+    return std::max(1u, Size() / (Threads() * 8));
+}
@@ -0,0 +1,66 @@
+#ifndef _ENVIRONMENT_H_
+#define _ENVIRONMENT_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Chip8.h"
+#include "Snapshot.h"
+#include "ThreadPool.h"
+
+// Copies of one program run as a vector of reinforcement learning
+// environments: reset them, step them all with one action each, read the
+// screens in place. Every instance is a whole Chip8 with its own engine, so
+// instances are spread across cores by a work stealing thread pool. No SDL,
+// no audio.
+class VectorEnvironment
+{
+public:
+    // threads counts the calling thread, 0 is one per hardware thread
+    explicit VectorEnvironment(uint32_t count, uint32_t threads = 0);
+    ~VectorEnvironment() = default;
+    VectorEnvironment (const VectorEnvironment &) = delete;
+    VectorEnvironment & operator=(const VectorEnvironment &) = delete;
+
+    // Loads the program into every instance, with the quirk profile it most
+    // likely expects, and keeps that state as the one to reset to
+    bool LoadROM(const char *filename);
+    // Program already in memory, from a ROM pack for instance
+    bool LoadROM(const uint8_t *program, size_t size);
+    // Not part of the state: they survive resets
+    void SetEngine(Engine engine);
+    void SetQuirks(QuirkProfile quirks);
+    void SetInstructionsPerFrame(uint32_t ipf) { instructionsPerFrame = ipf; }
+
+    // Back to the state right after loading, instance i seeded with seed + i
+    void Reset(uint64_t seed);
+    // Only one instance, seeded with seed, for environments that finished an episode
+    void Reset(uint32_t instance, uint64_t seed);
+
+    // Holds the keys of actions[i] (bit N for key N) on instance i and runs
+    // frames frames of every instance
+    void Step(const uint16_t *actions, uint32_t frames);
+
+    uint32_t Size() const { return instances.size(); }
+    uint32_t Threads() const { return pool.Threads(); }
+    // 32 rows of 64 pixels, leftmost pixel in the most significant bit. Points
+    // into the instance: no copy, updated in place by Step and Reset.
+    const uint64_t *Observation(uint32_t instance) const { return instances[instance]->display.Rows(); }
+    // The 4 KB of memory of the instance, in place as well
+    const uint8_t *RAM(uint32_t instance) const { return instances[instance]->RAM(); }
+    Chip8 &Instance(uint32_t instance) { return *instances[instance]; }
+
+private:
+    // Instances per range handed to a thread: enough work to amortize taking
+    // it, small enough to keep stealing useful
+    uint32_t grain() const;
+
+private:
+    std::vector<std::unique_ptr<Chip8>> instances;
+    // Power on state, then the one right after LoadROM
+    Snapshot initial;
+    uint32_t instructionsPerFrame;
+    ThreadPool pool;
+};
+
+#endif // _ENVIRONMENT_H_
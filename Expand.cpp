@@ -0,0 +1,84 @@
+#include "Expand.h"
+
+#ifdef CHIP8_EXPAND_X86
+#include <immintrin.h>
+#endif
+
+void ExpandScalar(const uint64_t *rows, uint32_t count, uint32_t *pixels)
+{
+    for (uint32_t y = 0; y < count; y++)
+    {
+        uint64_t row = rows[y];
+        for (int x = 63; x >= 0; x--)
+            *pixels++ = -static_cast<uint32_t>((row >> x) & 1);
+    }
+}
+
+#ifdef CHIP8_EXPAND_X86
+
+// Every byte of a row holds 8 pixels: it is broadcast to all lanes, each lane
+// keeps its own bit and the comparison turns it into a full pixel.
+__attribute__((target("sse2")))
+void ExpandSSE2(const uint64_t *rows, uint32_t count, uint32_t *pixels)
+{
+    const __m128i high = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+    const __m128i low  = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+    __m128i *out = reinterpret_cast<__m128i *>(pixels);
+
+    for (uint32_t y = 0; y < count; y++)
+    {
+        uint64_t row = rows[y];
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            __m128i bits = _mm_set1_epi32((row >> shift) & 0xFF);
+            _mm_storeu_si128(out++, _mm_cmpeq_epi32(_mm_and_si128(bits, high), high));
+            _mm_storeu_si128(out++, _mm_cmpeq_epi32(_mm_and_si128(bits, low), low));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void ExpandAVX2(const uint64_t *rows, uint32_t count, uint32_t *pixels)
+{
+    const __m256i mask = _mm256_set_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+    __m256i *out = reinterpret_cast<__m256i *>(pixels);
+
+    for (uint32_t y = 0; y < count; y++)
+    {
+        uint64_t row = rows[y];
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            __m256i bits = _mm256_set1_epi32((row >> shift) & 0xFF);
+            _mm256_storeu_si256(out++, _mm256_cmpeq_epi32(_mm256_and_si256(bits, mask), mask));
+        }
+    }
+}
+
+ExpandKernel SelectExpandKernel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return ExpandAVX2;
+    if (__builtin_cpu_supports("sse2")) return ExpandSSE2;
+    return ExpandScalar;
+}
+
+const char *ExpandKernelName(ExpandKernel kernel)
+{
+    if (kernel == ExpandAVX2) return "avx2";
+    if (kernel == ExpandSSE2) return "sse2";
+    return "scalar";
+}
+
+#else
+
+ExpandKernel SelectExpandKernel()
+{
+    return ExpandScalar;
+}
+
+const char *ExpandKernelName(ExpandKernel kernel)
+{
+    return "scalar";
+}
+
+#endif // CHIP8_EXPAND_X86
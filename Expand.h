@@ -0,0 +1,21 @@
+#ifndef _EXPAND_H_
+#define _EXPAND_H_
+
+#include <cstdint>
+
+// Expands packed 64 pixel rows (leftmost pixel in the most significant bit)
+// into 32 bit pixels: 0xFFFFFFFF for lit pixels and 0 otherwise.
+typedef void (*ExpandKernel)(const uint64_t *rows, uint32_t count, uint32_t *pixels);
+
+void ExpandScalar(const uint64_t *rows, uint32_t count, uint32_t *pixels);
+#if defined(__x86_64__) || defined(__i386__)
+#define CHIP8_EXPAND_X86 1
+void ExpandSSE2(const uint64_t *rows, uint32_t count, uint32_t *pixels);
+void ExpandAVX2(const uint64_t *rows, uint32_t count, uint32_t *pixels);
+#endif
+
+// Fastest kernel supported by the host CPU
+ExpandKernel SelectExpandKernel();
+const char *ExpandKernelName(ExpandKernel kernel);
+
+#endif // _EXPAND_H_
@@ -0,0 +1,353 @@
+#include "Extended.h"
+
+namespace
+{
+    // 8x10 digits for FX30, right after the 5 byte ones (Octo's, with A-F)
+    const uint16_t BIG_FONT_ADDRESS = 0x50;
+    const unsigned char big_fontset[] =
+    {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, //0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, //1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, //4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, //6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, //7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, //8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, //A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, //B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, //C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, //D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  //F
+    };
+
+    // Every bit of a 16 bit sprite row doubled, for low resolution
+    uint32_t widen(uint32_t bits)
+    {
+        bits = (bits | (bits << 8)) & 0x00FF00FF;
+        bits = (bits | (bits << 4)) & 0x0F0F0F0F;
+        bits = (bits | (bits << 2)) & 0x33333333;
+        bits = (bits | (bits << 1)) & 0x55555555;
+        return bits | (bits << 1);
+    }
+} // namespace
+
+template <class Mode>
+ExtendedChip8<Mode>::ExtendedChip8()
+            : drawF(true),
+              keyboard{0},
+              pc(0x200), opcode(0),
+              I(0), sp(0),
+              V{0}, stack{0},
+              delay_timer(0), sound_timer(0),
+              selected(1),
+              hires(false),
+              exited(false),
+              flags{0},
+              pattern{0},
+              pitch(64),
+              audio(NULL),
+              beeping(false),
+              cycle(0),
+              unknownOpcodes(0),
+              random(time(NULL))
+{
+    for (uint32_t i=0; i<sizeof(big_fontset); ++i) memory.Write(BIG_FONT_ADDRESS + i, big_fontset[i]);
+}
+
+template <class Mode>
+void ExtendedChip8<Mode>::UpdateTimers()
+{
+    if(delay_timer > 0) --delay_timer;
+    if(sound_timer > 0) --sound_timer;
+
+    // the audio sink only hears about transitions
+    bool on = sound_timer > 0;
+    if (!audio || on == beeping) return;
+    beeping = on;
+    if (on) audio->StartBeep();
+    else audio->StopBeep();
+}
+
+template <class Mode>
+bool ExtendedChip8<Mode>::TakeScreen(Screen &screen)
+{
+    if (!drawF) return false;
+    screen.Capture(planes, Mode::PLANES);
+    drawF = false;
+    return true;
+}
+
+template <class Mode>
+void ExtendedChip8<Mode>::Run(uint32_t cycles)
+{
+    while (cycles--) RunCicle();
+}
+
+template <class Mode>
+void ExtendedChip8<Mode>::skip(bool condition)
+{
+    if (!condition) return;
+    bool longLoad = Mode::XO && read(pc) == 0xF0 && read(pc + 1) == 0x00;
+    pc += longLoad ? 4 : 2;
+}
+
+template <class Mode>
+void ExtendedChip8<Mode>::clear()
+{
+    for (uint32_t p=0; p<Mode::PLANES; ++p)
+        if (selected & (1 << p)) planes[p].Clear();
+    drawF = true;
+}
+
+template <class Mode>
+void ExtendedChip8<Mode>::scroll(Direction direction, uint32_t n)
+{
+    uint32_t pixels = hires ? n : n * 2;
+    for (uint32_t p=0; p<Mode::PLANES; ++p)
+    {
+        if (!(selected & (1 << p))) continue;
+        switch (direction)
+        {
+            case DOWN: planes[p].ScrollDown(pixels); break;
+            case UP: planes[p].ScrollUp(pixels); break;
+            case RIGHT: planes[p].ScrollRight(pixels); break;
+            case LEFT: planes[p].ScrollLeft(pixels); break;
+        }
+    }
+    drawF = true;
+}
+
+// DXYN: N rows of 8 pixels, or 16 rows of 16 pixels when N is 0. With both
+// planes selected the data of the second plane follows the first one.
+template <class Mode>
+void ExtendedChip8<Mode>::draw(uint8_t x, uint8_t y, uint8_t n)
+{
+    const uint32_t scale = hires ? 1 : 2;
+    const uint32_t width = Plane::WIDTH / scale, height = Plane::HEIGHT / scale;
+    const uint32_t rows = n ? n : 16, bytes = n ? 1 : 2;
+    uint32_t left = V[x] % width, top = V[y] % height;
+
+    bool collision = false;
+    uint32_t address = I;
+    for (uint32_t p=0; p<Mode::PLANES; ++p)
+    {
+        if (!(selected & (1 << p))) continue;
+        for (uint32_t r=0; r<rows; ++r, address += bytes)
+        {
+            uint32_t row = top + r;
+            if (row >= height)
+            {
+                if (Mode::CLIP) continue;
+                row -= height;
+            }
+
+            uint32_t bits = bytes == 2 ? read(address) << 8 | read(address + 1) : read(address);
+            if (!bits) continue;
+            uint32_t size = 8 * bytes;
+            if (scale == 2)
+            {
+                bits = widen(bits);
+                size *= 2;
+            }
+            uint64_t aligned = static_cast<uint64_t>(bits) << (64 - size);
+            for (uint32_t line=0; line<scale; ++line)
+                collision |= planes[p].DrawBits(left * scale, row * scale + line, aligned, size, Mode::CLIP);
+        }
+    }
+    V[0xF] = collision;
+    drawF = true;
+}
+
+template <class Mode>
+void ExtendedChip8<Mode>::unknown()
+{
+    // halts where it is, like the original machine
+    pc -= 2;
+    ++unknownOpcodes;
+}
+
+template <class Mode>
+void ExtendedChip8<Mode>::RunCicle()
+{
+    ++cycle;
+    opcode = read(pc) << 8 | read(pc + 1);
+    pc += 2;
+
+    const uint8_t x = (opcode & 0x0F00) >> 8;
+    const uint8_t y = (opcode & 0x00F0) >> 4;
+    const uint8_t n = opcode & 0x000F;
+    const uint8_t kk = opcode & 0x00FF;
+    const uint16_t nnn = opcode & 0x0FFF;
+    typedef typename Mode::Quirks Q;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            if ((opcode & 0xFFF0) == 0x00C0 && n) { scroll(DOWN, n); break; }
+            if (Mode::XO && (opcode & 0xFFF0) == 0x00D0 && n) { scroll(UP, n); break; }
+            switch (opcode)
+            {
+                case 0x00E0: clear(); break;
+                case 0x00EE: pc = stack[--sp & 0xF]; break;
+                case 0x00FB: scroll(RIGHT, 4); break;
+                case 0x00FC: scroll(LEFT, 4); break;
+                case 0x00FD: exited = true; pc -= 2; break;
+                case 0x00FE:
+                case 0x00FF:
+                    hires = opcode == 0x00FF;
+                    for (auto &plane : planes) plane.Clear();
+                    drawF = true;
+                    break;
+                default: unknown(); break;
+            }
+            break;
+        case 0x1000: pc = nnn; break;
+        case 0x2000: stack[sp++ & 0xF] = pc; pc = nnn; break;
+        case 0x3000: skip(V[x] == kk); break;
+        case 0x4000: skip(V[x] != kk); break;
+        case 0x5000:
+            switch (n)
+            {
+                case 0x0: skip(V[x] == V[y]); break;
+                // XO-CHIP: save or load VX..VY (either order) at I, I unchanged
+                case 0x2:
+                case 0x3:
+                {
+                    if (!Mode::XO) { unknown(); break; }
+                    int step = x <= y ? 1 : -1;
+                    for (int i=0, r=x; ; ++i, r+=step)
+                    {
+                        if (n == 0x2) write(I + i, V[r]);
+                        else V[r] = read(I + i);
+                        if (r == y) break;
+                    }
+                    break;
+                }
+                default: unknown(); break;
+            }
+            break;
+        case 0x6000: V[x] = kk; break;
+        case 0x7000: V[x] += kk; break;
+        // Flag operations write VF last: VF as an operand sees its old value
+        case 0x8000:
+        {
+            uint8_t flag;
+            switch (n)
+            {
+                case 0x0: V[x] = V[y]; break;
+                case 0x1: V[x] |= V[y]; break;
+                case 0x2: V[x] &= V[y]; break;
+                case 0x3: V[x] ^= V[y]; break;
+                case 0x4: flag = V[x] + V[y] > 0xFF; V[x] += V[y]; V[0xF] = flag; break;
+                case 0x5: flag = V[x] >= V[y]; V[x] -= V[y]; V[0xF] = flag; break;
+                case 0x7: flag = V[y] >= V[x]; V[x] = V[y] - V[x]; V[0xF] = flag; break;
+                case 0x6:
+                {
+                    uint8_t value = V[Q::shiftVY ? y : x];
+                    V[x] = value >> 1;
+                    V[0xF] = value & 0x1;
+                    break;
+                }
+                case 0xE:
+                {
+                    uint8_t value = V[Q::shiftVY ? y : x];
+                    V[x] = value << 1;
+                    V[0xF] = value >> 7;
+                    break;
+                }
+                default: unknown(); break;
+            }
+            break;
+        }
+        case 0x9000:
+            if (n == 0) skip(V[x] != V[y]);
+            else unknown();
+            break;
+        case 0xA000: I = nnn; break;
+        case 0xB000: pc = nnn + V[Q::jumpVX ? x : 0]; break;
+        case 0xC000: V[x] = kk & random.NextByte(); break;
+        case 0xD000: draw(x, y, n); break;
+        case 0xE000:
+            switch (kk)
+            {
+                case 0x9E: skip(keyboard[V[x] & 0xF] != 0); break;
+                case 0xA1: skip(keyboard[V[x] & 0xF] == 0); break;
+                default: unknown(); break;
+            }
+            break;
+        case 0xF000:
+            if (Mode::XO && opcode == 0xF000)
+            {
+                // I = NNNN, from the next word
+                I = read(pc) << 8 | read(pc + 1);
+                pc += 2;
+                break;
+            }
+            if (Mode::XO && kk == 0x01) { selected = x & 0x3; break; }
+            if (Mode::XO && opcode == 0xF002)
+            {
+                for (auto i=0; i<16; ++i) pattern[i] = read(I + i);
+                if (audio) audio->SetPattern(pattern, pitch);
+                break;
+            }
+            switch (kk)
+            {
+                case 0x07: V[x] = delay_timer; break;
+                case 0x0A:
+                {
+                    bool pressed = false;
+                    for (auto i=0; i<16; ++i)
+                    {
+                        if (keyboard[i] != 0)
+                        {
+                            V[x] = i;
+                            pressed = true;
+                        }
+                    }
+                    if (!pressed) pc -= 2;
+                    break;
+                }
+                case 0x15: delay_timer = V[x]; break;
+                case 0x18: sound_timer = V[x]; break;
+                case 0x1E:
+                    if (Q::addiVF) V[0xF] = (I + V[x]) > 0xFFF;
+                    I += V[x];
+                    break;
+                case 0x29: I = (V[x] & 0xF) * 5; break;
+                case 0x30: I = BIG_FONT_ADDRESS + (V[x] & 0xF) * 10; break;
+                case 0x33:
+                    write(I, V[x] / 100);
+                    write(I + 1, (V[x] / 10) % 10);
+                    write(I + 2, V[x] % 10);
+                    break;
+                case 0x3A:
+                    if (!Mode::XO) { unknown(); break; }
+                    pitch = V[x];
+                    if (audio) audio->SetPattern(pattern, pitch);
+                    break;
+                case 0x55:
+                    for (auto i=0; i<=x; ++i) write(I + i, V[i]);
+                    if (Q::loadStoreI) I += x + 1;
+                    break;
+                case 0x65:
+                    for (auto i=0; i<=x; ++i) V[i] = read(I + i);
+                    if (Q::loadStoreI) I += x + 1;
+                    break;
+                case 0x75:
+                    for (auto i=0; i<=x && i<int(Mode::FLAGS); ++i) flags[i] = V[i];
+                    break;
+                case 0x85:
+                    for (auto i=0; i<=x && i<int(Mode::FLAGS); ++i) V[i] = flags[i];
+                    break;
+                default: unknown(); break;
+            }
+            break;
+    }
+}
+
+template class ExtendedChip8<SchipMode>;
+template class ExtendedChip8<XoChipMode>;
@@ -0,0 +1,131 @@
+#ifndef _EXTENDED_H_
+#define _EXTENDED_H_
+
+#include <cstdint>
+#include <time.h>
+#include "Display.h"
+#include "Machine.h"
+#include "Memory.h"
+#include "Quirks.h"
+#include "Random.h"
+
+// Modes of the extended interpreter, as compile time policies: the whole
+// interpreter is instantiated once per mode. The original 64x32 machine is
+// the Chip8 class and doesn't pay for any of this.
+//
+//   MEMORY_SIZE  addressable bytes, a power of two
+//   PLANES       bit planes of the screen, 2^PLANES colors
+//   FLAGS        RPL user flags saved and restored by FX75/FX85
+//   CLIP         sprites are cut at the right and bottom edges instead of wrapping
+//   XO           XO-CHIP instructions: F000 NNNN, 5XY2/5XY3, FN01, F002, FX3A, 00DN
+
+// SUPER-CHIP 1.1: 128x64 high resolution, scrolling, 16x16 sprites, big font
+struct SchipMode
+{
+    static const uint32_t MEMORY_SIZE = 4096;
+    static const uint32_t PLANES = 1;
+    static const uint32_t FLAGS = 8;
+    static const bool CLIP = true;
+    static const bool XO = false;
+    typedef SchipQuirks Quirks;
+};
+
+// XO-CHIP, as defined by Octo: SUPER-CHIP plus 64 KB of memory and two planes
+struct XoChipMode
+{
+    static const uint32_t MEMORY_SIZE = 65536;
+    static const uint32_t PLANES = 2;
+    static const uint32_t FLAGS = 16;
+    static const bool CLIP = false;
+    static const bool XO = true;
+    typedef VipQuirks Quirks;
+};
+
+// Interpreter of the extended instruction sets. The framebuffer is always
+// 128x64: in low resolution every pixel is drawn as a 2x2 block, so the
+// renderer never deals with two sizes. A single switch interpreter: these
+// programs are rare enough not to need the faster engines.
+template <class Mode>
+class ExtendedChip8 final : public Machine
+{
+public:
+    typedef Display<128, 64> Plane;
+
+    ExtendedChip8();
+    ~ExtendedChip8() = default;
+    ExtendedChip8 (const ExtendedChip8 &) = delete;
+    ExtendedChip8 & operator=(const ExtendedChip8 &) = delete;
+
+    using Machine::LoadROM;
+    bool LoadROM(const uint8_t *program, size_t size) override { return memory.LoadProgram(program, size); }
+    size_t MaxROMSize() const override { return Memory<Mode::MEMORY_SIZE>::PROGRAM_SIZE; }
+    void SetAudioSink(AudioSink *sink) override { audio = sink; beeping = false; }
+    void Seed(uint64_t seed) override { random.Seed(seed); }
+
+    void RunCicle();
+    void Run(uint32_t cycles);
+    void UpdateTimers();
+    void RunFrame(uint32_t instructions) override { Run(instructions); UpdateTimers(); }
+    uint64_t Cycle() const override { return cycle; }
+    void SetKeys(uint16_t pressed) override { for (auto i=0; i<16; ++i) keyboard[i] = (pressed >> i) & 1; }
+
+    bool TakeScreen(Screen &screen) override;
+    uint32_t ScreenWidth() const override { return Plane::WIDTH; }
+    uint32_t ScreenHeight() const override { return Plane::HEIGHT; }
+    const Plane &GetPlane(uint32_t plane) const { return planes[plane]; }
+    bool HighResolution() const { return hires; }
+    // The program ran 00FD and stays where it is
+    bool Exited() const { return exited; }
+
+    uint64_t UnknownOpcodes() const override { return unknownOpcodes; }
+
+public:
+    bool drawF;
+    uint8_t keyboard[16];
+
+private:
+    uint8_t read(uint32_t address) const { return memory[address & (Mode::MEMORY_SIZE - 1)]; }
+    void write(uint32_t address, uint8_t value) { memory.Write(address & (Mode::MEMORY_SIZE - 1), value); }
+    // Conditional skips jump over both words of F000 NNNN
+    void skip(bool condition);
+    void draw(uint8_t x, uint8_t y, uint8_t n);
+    enum Direction { DOWN, UP, RIGHT, LEFT };
+    // Amounts are in pixels of the current resolution
+    void scroll(Direction direction, uint32_t n);
+    void clear();
+    void unknown();
+
+private:
+    uint16_t pc;
+    uint16_t opcode;
+    // 16 bits: XO-CHIP addresses the whole 64 KB
+    uint16_t I;
+    uint8_t sp;
+    uint8_t V[16];
+    uint16_t stack[16];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+
+    Memory<Mode::MEMORY_SIZE> memory;
+    Plane planes[Mode::PLANES];
+    // Planes affected by drawing, clearing and scrolling (FN01)
+    uint8_t selected;
+    bool hires;
+    bool exited;
+    uint8_t flags[Mode::FLAGS];
+    // XO-CHIP audio, handed to the audio sink whenever it changes
+    uint8_t pattern[16];
+    uint8_t pitch;
+
+    AudioSink *audio;
+    // State the audio sink was last told about
+    bool beeping;
+    uint64_t cycle;
+    uint64_t unknownOpcodes;
+    Xorshift random;
+};
+
+typedef ExtendedChip8<SchipMode> SuperChip8;
+typedef ExtendedChip8<XoChipMode> XoChip8;
+
+#endif // _EXTENDED_H_
@@ -1,23 +1,58 @@
 #include <SDL2/SDL.h>
+#include <cstdlib>
+#include <cstring>
 
-#include "Chip8.h"
+#include "Beep.h"
+#include "Catalog.h"
+#include "EmulationThread.h"
 #include "Graphics.h"
+#include "Machine.h"
+#include "Startup.h"
 
-Graphics::Graphics(Chip8 &chip8) 
+namespace
+{
+    const char *window_title = "Yast Another Chip8 Emulator";
+    // Colors of the second plane and of both, the first one is white on black
+    const uint32_t plane2_color = 0xAAAAAAFF;
+    const uint32_t both_color = 0x555555FF;
+#ifdef CHIP8_STATS
+    // Written on F2
+    const char *stats_file = "chip8-stats.json";
+#endif
+}
+
+Graphics::Graphics(EmulationThread &emulation, uint32_t width, uint32_t height) 
             : window(NULL),
               renderer(NULL),
               texture(NULL), 
-              chip8(chip8)
+              emulation(emulation),
+              startup(NULL),
+              beep(NULL),
+              expand(SelectExpandKernel()),
+              width(width),
+              height(height),
+              pixels{0}
+#ifdef CHIP8_STATS
+              , lastCycle(0),
+              overlay(false),
+              overlayCycle(0),
+              overlayTicks(0)
+#endif
     {
-        Init();
+        shown.width = width;
+        shown.height = height;
+        SetKeymap(DEFAULT_KEYMAP);
     }
 
 void Graphics::Init()
 {
-    SDL_Init(SDL_INIT_EVERYTHING);
-    window = SDL_CreateWindow("Yast Another Chip8 Emulator",
+    // Audio is opened after the first frame, the other subsystems are never used
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
+    if (startup) startup->Mark("SDL video");
+
+    window = SDL_CreateWindow(window_title,
                                    SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                   display_width, display_height, SDL_WINDOW_SHOWN);
+                                   display_width, display_height, SDL_WINDOW_HIDDEN);
 
     if (window == NULL) 
     {
@@ -33,7 +68,7 @@ void Graphics::Init()
         exit(1);
     }
 
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
     if (texture == NULL) 
     {
         SDL_DestroyWindow(window);
@@ -41,6 +76,7 @@ void Graphics::Init()
         SDL_Quit();
         exit(1);
     }
+    if (startup) startup->Mark("window");
 }
 
 void Graphics::CleanUp()
@@ -51,75 +87,170 @@ void Graphics::CleanUp()
     SDL_Quit();
 }
 
+void Graphics::SetKeymap(const char *keymap)
+{
+    memset(keys, -1, sizeof(keys));
+    for (auto i=0; i<16; ++i) keys[static_cast<uint8_t>(keymap[i]) & 0x7F] = i;
+}
+
 void Graphics::Updatekey(SDL_KeyboardEvent *e, uint8_t val)
 {
-    switch (e->keysym.sym)
+    SDL_Keycode key = e->keysym.sym;
+    if (key >= 0 && key < 128 && keys[key] >= 0)
+    {
+        emulation.SetKey(keys[key], val);
+        return;
+    }
+
+    switch (key)
     {
-        case SDLK_1: chip8.keyboard[0x1] = val; break;
-        case SDLK_2: chip8.keyboard[0x2] = val; break;
-        case SDLK_3: chip8.keyboard[0x3] = val; break;
-        case SDLK_4: chip8.keyboard[0xC] = val; break;
-
-        case SDLK_q: chip8.keyboard[0x4] = val; break;
-        case SDLK_w: chip8.keyboard[0x5] = val; break;
-        case SDLK_e: chip8.keyboard[0x6] = val; break;
-        case SDLK_r: chip8.keyboard[0xD] = val; break;
-
-        case SDLK_a: chip8.keyboard[0x7] = val; break;
-        case SDLK_s: chip8.keyboard[0x8] = val; break;
-        case SDLK_d: chip8.keyboard[0x9] = val; break;
-        case SDLK_f: chip8.keyboard[0xE] = val; break;
-
-        case SDLK_z: chip8.keyboard[0xA] = val; break;
-        case SDLK_x: chip8.keyboard[0x0] = val; break;
-        case SDLK_c: chip8.keyboard[0xB] = val; break;
-        case SDLK_v: chip8.keyboard[0xF] = val; break;
+        // Fast forward while held
+        case SDLK_TAB: emulation.SetTurbo(val); break;
+        // Play backwards while held
+        case SDLK_BACKSPACE: emulation.SetRewinding(val); break;
+#ifdef CHIP8_STATS
+        case SDLK_F2: if (val) writeStats(); break;
+        case SDLK_F3: 
+            if (!val) break;
+            overlay = !overlay; 
+            if (!overlay) SDL_SetWindowTitle(window, window_title);
+            break;
+#endif
     }
 }
 
-void Graphics::expandScreen(unsigned char* from, uint32_t * to)
+// Whole words are expanded at once, so 128 pixel rows cost two 64 pixel ones
+void Graphics::expandScreen(const Screen &from, uint32_t first, uint32_t count)
 {
-    for (int i = 0; i < 2048; i++)
-        to[i] = (from[i]) ? -1 : 0;
+    uint32_t *out = pixels + first * from.width;
+    expand(from.Row(0, first), count * from.Words(), out);
+    if (from.planes < 2) return;
+
+    // 2 bit color from the masks of both planes
+    expand(from.Row(1, first), count * from.Words(), plane);
+    for (uint32_t i=0; i<count * from.width; ++i)
+        out[i] = (out[i] & ~plane[i]) | (~out[i] & plane[i] & plane2_color) | (out[i] & plane[i] & both_color);
 }
 
 // Draw into the emulator window
 void Graphics::renderTexture()
 {
+    CHIP8_STAT(ScopedTiming timing(stats.render));
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, NULL, NULL);
     SDL_RenderPresent(renderer);
 }
 
-void Graphics::updatePixelsWithCPUData()
+// Only rows changed by the CPU are converted and uploaded, one rect per run of dirty rows
+void Graphics::updatePixelsWithCPUData(const Screen &screen, uint64_t dirty)
 {
-    void *pixels = NULL;
-    int pitch = 0;
-    SDL_LockTexture(texture, NULL, &pixels, &pitch);
-    expandScreen(chip8.display, (uint32_t *) pixels);
-    SDL_UnlockTexture(texture);
+    CHIP8_STAT(ScopedTiming timing(stats.updatePixels));
+    uint32_t y = 0;
+    while (y < screen.height)
+    {
+        if (!((dirty >> y) & 1)) { ++y; continue; }
+
+        uint32_t first = y;
+        while (y < screen.height && ((dirty >> y) & 1)) ++y;
+
+        expandScreen(screen, first, y - first);
+        SDL_Rect rect = { 0, (int) first, (int) screen.width, (int) (y - first) };
+        SDL_UpdateTexture(texture, &rect, pixels + first * screen.width, screen.width * sizeof(uint32_t));
+    }
 }
 
+// Presents the latest frame published by the emulation thread, if any.
+// Frames may have been skipped since the last one shown, rows are diffed
+// against what is on screen.
 void Graphics::display()
 {
-    chip8.RunCicle();
+#ifdef CHIP8_STATS
+    if (overlay) updateOverlay();
+#endif
+
+    if (beep && beep->Started())
+    {
+        beep->Open();
+        beep = NULL;
+    }
 
-    int timerFps = SDL_GetTicks();
-    if (chip8.drawF)
+    if (!emulation.ConsumeFrame())
     {
-        updatePixelsWithCPUData();
-        timerFps = SDL_GetTicks() - timerFps;
-        if (timerFps < 1000 / FRAMES_PER_SECOND)
-            SDL_Delay((1000 / FRAMES_PER_SECOND) - timerFps);
+        CHIP8_STAT(ScopedTiming timing(stats.delay));
+        SDL_Delay(1);
+        return;
+    }
+
+    const Screen &frame = emulation.LatestFrame().screen;
+#ifdef CHIP8_STATS
+    stats.Presented(emulation.LatestFrame().cycle - lastCycle);
+    lastCycle = emulation.LatestFrame().cycle;
+#endif
+    uint64_t dirty = frame.Diff(shown);
+    if (dirty)
+    {
+        updatePixelsWithCPUData(frame, dirty);
         renderTexture();
-        chip8.drawF = false;
+        shown = frame;
+    }
+
+    // A blank first frame is already on screen
+    if (startup)
+    {
+        startup->Mark("first frame");
+        startup->Print();
+        startup = NULL;
     }
 }
 
+#ifdef CHIP8_STATS
+// The emulation thread is paused while its counters are read
+void Graphics::writeStats()
+{
+    FILE *file = fopen(stats_file, "w");
+    if (!file) return;
+
+    emulation.Stop();
+    const Machine &cpu = emulation.Cpu();
+    WriteStatsJSON(file, cpu.Counters(), cpu.UnknownOpcodes(), &stats);
+    emulation.Start();
+    fclose(file);
+}
+
+void Graphics::updateOverlay()
+{
+    uint32_t now = SDL_GetTicks();
+    if (now - overlayTicks < 1000) return;
+
+    double seconds = (now - overlayTicks) / 1000.0;
+    uint64_t frames = stats.frames - overlayBase.frames;
+    uint64_t updates = stats.updatePixels.calls - overlayBase.updatePixels.calls;
+    uint64_t renders = stats.render.calls - overlayBase.render.calls;
+
+    char title[160];
+    snprintf(title, sizeof(title), "%s - %.2f MIPS, %.0f fps, update %.1f us, render %.1f us", window_title,
+             (lastCycle - overlayCycle) / seconds / 1e6, frames / seconds,
+             updates ? (stats.updatePixels.ns - overlayBase.updatePixels.ns) / 1000.0 / updates : 0.0,
+             renders ? (stats.render.ns - overlayBase.render.ns) / 1000.0 / renders : 0.0);
+    SDL_SetWindowTitle(window, title);
+
+    overlayBase = stats;
+    overlayCycle = lastCycle;
+    overlayTicks = now;
+}
+#endif
+
 void Graphics::mainLoop()
 {
     bool running = true;
 
+    // Blank texture before the first frame arrives
+    updatePixelsWithCPUData(shown, ~0ull >> (64 - height));
+    renderTexture();
+    SDL_ShowWindow(window);
+    if (startup) startup->Mark("show window");
+    emulation.Start();
+
     while(running)
     {
         SDL_Event e;
@@ -140,5 +271,6 @@ void Graphics::mainLoop()
         }
         display();
     }
+    emulation.Stop();
     CleanUp();
 }
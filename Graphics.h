@@ -1,23 +1,46 @@
 #ifndef _GRAPHICS_H_
 #define _GRAPHICS_H_
 
-class Chip8;
+#include "Expand.h"
+#include "Screen.h"
+#include "Stats.h"
+
+class Beep;
+class EmulationThread;
+class StartupTimer;
 
 class Graphics
 {
 public:
-    explicit Graphics(Chip8 &chip8);
+    // width x height: screen resolution of the emulated machine. SDL is
+    // left alone until Init.
+    Graphics(EmulationThread &emulation, uint32_t width, uint32_t height);
     ~Graphics() = default;
 
-private:
+    // Video and events only, the window stays hidden until mainLoop has
+    // something to show in it
     void Init();
+    // Phases of the start up are marked on it, then it's printed once the
+    // first frame is on screen (NULL: no report)
+    void SetStartupTimer(StartupTimer *timer) { startup = timer; }
+    // Its device is opened the first time the program starts a beep, programs
+    // that never beep don't open one (NULL: no audio)
+    void SetBeep(Beep *sound) { beep = sound; }
+    // Host key of every Chip8 key, as in a catalog entry (see Catalog.h)
+    void SetKeymap(const char *keymap);
+
+private:
     void CleanUp();
     void Updatekey(SDL_KeyboardEvent *e, uint8_t val);
-    void expandScreen(unsigned char *from, uint32_t *to);
+    void expandScreen(const Screen &from, uint32_t first, uint32_t count);
     // Draw into the emulator window
     void renderTexture();
-    void updatePixelsWithCPUData();
+    void updatePixelsWithCPUData(const Screen &screen, uint64_t dirty);
     void display();
+#ifdef CHIP8_STATS
+    void writeStats();
+    void updateOverlay();
+#endif
 
 public:
     void mainLoop();
@@ -26,16 +49,40 @@ private:
     SDL_Window *window;
     SDL_Renderer *renderer;
     SDL_Texture *texture;
-    Chip8 & chip8;
+    EmulationThread & emulation;
+    StartupTimer *startup;
+    // Until its device is opened
+    Beep *beep;
+    // Chip8 key of the host keys with an ASCII keycode, -1 for none
+    int8_t keys[128];
+    // SIMD when the CPU supports it
+    ExpandKernel expand;
 
 private:
-    // Display resolution is 64×32 pixels, and color is monochrome.
-    static const uint32_t SCREEN_WIDTH = 64;
-    static const uint32_t SCREEN_HEIGHT = 32;
+    // The texture has the resolution of the machine (64x32, or 128x64 for the
+    // extended modes) and the GPU scales it to the window.
     static const uint32_t SCALE_FACTOR = 10;
-    static constexpr uint32_t display_width = SCREEN_WIDTH * SCALE_FACTOR;
-    static constexpr uint32_t display_height = SCREEN_HEIGHT * SCALE_FACTOR;
-    static const uint32_t FRAMES_PER_SECOND = 60;
+    static constexpr uint32_t display_width = 64 * SCALE_FACTOR;
+    static constexpr uint32_t display_height = 32 * SCALE_FACTOR;
+
+    uint32_t width;
+    uint32_t height;
+    // Expanded copy of the screen, source of the texture uploads
+    uint32_t pixels[Screen::MAX_WIDTH * Screen::MAX_HEIGHT];
+    // Rows of the second plane being expanded, combined into pixels
+    uint32_t plane[Screen::MAX_WIDTH * Screen::MAX_HEIGHT];
+    // Last frame uploaded to the texture, frames skipped in between are diffed against it
+    Screen shown;
+
+#ifdef CHIP8_STATS
+    FrameStats stats;
+    uint64_t lastCycle;
+    // Stats in the title bar, refreshed every second
+    bool overlay;
+    FrameStats overlayBase;
+    uint64_t overlayCycle;
+    uint32_t overlayTicks;
+#endif
 };
 
 #endif //_GRAPHICS_H_
@@ -0,0 +1,301 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "Analysis.h"
+#include "Catalog.h"
+#include "Chip8.h"
+#include "InputLog.h"
+#include "Machine.h"
+#include "Pack.h"
+#include "Profiler.h"
+#include "Rom.h"
+#include "Scheduler.h"
+#include "Trace.h"
+
+// Runs a ROM without SDL: no window, no audio device. Useful for batch jobs
+// and servers without display, frames are executed as fast as possible.
+// With --replay, a session recorded by the SDL frontend (--record) is played
+// again and its final state checked against the recording. --mode runs
+// SUPER-CHIP and XO-CHIP programs, engines, quirks, replays and profiles are
+// features of the original machine only.
+// ROMs found in the catalog (catalog.txt next to them, or --catalog) run
+// with the quirks and instructions per frame it gives, unless the command
+// line sets them. Others get the line to add to the catalog printed.
+// With --pack, the ROM is taken from a pack built by chip8-pack.
+// --trace records every instruction in a binary trace, see chip8-trace.
+
+namespace
+{
+    // Prime, so samples don't lock onto loops of a fixed length
+    const uint32_t DEFAULT_PROFILE_INTERVAL = 101;
+
+    double elapsedUs(std::chrono::steady_clock::time_point from, 
+                     std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration<double, std::micro>(to - from).count();
+    }
+
+    bool writeProfile(const GuestProfiler &profiler, const char *filename)
+    {
+        if (!profiler.Write(filename))
+        {
+            printf("Can't write %s\n", filename);
+            return false;
+        }
+        printf("Profile: %lu samples in %s\n", (unsigned long) profiler.Samples(), filename);
+        return true;
+    }
+
+    bool closeTrace(Chip8 &processor, Tracer &tracer, const char *filename)
+    {
+        processor.SetTracer(NULL);
+        if (!tracer.Close())
+        {
+            printf("Can't write the trace %s\n", filename);
+            return false;
+        }
+        printf("Trace: %lu records in %s, %lu waits for the writer\n", (unsigned long) tracer.Records(), filename,
+               (unsigned long) tracer.Stalls());
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    MachineMode mode = MachineMode::Chip8;
+    Engine engine = Engine::CHIP8_DEFAULT_ENGINE;
+    bool chip8Only = false;
+    uint32_t instructionsPerFrame = Scheduler::DEFAULT_INSTRUCTIONS_PER_FRAME;
+    uint64_t seed = time(NULL);
+    bool ipfSet = false;
+    bool autoQuirks = true;
+    bool quirksSet = false;
+    QuirkProfile quirks = QuirkProfile::Legacy;
+    const char *catalogFile = NULL;
+    const char *packFile = NULL;
+    const char *replay = NULL;
+    const char *stats = NULL;
+    const char *profile = NULL;
+    const char *trace = NULL;
+    uint32_t profileEvery = DEFAULT_PROFILE_INTERVAL;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        if (strcmp(argv[arg], "--mode") == 0)
+        {
+            if (!MachineModeFromName(argv[arg + 1], mode))
+            {
+                printf("Unknown mode: %s\n", argv[arg + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--engine") == 0)
+        {
+            if (!EngineFromName(argv[arg + 1], engine))
+            {
+                printf("Unknown engine: %s\n", argv[arg + 1]);
+                return 1;
+            }
+            chip8Only = true;
+        }
+        else if (strcmp(argv[arg], "--quirks") == 0)
+        {
+            autoQuirks = strcmp(argv[arg + 1], "auto") == 0;
+            if (!autoQuirks && !QuirkProfileFromName(argv[arg + 1], quirks))
+            {
+                printf("Unknown quirk profile: %s\n", argv[arg + 1]);
+                return 1;
+            }
+            quirksSet = true;
+            chip8Only = true;
+        }
+        else if (strcmp(argv[arg], "--ipf") == 0) { instructionsPerFrame = strtoul(argv[arg + 1], NULL, 0); ipfSet = true; }
+        else if (strcmp(argv[arg], "--catalog") == 0) catalogFile = argv[arg + 1];
+        else if (strcmp(argv[arg], "--pack") == 0) packFile = argv[arg + 1];
+        else if (strcmp(argv[arg], "--seed") == 0) seed = strtoull(argv[arg + 1], NULL, 0);
+        else if (strcmp(argv[arg], "--replay") == 0) { replay = argv[arg + 1]; chip8Only = true; }
+        else if (strcmp(argv[arg], "--stats") == 0) stats = argv[arg + 1];
+        else if (strcmp(argv[arg], "--profile") == 0) { profile = argv[arg + 1]; chip8Only = true; }
+        else if (strcmp(argv[arg], "--trace") == 0) { trace = argv[arg + 1]; chip8Only = true; }
+        else if (strcmp(argv[arg], "--profile-every") == 0) profileEvery = strtoul(argv[arg + 1], NULL, 0);
+        else break;
+    }
+
+    if(argc - arg < 1 || instructionsPerFrame == 0)
+    {
+        printf("Usage: %s [--mode chip8|schip|xochip] [--engine switch|table|cached|jit] [--quirks auto|legacy|vip|schip] [--ipf instructions per frame] [--catalog ROM catalog] [--pack ROM pack] [--seed N] [--replay input log] [--stats JSON file] [--profile folded stacks file] [--profile-every instructions, 0 = every frame] [--trace trace file] <ROM file, or name or hash in the pack> [cycles]\n\n", argv[0]);
+        return 1;
+    }
+
+    const char *rom = argv[arg];
+    uint32_t cycles = (argc - arg > 1) ? strtoul(argv[arg + 1], NULL, 0) : 1000000;
+
+    if (chip8Only && mode != MachineMode::Chip8)
+    {
+        printf("--engine, --quirks, --replay, --profile and --trace need --mode chip8\n");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<Machine> machine = CreateMachine(mode);
+    Chip8 *processor = (mode == MachineMode::Chip8) ? static_cast<Chip8 *>(machine.get()) : NULL;
+    if (processor) processor->SetEngine(engine);
+    machine->Seed(seed);
+
+    // In a pack, the ROM is named by its file name or hash
+    std::unique_ptr<RomPack> pack;
+    std::unique_ptr<RomImage> image;
+    const uint8_t *program;
+    size_t size;
+    uint64_t hash;
+    if (packFile)
+    {
+        pack.reset(new RomPack(packFile));
+        if (!pack->Valid())
+        {
+            printf("%s isn't a valid ROM pack\n", packFile);
+            return 1;
+        }
+        int32_t index = pack->Find(rom);
+        if (index < 0)
+        {
+            printf("%s isn't in %s\n", rom, packFile);
+            return 1;
+        }
+        rom = pack->Name(index);
+        program = pack->Data(index);
+        size = pack->Entry(index).size;
+        hash = pack->Entry(index).hash;
+    }
+    else
+    {
+        image.reset(new RomImage(rom, machine->MaxROMSize()));
+        if (!image->Valid())
+        {
+            printf("%s %s\n", rom, image->Error());
+            return 1;
+        }
+        program = image->Data();
+        size = image->Size();
+        hash = image->Hash();
+    }
+    RomCatalog catalog;
+    if (!catalog.LoadFor(packFile ? packFile : rom, catalogFile))
+    {
+        printf("Can't read the catalog %s\n", catalogFile);
+        return 1;
+    }
+    if (catalog.BadLine()) printf("%s:%u: bad catalog entry, skipped\n", catalog.Path().c_str(), catalog.BadLine());
+    const RomProfile *tuned = catalog.Find(hash);
+    if (tuned)
+    {
+        if (!quirksSet)
+        {
+            autoQuirks = false;
+            quirks = tuned->quirks;
+        }
+        if (!ipfSet) instructionsPerFrame = tuned->instructionsPerFrame;
+    }
+
+    // A replay runs with the profile it was recorded with
+    InputLog log;
+    if (replay)
+    {
+        if (!log.Load(replay))
+        {
+            printf("Can't read the input log %s\n", replay);
+            return 1;
+        }
+        autoQuirks = false;
+        quirks = log.Quirks();
+    }
+
+    if (!machine->LoadROM(program, size))
+    {
+        printf("%s doesn't fit in memory\n", rom);
+        return 1;
+    }
+    if (processor)
+    {
+        processor->SetQuirks(autoQuirks ? processor->DetectQuirks() : quirks);
+        if (processor->UsesBlocks()) processor->Prebuild(RomAnalysis(program, size));
+    }
+
+    if (tuned) printf("Catalog: %s\n", tuned->name.empty() ? rom : tuned->name.c_str());
+    else
+    {
+        const char *slash = strrchr(rom, '/');
+        RomProfile entry{ processor ? processor->GetQuirks() : quirks, instructionsPerFrame, "", slash ? slash + 1 : rom };
+        strcpy(entry.keymap, DEFAULT_KEYMAP);
+        printf("Not in the catalog: %s\n", RomCatalog::Format(hash, entry).c_str());
+    }
+
+    GuestProfiler profiler(profileEvery);
+    Tracer tracer;
+    if (trace)
+    {
+        if (!tracer.Open(trace, hash, processor->GetQuirks(), processor->Cycle()))
+        {
+            printf("Can't write the trace %s\n", trace);
+            return 1;
+        }
+        processor->SetTracer(&tracer);
+    }
+
+    if (replay)
+    {
+        auto loaded = std::chrono::steady_clock::now();
+        bool same = log.Replay(*processor, profile ? &profiler : NULL);
+        double runUs = elapsedUs(loaded, std::chrono::steady_clock::now());
+
+        printf("Replayed %lu cycles, %zu key events with %s engine in %.3f ms: %.2f MIPS\n", 
+               (unsigned long) log.Cycles(), log.Events().size(), EngineName(engine), runUs / 1000.0,
+               runUs > 0 ? log.Cycles() / runUs : 0.0);
+        printf("Final state %s the recording\n", same ? "matches" : "DIFFERS from");
+        if (profile && !writeProfile(profiler, profile)) return 1;
+        if (trace && !closeTrace(*processor, tracer, trace)) return 1;
+        return same ? 0 : 2;
+    }
+
+    Scheduler scheduler(*machine, instructionsPerFrame);
+    scheduler.SetTurbo(true);
+    if (profile) processor->SetProfiler(&profiler);
+
+    auto loaded = std::chrono::steady_clock::now();
+
+    uint32_t frames = (cycles + instructionsPerFrame - 1) / instructionsPerFrame;
+    for (uint32_t i=0; i<frames; ++i) scheduler.RunFrame();
+
+    auto end = std::chrono::steady_clock::now();
+    double runUs = elapsedUs(loaded, end);
+    uint64_t executed = uint64_t(frames) * instructionsPerFrame;
+
+    printf("Startup: %.1f us\n", elapsedUs(start, loaded));
+    printf("Executed %lu cycles (%u frames) of %s with %s engine in %.3f ms: %.2f MIPS, %.0f frames/s\n", 
+           (unsigned long) executed, frames, MachineModeName(mode), EngineName(processor ? engine : Engine::Switch), runUs / 1000.0, 
+           runUs > 0 ? executed / runUs : 0.0, runUs > 0 ? frames * 1e6 / runUs : 0.0);
+
+    if (profile && !writeProfile(profiler, profile)) return 1;
+    if (trace && !closeTrace(*processor, tracer, trace)) return 1;
+
+    // Per operation and per address counts need a CHIP8_STATS build
+    if (stats)
+    {
+        FILE *file = fopen(stats, "w");
+        if (!file)
+        {
+            printf("Can't write %s\n", stats);
+            return 1;
+        }
+#ifdef CHIP8_STATS
+        WriteStatsJSON(file, machine->Counters(), machine->UnknownOpcodes(), NULL);
+#else
+        WriteStatsJSON(file, NULL, machine->UnknownOpcodes(), NULL);
+#endif
+        fclose(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <cstring>
+
+#include "Chip8.h"
+#include "InputLog.h"
+#include "Scheduler.h"
+
+namespace
+{
+    const char input_magic[4] = { 'C', '8', 'I', 'N' };
+
+    // Longest LEB128 encoding of a 64 bit value
+    const size_t MAX_VARINT = 10;
+
+    size_t putVarint(uint8_t *out, uint64_t value)
+    {
+        size_t n = 0;
+        do
+        {
+            uint8_t byte = value & 0x7F;
+            value >>= 7;
+            out[n++] = byte | (value ? 0x80 : 0);
+        } while (value);
+        return n;
+    }
+
+    bool getVarint(FILE *file, uint64_t &value)
+    {
+        value = 0;
+        for (size_t shift=0; shift < 7 * MAX_VARINT; shift += 7)
+        {
+            int byte = fgetc(file);
+            if (byte == EOF) return false;
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    void put(uint8_t *&out, uint64_t value, size_t bytes)
+    {
+        for (size_t i=0; i<bytes; ++i) *out++ = value >> (8 * i);
+    }
+
+    uint64_t get(const uint8_t *&in, size_t bytes)
+    {
+        uint64_t value = 0;
+        for (size_t i=0; i<bytes; ++i) value |= uint64_t(*in++) << (8 * i);
+        return value;
+    }
+
+    const size_t HEADER_SIZE = 4 + 2 + 2 + 4 + 8 + 8 + 8 + 4;
+}
+
+InputLog::InputLog() 
+            : seed(0),
+              instructionsPerFrame(Scheduler::DEFAULT_INSTRUCTIONS_PER_FRAME),
+              quirks(QuirkProfile::Legacy),
+              cycles(0),
+              hash(0),
+              keys(0)
+{
+}
+
+void InputLog::Start(uint64_t s, uint32_t ipf, QuirkProfile profile)
+{
+    seed = s;
+    instructionsPerFrame = ipf;
+    quirks = profile;
+    cycles = hash = 0;
+    keys = 0;
+    events.clear();
+    events.reserve(4096);
+}
+
+void InputLog::Record(uint64_t cycle, uint16_t pressed)
+{
+    uint16_t changed = pressed ^ keys;
+    for (uint8_t key=0; changed; ++key, changed >>= 1)
+    {
+        if (changed & 1) events.push_back({ cycle, key, uint8_t((pressed >> key) & 1) });
+    }
+    keys = pressed;
+}
+
+void InputLog::Truncate(uint64_t cycle)
+{
+    while (!events.empty() && events.back().cycle >= cycle) events.pop_back();
+
+    keys = 0;
+    for (const auto &e : events)
+    {
+        if (e.pressed) keys |= 1 << e.key;
+        else keys &= ~(1 << e.key);
+    }
+}
+
+bool InputLog::Save(const char *filename) const
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file) return false;
+
+    uint8_t header[HEADER_SIZE];
+    uint8_t *out = header;
+    memcpy(out, input_magic, sizeof(input_magic));
+    out += sizeof(input_magic);
+    put(out, VERSION, 2);
+    put(out, static_cast<uint16_t>(quirks), 2);
+    put(out, instructionsPerFrame, 4);
+    put(out, seed, 8);
+    put(out, cycles, 8);
+    put(out, hash, 8);
+    put(out, events.size(), 4);
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+    uint64_t last = 0;
+    for (const auto &e : events)
+    {
+        uint8_t record[MAX_VARINT + 1];
+        size_t n = putVarint(record, e.cycle - last);
+        record[n++] = e.key << 1 | e.pressed;
+        ok = ok && fwrite(record, n, 1, file) == 1;
+        last = e.cycle;
+    }
+
+    return (fclose(file) == 0) && ok;
+}
+
+bool InputLog::Load(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file) return false;
+
+    uint8_t header[HEADER_SIZE];
+    const uint8_t *in = header + sizeof(input_magic);
+    if (fread(header, sizeof(header), 1, file) != 1 || 
+        memcmp(header, input_magic, sizeof(input_magic)) != 0 ||
+        get(in, 2) != VERSION)
+    {
+        fclose(file);
+        return false;
+    }
+
+    uint32_t profile = get(in, 2);
+    uint32_t ipf = get(in, 4);
+    Start(0, ipf, static_cast<QuirkProfile>(profile));
+    seed = get(in, 8);
+    cycles = get(in, 8);
+    hash = get(in, 8);
+    uint32_t count = get(in, 4);
+
+    uint64_t cycle = 0;
+    bool ok = instructionsPerFrame != 0 && profile < QUIRK_PROFILE_COUNT;
+    for (uint32_t i=0; i<count && ok; ++i)
+    {
+        uint64_t delta;
+        int record = 0;
+        ok = getVarint(file, delta) && (record = fgetc(file)) != EOF && (record >> 1) < 16;
+        cycle += delta;
+        if (ok) events.push_back({ cycle, uint8_t(record >> 1), uint8_t(record & 1) });
+    }
+    fclose(file);
+    return ok;
+}
+
+bool InputLog::Replay(Chip8 &cpu, GuestProfiler *profiler) const
+{
+    Scheduler scheduler(cpu, instructionsPerFrame);
+    scheduler.SetTurbo(true);
+    cpu.SetQuirks(quirks);
+    cpu.SetProfiler(profiler);
+    cpu.Seed(seed);
+
+    size_t next = 0;
+    while (cpu.Cycle() < cycles)
+    {
+        for (; next < events.size() && events[next].cycle <= cpu.Cycle(); ++next)
+            cpu.keyboard[events[next].key] = events[next].pressed;
+        scheduler.RunFrame();
+    }
+    cpu.SetProfiler(NULL);
+
+    Snapshot snapshot;
+    cpu.Save(snapshot);
+    return cpu.Cycle() == cycles && SnapshotHash(snapshot) == hash;
+}
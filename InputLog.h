@@ -0,0 +1,70 @@
+#ifndef _INPUT_LOG_H_
+#define _INPUT_LOG_H_
+
+#include <cstdint>
+#include <vector>
+#include "Quirks.h"
+
+class Chip8;
+class GuestProfiler;
+
+// Key change, applied before the instruction number cycle
+struct InputEvent
+{
+    uint64_t cycle;
+    uint8_t key;
+    uint8_t pressed;
+};
+
+// Everything needed, besides the ROM, to play a run again bit for bit:
+// the random seed, the instructions per frame, the quirk profile and every
+// key change.
+//
+// File format (little endian):
+//   header  "C8IN", uint16 version, uint16 quirk profile, uint32 instructions per frame,
+//           uint64 seed, uint64 cycles, uint64 final state hash, uint32 events
+//   events  LEB128 cycles since the previous event, then key << 1 | pressed
+class InputLog
+{
+public:
+    static const uint16_t VERSION = 2;
+
+    InputLog();
+    ~InputLog() = default;
+
+    // Starts a new recording
+    void Start(uint64_t seed, uint32_t instructionsPerFrame, QuirkProfile quirks);
+    // Logs the keys that changed since the previous call
+    void Record(uint64_t cycle, uint16_t pressed);
+    // Forgets the events from cycle on (the machine went back in time)
+    void Truncate(uint64_t cycle);
+    // End of the run and hash of the final state, checked on replay
+    void Finish(uint64_t cycle, uint64_t stateHash) { cycles = cycle; hash = stateHash; }
+
+    bool Save(const char *filename) const;
+    bool Load(const char *filename);
+
+    uint64_t Seed() const { return seed; }
+    uint32_t InstructionsPerFrame() const { return instructionsPerFrame; }
+    QuirkProfile Quirks() const { return quirks; }
+    uint64_t Cycles() const { return cycles; }
+    uint64_t StateHash() const { return hash; }
+    const std::vector<InputEvent> &Events() const { return events; }
+
+    // Runs the recorded session on cpu (ROM already loaded) as fast as possible,
+    // with the recorded quirk profile.
+    // Returns true when it ends in the recorded state.
+    bool Replay(Chip8 &cpu, GuestProfiler *profiler = NULL) const;
+
+private:
+    uint64_t seed;
+    uint32_t instructionsPerFrame;
+    QuirkProfile quirks;
+    uint64_t cycles;
+    uint64_t hash;
+    // key state after the last event
+    uint16_t keys;
+    std::vector<InputEvent> events;
+};
+
+#endif // _INPUT_LOG_H_
@@ -0,0 +1,620 @@
+#include "Chip8Ops.h"
+#include "Jit.h"
+
+#ifdef CHIP8_JIT_SUPPORTED
+
+#include <cstddef>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    static_assert(sizeof(Instruction) == sizeof(uint64_t), "Instruction is passed in a register");
+
+    // Host registers
+    enum { EAX = 0, ECX = 1, EDX = 2, R13 = 5, R8 = 8 };
+    // Condition codes of jcc/cmovcc
+    enum { CC_E = 0x4, CC_NE = 0x5 };
+
+    // Blocks are interpreted the first times they run, so code that hardly
+    // runs (start up, blocks starting where a frame stopped...) isn't compiled
+    const uint16_t COMPILE_AFTER = 8;
+
+    // Instructions that leave the block, always its last one (see BlockCache)
+    bool isTerminator(uint8_t op)
+    {
+        switch(op)
+        {
+            case OP_Unknown: case OP_Ret: case OP_Jmp: case OP_Call:
+            case OP_Jumpv0: case OP_Waitkey: case OP_Bcd: case OP_Push:
+                return true;
+        }
+        return false;
+    }
+
+    // Counts the V registers an instruction compiled inline works on
+    void countUses(const Instruction &ins, uint32_t *uses)
+    {
+        switch(ins.op)
+        {
+            case OP_Addr: case OP_Sub: case OP_Subb: case OP_Shr: case OP_Shl:
+                ++uses[0xF];
+                // fall through
+            case OP_Setr: case OP_Or: case OP_And: case OP_Xor: case OP_Jeqr: case OP_Jneqr:
+                ++uses[ins.y];
+                // fall through
+            case OP_Set: case OP_Add: case OP_Jeq: case OP_Jneq: case OP_Jkey: case OP_Jnkey:
+            case OP_Getdelay: case OP_Setdelay: case OP_Setsound: case OP_Addi: case OP_Spritei:
+                ++uses[ins.x];
+                break;
+        }
+    }
+} // namespace
+
+Jit::Jit(Chip8 &cpu) : cpu(cpu), code(NULL), used(0), writable(false), openFrom(0), openTo(0), exit(NO_EXIT), bodyOffset(0)
+{
+    const char *base = reinterpret_cast<const char *>(cpu.V);
+    dispV = 0;
+    dispI = reinterpret_cast<const char *>(&cpu.I) - base;
+    dispPC = reinterpret_cast<const char *>(&cpu.pc) - base;
+    dispSP = reinterpret_cast<const char *>(&cpu.sp) - base;
+    dispStack = reinterpret_cast<const char *>(cpu.stack) - base;
+    dispOpcode = reinterpret_cast<const char *>(&cpu.opcode) - base;
+    dispMemory = reinterpret_cast<const char *>(cpu.memory.Data()) - base;
+    dispKeyboard = reinterpret_cast<const char *>(cpu.keyboard) - base;
+    dispDelay = reinterpret_cast<const char *>(&cpu.delay_timer) - base;
+    dispSound = reinterpret_cast<const char *>(&cpu.sound_timer) - base;
+    // Native code jumps through them: they must never move
+    slots.reserve(MAX_SLOTS);
+
+    // Never writable and executable at the same time
+    page = sysconf(_SC_PAGESIZE);
+    void *mapping = mmap(NULL, CODE_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    code = (mapping == MAP_FAILED) ? NULL : static_cast<uint8_t *>(mapping);
+}
+
+Jit::~Jit()
+{
+    if (code) munmap(code, CODE_SIZE);
+}
+
+void Jit::interpret(Chip8 *cpu, uint64_t packed, uint32_t opcode, Dispatch::Handler handler)
+{
+    Instruction ins;
+    memcpy(&ins, &packed, sizeof(ins));
+    cpu->opcode = opcode;
+    handler(*cpu, ins);
+}
+
+bool Jit::protect(bool write, uint32_t to)
+{
+    if (write)
+    {
+        // Whole pages, from the one the next block starts in
+        to = (to + page - 1) & ~(page - 1);
+        if (to > CODE_SIZE) to = CODE_SIZE;
+        if (!writable) openFrom = openTo = used & ~(page - 1);
+        if (to <= openTo) return true;
+    }
+
+    const uint32_t from = write ? openTo : openFrom;
+    const uint32_t end = write ? to : openTo;
+    if (mprotect(code + from, end - from, write ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(code, CODE_SIZE);
+        code = NULL;
+        writable = false;
+        return false;
+    }
+    if (write) openTo = to;
+    writable = write;
+    return true;
+}
+
+void Jit::Chain(uint32_t from, NativeBlock to)
+{
+    slots[from].target = reinterpret_cast<const uint8_t *>(to) + bodyOffset;
+}
+
+void Jit::Unchain()
+{
+    for (auto &slot : slots) slot.target = slot.unchained;
+}
+
+Jit::NativeBlock Jit::Compile(const Block &block, const MicroOp *ops)
+{
+    if (!code || used + (block.count + 2) * MAX_OP_SIZE > CODE_SIZE) return NULL;
+    if (slots.size() + MAX_BLOCK_SLOTS > MAX_SLOTS) return NULL;
+    // Two system calls per run of compiles (Prebuild, the blocks met after
+    // a flush...) instead of two per block, on the pages being written only
+    if (!protect(true, used + (block.count + 2) * MAX_OP_SIZE)) return NULL;
+
+    uint8_t *entry = code + used;
+    starts.assign(block.count, 0);
+    branches.clear();
+    exits.clear();
+    hostRegisters(ops, block.count);
+
+    // push rbx; push rbp; push r12; push r13; sub rsp, 8 (keeps the stack 16 bytes aligned for callouts)
+    bytes({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x48, 0x83, 0xEC, 0x08});
+    // mov r12, rdi; mov ebp, esi
+    bytes({0x49, 0x89, 0xFC, 0x89, 0xF5});
+    // mov rbx, &V[0]
+    bytes({0x48, 0xBB}); imm64(reinterpret_cast<uint64_t>(cpu.V));
+    // movzx r13d, word [I]
+    bytes({0x44, 0x0F, 0xB7}); mem(R13, dispI);
+
+    // Chained blocks jump in here, I is already in r13
+    bodyOffset = (code + used) - entry;
+    loadV();
+    // Jumps back to the start of the block keep their host registers
+    const uint32_t loop = used;
+
+#ifdef CHIP8_STATS
+    const int32_t dispStats = reinterpret_cast<const char *>(&cpu.stats) - reinterpret_cast<const char *>(cpu.V);
+#endif
+    // ebp counts the cycles left down, checked after every instruction:
+    // there is always one when the block is entered
+    uint16_t address = block.start;
+    for (auto i=0; i<block.count; ++i, address += 2)
+    {
+        const MicroOp &op = ops[i];
+        const bool last = i + 1 == block.count;
+        starts[i] = used;
+#ifdef CHIP8_STATS
+        bytes({0x48, 0xFF}); mem(0, dispStats + offsetof(CpuStats, ops) + op.ins.op * 8);                     // inc qword [ops[op]]
+        bytes({0x48, 0xFF}); mem(0, dispStats + offsetof(CpuStats, addresses) + (address & 0xFFF) * 8);    // inc qword [addresses[pc]]
+#endif
+
+        if (Skips(op.ins.op))
+        {
+            // Out of cycles: the stub makes the test and works out pc
+            bytes({0x83, 0xED, 0x01});                               // sub ebp, 1
+            skipExitOn(CC_E, i, op.opcode);
+            const uint8_t cc = emitSkipTest(op);
+            // Taken: two instructions further, in the block or after it
+            if (i + 2 < block.count) branchTo(cc, i + 2);
+            else exitOn(cc, address + 4, op.opcode, true);
+            if (last) exitTo(address + 2, op.opcode, true);
+            continue;
+        }
+
+        emitOp(op, address);
+        bytes({0x83, 0xED, 0x01});                                   // sub ebp, 1
+        // Jumps and calls go on with a known block. The other terminators
+        // already wrote pc, and FX33/FX55 may have overwritten the next block.
+        if (op.ins.op == OP_Jmp || op.ins.op == OP_Call) exitTo(op.ins.nnn, op.opcode, true);
+        else if (isTerminator(op.ins.op)) exitTo(-1, op.opcode, false);
+        else if (last) exitTo(address + 2, op.opcode, true);
+        else exitOn(CC_E, address + 2, op.opcode, false);
+    }
+
+    // Stubs leaving the block, out of the way of the straight line code
+    for (const auto &exit : exits)
+    {
+        patch(exit.from, used);
+        int32_t slot = -1;
+        if (exit.chain)
+        {
+            // Cycles left: on with the next block, through its slot once
+            // runJit has chained it
+            bytes({0x85, 0xED});                                     // test ebp, ebp
+            bytes({0x0F, 0x84}); imm32(0);                           // jz leave
+            const uint32_t leave = used - 4;
+            if (exit.pc == block.start)
+            {
+                byte(0xE9); imm32(0);                                // jmp loop
+                patch(used - 4, loop);
+            }
+            else
+            {
+                slot = slots.size();
+                slots.push_back({NULL, NULL});
+                storeV();
+                bytes({0x48, 0xB8}); imm64(reinterpret_cast<uint64_t>(&slots[slot].target));
+                bytes({0xFF, 0x20});                                 // jmp [rax]
+            }
+            patch(leave, used);
+            if (slot >= 0) slots[slot].target = slots[slot].unchained = code + used;
+        }
+
+        if (exit.skip >= 0)
+        {
+            // Skip on the last cycle: pc = condition ? pc + 4 : pc + 2, on the
+            // flags of the test made again
+            const uint16_t at = block.start + 2 * exit.skip;
+            const uint8_t cc = emitSkipTest(ops[exit.skip]);
+            byte(0xB9); imm32(at + 2);                               // mov ecx, pc + 2
+            byte(0xBA); imm32(at + 4);                               // mov edx, pc + 4
+            bytes({0x0F, uint8_t(0x40 | cc), 0xCA});                 // cmovcc ecx, edx
+            bytes({0x66, 0x89}); mem(ECX, dispPC);                   // mov [pc], cx
+        }
+        else if (exit.pc >= 0)
+        {
+            bytes({0x66, 0xC7}); mem(0, dispPC); imm16(exit.pc);     // mov word [pc], address
+        }
+        storeV();
+        bytes({0x66, 0xC7}); mem(0, dispOpcode); imm16(exit.opcode); // mov word [opcode], opcode
+        if (slot >= 0)
+        {
+            // Tells runJit which slot to chain
+            bytes({0x48, 0xB8}); imm64(reinterpret_cast<uint64_t>(&this->exit));
+            bytes({0xC7, 0x00}); imm32(slot);                        // mov dword [rax], slot
+        }
+        emitExit();
+    }
+
+    for (const auto &branch : branches) patch(branch.from, starts[branch.to]);
+    return reinterpret_cast<NativeBlock>(entry);
+}
+
+void Jit::hostRegisters(const MicroOp *ops, uint16_t count)
+{
+    uint32_t uses[16] = {0};
+    for (auto i=0; i<count; ++i) countUses(ops[i].ins, uses);
+
+    // The most used ones, when they are used more than once
+    hosted.clear();
+    memset(host, -1, sizeof(host));
+    while (hosted.size() < HOST_REGISTERS)
+    {
+        uint8_t most = 0;
+        for (uint8_t v=1; v<16; ++v) if (uses[v] > uses[most]) most = v;
+        if (uses[most] < 2) break;
+        host[most] = R8 + hosted.size();
+        hosted.push_back(most);
+        uses[most] = 0;
+    }
+}
+
+void Jit::loadV()
+{
+    // movzx r8d..r11d, byte [Vx]
+    for (auto v : hosted) { bytes({0x44, 0x0F, 0xB6}); mem(host[v] & 7, vreg(v)); }
+}
+
+void Jit::storeV()
+{
+    // mov [Vx], r8b..r11b
+    for (auto v : hosted) { bytes({0x44, 0x88}); mem(host[v] & 7, vreg(v)); }
+}
+
+void Jit::vop(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t v)
+{
+    if (host[v] < 0)
+    {
+        bytes(opcode); mem(reg, vreg(v));
+        return;
+    }
+    // REX.B and the host register as r/m
+    byte(0x41); bytes(opcode); byte(0xC0 | (reg << 3) | (host[v] & 7));
+}
+
+void Jit::exitOn(uint8_t cc, int32_t pc, uint16_t opcode, bool chain)
+{
+    bytes({0x0F, uint8_t(0x80 | cc)}); imm32(0);                     // jcc stub
+    exits.push_back({used - 4, pc, opcode, -1, chain});
+}
+
+void Jit::skipExitOn(uint8_t cc, int skip, uint16_t opcode)
+{
+    bytes({0x0F, uint8_t(0x80 | cc)}); imm32(0);                     // jcc stub
+    exits.push_back({used - 4, -1, opcode, skip, false});
+}
+
+void Jit::exitTo(int32_t pc, uint16_t opcode, bool chain)
+{
+    byte(0xE9); imm32(0);                                            // jmp stub
+    exits.push_back({used - 4, pc, opcode, -1, chain});
+}
+
+void Jit::branchTo(uint8_t cc, int op)
+{
+    bytes({0x0F, uint8_t(0x80 | cc)}); imm32(0);                     // jcc op
+    branches.push_back({used - 4, op});
+}
+
+void Jit::patch(uint32_t from, uint32_t to)
+{
+    const int32_t rel = to - (from + 4);
+    memcpy(code + from, &rel, sizeof(rel));
+}
+
+void Jit::emitExit()
+{
+    // mov word [I], r13w
+    bytes({0x66, 0x44, 0x89}); mem(R13, dispI);
+    // mov eax, ebp (cycles left)
+    bytes({0x89, 0xE8});
+    // add rsp, 8; pop r13; pop r12; pop rbp; pop rbx; ret
+    bytes({0x48, 0x83, 0xC4, 0x08, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3});
+}
+
+void Jit::emitCallout(const MicroOp &op, uint16_t address)
+{
+    uint64_t packed;
+    memcpy(&packed, &op.ins, sizeof(packed));
+
+    // Handlers see the same state as the interpreter: spill I, pc and the
+    // V registers kept in host registers
+    bytes({0x66, 0x44, 0x89}); mem(R13, dispI);
+    bytes({0x66, 0xC7}); mem(0, dispPC); imm16(address);
+    storeV();
+    // mov rdi, r12; mov rsi, packed; mov edx, opcode; mov rcx, handler; mov rax, interpret; call rax
+    bytes({0x4C, 0x89, 0xE7});
+    bytes({0x48, 0xBE}); imm64(packed);
+    byte(0xBA); imm32(op.opcode);
+    bytes({0x48, 0xB9}); imm64(reinterpret_cast<uint64_t>(op.handler));
+    bytes({0x48, 0xB8}); imm64(reinterpret_cast<uint64_t>(&Jit::interpret));
+    bytes({0xFF, 0xD0});
+    // Handlers may change I (FX65) and V, and don't preserve r8-r11: reload them
+    bytes({0x44, 0x0F, 0xB7}); mem(R13, dispI);
+    loadV();
+}
+
+uint8_t Jit::emitSkipTest(const MicroOp &op)
+{
+    const Instruction &ins = op.ins;
+    switch(ins.op)
+    {
+        case OP_Jeq:
+        case OP_Jneq:
+            vop({0x80}, 7, ins.x); byte(ins.kk);                     // cmp byte [Vx], kk
+            return ins.op == OP_Jeq ? CC_E : CC_NE;
+        case OP_Jeqr:
+        case OP_Jneqr:
+            vop({0x0F, 0xB6}, EAX, ins.x);                           // movzx eax, byte [Vx]
+            vop({0x3A}, EAX, ins.y);                                 // cmp al, [Vy]
+            return ins.op == OP_Jeqr ? CC_E : CC_NE;
+        default:
+            // Keys: Vx indexes the keypad, as in the interpreter
+            vop({0x0F, 0xB6}, EAX, ins.x);                           // movzx eax, byte [Vx]
+            bytes({0x80, 0xBC, 0x03}); imm32(dispKeyboard); byte(0); // cmp byte [rbx + rax + keyboard], 0
+            return ins.op == OP_Jkey ? CC_NE : CC_E;
+    }
+}
+
+void Jit::emitOp(const MicroOp &op, uint16_t address)
+{
+    const Instruction &ins = op.ins;
+    const uint8_t x = ins.x, y = ins.y;
+    // Quirks of the selected profile are compile time constants of the block
+    const QuirkFlags &quirks = cpu.quirkFlags;
+
+    switch(ins.op)
+    {
+        case OP_Jmp:
+            // The exit writes pc
+            break;
+        case OP_Call:
+            bytes({0x0F, 0xB7}); mem(EAX, dispSP);                   // movzx eax, word [sp]
+            bytes({0x66, 0xC7, 0x84, 0x43}); imm32(dispStack);       // mov word [stack + rax*2], pc
+            imm16(address);
+            bytes({0xFF, 0xC0});                                     // inc eax
+            bytes({0x83, 0xE0, 0x0F});                               // and eax, 0xF
+            bytes({0x66, 0x89}); mem(EAX, dispSP);                   // mov [sp], ax
+            break;
+        case OP_Ret:
+            bytes({0x0F, 0xB7}); mem(EAX, dispSP);                   // movzx eax, word [sp]
+            bytes({0xFF, 0xC8});                                     // dec eax
+            bytes({0x83, 0xE0, 0x0F});                               // and eax, 0xF
+            bytes({0x66, 0x89}); mem(EAX, dispSP);                   // mov [sp], ax
+            bytes({0x0F, 0xB7, 0x8C, 0x43}); imm32(dispStack);       // movzx ecx, word [stack + rax*2]
+            bytes({0x83, 0xC1, 0x02});                               // add ecx, 2
+            bytes({0x66, 0x89}); mem(ECX, dispPC);                   // mov [pc], cx
+            break;
+        case OP_Jumpv0:
+            vop({0x0F, 0xB6}, EAX, quirks.jumpVX ? x : 0);           // movzx eax, byte [V0 or Vx]
+            byte(0x05); imm32(ins.nnn);                              // add eax, nnn
+            byte(0x25); imm32(0xFFF);                                // and eax, 0xFFF
+            bytes({0x66, 0x89}); mem(EAX, dispPC);                   // mov [pc], ax
+            break;
+        case OP_Set:
+            vop({0xC6}, 0, x); byte(ins.kk);                         // mov byte [Vx], kk
+            break;
+        case OP_Add:
+            vop({0x80}, 0, x); byte(ins.kk);                         // add byte [Vx], kk
+            break;
+        case OP_Setr:
+        case OP_Or:
+        case OP_And:
+        case OP_Xor:
+        {
+            const uint8_t opc = ins.op == OP_Setr ? 0x88 :
+                                ins.op == OP_Or   ? 0x08 :
+                                ins.op == OP_And  ? 0x20 : 0x30;
+            vop({0x8A}, EAX, y);                                     // mov al, [Vy]
+            vop({opc}, EAX, x);                                      // op [Vx], al
+            break;
+        }
+        // Flag operations write VF first and then reload the operands,
+        // like the interpreter does (X or Y may be F)
+        case OP_Addr:
+            vop({0x0F, 0xB6}, EAX, x);                               // movzx eax, byte [Vx]
+            vop({0x0F, 0xB6}, ECX, y);                               // movzx ecx, byte [Vy]
+            bytes({0x01, 0xC8});                                     // add eax, ecx
+            byte(0x3D); imm32(0xFF);                                 // cmp eax, 0xFF
+            bytes({0x0F, 0x97, 0xC2});                               // seta dl
+            vop({0x88}, EDX, 0xF);                                   // mov [VF], dl
+            vop({0x8A}, EAX, y);                                     // mov al, [Vy]
+            vop({0x00}, EAX, x);                                     // add [Vx], al
+            break;
+        case OP_Sub:
+            vop({0x8A}, EAX, x);                                     // mov al, [Vx]
+            vop({0x3A}, EAX, y);                                     // cmp al, [Vy]
+            bytes({0x0F, 0x92, 0xC2});                               // setb dl
+            vop({0x88}, EDX, 0xF);                                   // mov [VF], dl
+            vop({0x8A}, EAX, y);                                     // mov al, [Vy]
+            vop({0x28}, EAX, x);                                     // sub [Vx], al
+            break;
+        case OP_Subb:
+            vop({0x8A}, EAX, x);                                     // mov al, [Vx]
+            vop({0x3A}, EAX, y);                                     // cmp al, [Vy]
+            bytes({0x0F, 0x97, 0xC2});                               // seta dl
+            vop({0x88}, EDX, 0xF);                                   // mov [VF], dl
+            vop({0x8A}, EAX, y);                                     // mov al, [Vy]
+            vop({0x2A}, EAX, x);                                     // sub al, [Vx]
+            vop({0x88}, EAX, x);                                     // mov [Vx], al
+            break;
+        case OP_Shr:
+        case OP_Shl:
+        {
+            // shifted register: Vx, or Vy when the profile says so
+            const uint8_t s = quirks.shiftVY ? y : x;
+            vop({0x0F, 0xB6}, EAX, s);                               // movzx eax, byte [Vs]
+            if (ins.op == OP_Shr) bytes({0x83, 0xE0, 0x01});         // and eax, 1
+            else bytes({0xC1, 0xE8, 0x07});                          // shr eax, 7
+            vop({0x88}, EAX, 0xF);                                   // mov [VF], al
+            vop({0x8A}, EAX, s);                                     // mov al, [Vs]
+            bytes({0xD0, uint8_t(ins.op == OP_Shr ? 0xE8 : 0xE0)});  // shr/shl al, 1
+            vop({0x88}, EAX, x);                                     // mov [Vx], al
+            break;
+        }
+        case OP_Seti:
+            bytes({0x41, 0xBD}); imm32(ins.nnn);                     // mov r13d, nnn
+            break;
+        case OP_Addi:
+            if (quirks.addiVF)
+            {
+                vop({0x0F, 0xB6}, EAX, x);                           // movzx eax, byte [Vx]
+                bytes({0x44, 0x89, 0xE9});                           // mov ecx, r13d
+                bytes({0x01, 0xC1});                                 // add ecx, eax
+                bytes({0x81, 0xF9}); imm32(0xFFF);                   // cmp ecx, 0xFFF
+                bytes({0x0F, 0x97, 0xC2});                           // seta dl
+                vop({0x88}, EDX, 0xF);                               // mov [VF], dl
+            }
+            vop({0x0F, 0xB6}, EAX, x);                               // movzx eax, byte [Vx]
+            bytes({0x41, 0x01, 0xC5});                               // add r13d, eax
+            bytes({0x45, 0x0F, 0xB7, 0xED});                         // movzx r13d, r13w
+            break;
+        case OP_Spritei:
+            vop({0x0F, 0xB6}, EAX, x);                               // movzx eax, byte [Vx]
+            bytes({0x44, 0x8D, 0x2C, 0x80});                         // lea r13d, [rax + rax*4]
+            break;
+        case OP_Getdelay:
+            bytes({0x0F, 0xB6}); mem(EAX, dispDelay);                // movzx eax, byte [delay]
+            vop({0x88}, EAX, x);                                     // mov [Vx], al
+            break;
+        case OP_Setdelay:
+        case OP_Setsound:
+            vop({0x8A}, EAX, x);                                     // mov al, [Vx]
+            byte(0x88); mem(EAX, ins.op == OP_Setdelay ? dispDelay : dispSound); // mov [timer], al
+            break;
+        case OP_Pop:
+            // Reads wrap around memory, as Memory::Read does
+            for (uint8_t v=0; v<=x; ++v)
+            {
+                bytes({0x41, 0x8D, 0x4D, v});                        // lea ecx, [r13 + v]
+                bytes({0x81, 0xE1}); imm32(0xFFF);                   // and ecx, 0xFFF
+                bytes({0x0F, 0xB6, 0x94, 0x0B}); imm32(dispMemory);  // movzx edx, byte [rbx + rcx + memory]
+                vop({0x88}, EDX, v);                                 // mov [Vv], dl
+            }
+            if (quirks.loadStoreI)
+            {
+                bytes({0x41, 0x83, 0xC5, uint8_t(x + 1)});           // add r13d, x + 1
+                bytes({0x45, 0x0F, 0xB7, 0xED});                     // movzx r13d, r13w
+            }
+            break;
+        default:
+            emitCallout(op, address);
+    }
+}
+
+// JIT engine: blocks are compiled on their first execution and then run
+// natively, going straight from one to the next once they are chained
+void Chip8::runJit(uint32_t cycles)
+{
+    if (!jit) jit.reset(new Jit(*this));
+
+    // Exit the last run left through, chained to the block run next
+    uint32_t from = Jit::NO_EXIT;
+    uint32_t invalidations = cache.Invalidations();
+    while (cycles)
+    {
+        // Block addresses are in memory, so is the pc native code writes back
+        pc &= 0xFFF;
+        Block &block = cache.Lookup(pc, memory);
+        const MicroOp *op = cache.Ops(block);
+
+        if (block.idle && idle(block, op, cycles)) return;
+
+        if (!block.native && ++block.runs <= COMPILE_AFTER)
+        {
+            // Until it leaves the block
+            uint16_t at;
+            do
+            {
+                CHIP8_STAT(stats.Count(pc, op->ins.op));
+                at = pc;
+                op->handler(*this, op->ins);
+                opcode = op->opcode;
+                --cycles;
+                if (Skips(op->ins.op)) op += (pc - at) >> 1;
+                else if (MovesOn(op->ins.op)) ++op;
+                else break;
+            } while (cycles && op->ins.op != OP_BlockEnd);
+            from = Jit::NO_EXIT;
+            continue;
+        }
+
+        if (!block.native)
+        {
+            // No executable memory available on this host
+            if (!jit->Available())
+            {
+                (this->*runBlocksLoop)(cycles);
+                return;
+            }
+
+            block.native = reinterpret_cast<void *>(jit->Compile(block, op));
+            if (!block.native)
+            {
+                // Code buffer full: start over
+                jit->Reset();
+                cache.Flush(memory);
+                from = Jit::NO_EXIT;
+                continue;
+            }
+        }
+
+        if (!jit->Seal())
+        {
+            // Native code can't be run on this host
+            cache.Flush(memory);
+            (this->*runBlocksLoop)(cycles);
+            return;
+        }
+
+        // Idle loops are always entered from here, to burn their cycles
+        const Jit::NativeBlock native = reinterpret_cast<Jit::NativeBlock>(block.native);
+        if (from != Jit::NO_EXIT && !block.idle) jit->Chain(from, native);
+
+        // Runs until it leaves the chained blocks or the cycles are spent
+        cycles = jit->Run(native, cycles);
+        from = jit->LastExit();
+
+        // FX33/FX55 overwrote blocks that may be chained
+        if (cache.Invalidations() != invalidations)
+        {
+            jit->Unchain();
+            invalidations = cache.Invalidations();
+            from = Jit::NO_EXIT;
+        }
+    }
+}
+
+#else
+
+Jit::Jit(Chip8 &cpu) : cpu(cpu), code(NULL), used(0), writable(false), page(0), openFrom(0), openTo(0), exit(NO_EXIT), bodyOffset(0) {}
+Jit::~Jit() {}
+Jit::NativeBlock Jit::Compile(const Block &block, const MicroOp *ops) { return NULL; }
+void Jit::Chain(uint32_t from, NativeBlock to) {}
+void Jit::Unchain() {}
+
+// No recompiler for this host: run the predecoded blocks
+void Chip8::runJit(uint32_t cycles)
+{
+    (this->*runBlocksLoop)(cycles);
+}
+
+#endif // CHIP8_JIT_SUPPORTED
@@ -0,0 +1,166 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include "BlockCache.h"
+
+class Chip8;
+
+// x86-64 dynamic recompiler: turns predecoded blocks into native code.
+// V registers are addressed off a pinned base register, the most used ones
+// of each block are kept in host registers, I lives in a host register and
+// pc is a compile time constant, only written back on exits. Skips branch
+// inside the block, and the cycles left are counted down so a block can stop
+// at any of its instructions. Exits to a known address (jumps, calls, the end
+// of the block) are chained: they jump straight into the next block once it's
+// compiled. Operations that need the rest of the machine (draw, clear, rand,
+// waiting for a key, memory stores...) call back into the interpreter
+// handlers.
+#if defined(__x86_64__) && defined(__unix__)
+#define CHIP8_JIT_SUPPORTED 1
+#endif
+
+class Jit
+{
+public:
+    // Runs at most cycles instructions (at least one), returns the cycles left
+    typedef uint32_t (*NativeBlock)(Chip8 *cpu, uint32_t cycles);
+    static const uint32_t NO_EXIT = 0xFFFFFFFF;
+
+    explicit Jit(Chip8 &cpu);
+    ~Jit();
+    Jit (const Jit &) = delete;
+    Jit & operator=(const Jit &) = delete;
+
+    // Returns NULL when the code buffer is full, Reset it and try again.
+    // The buffer stays writable for a whole run of compiles, Seal it before
+    // running any of them.
+    NativeBlock Compile(const Block &block, const MicroOp *ops);
+    // Makes the code executable again, once per run of compiles. False when
+    // the host doesn't allow it: the code is gone, blocks must be flushed.
+    bool Seal() { return !writable || protect(false); }
+    void Reset() { Seal(); used = 0; slots.clear(); }
+    bool Available() const { return code != NULL; }
+
+    // Runs the block and the blocks chained to it
+    uint32_t Run(NativeBlock block, uint32_t cycles) { exit = NO_EXIT; return block(&cpu, cycles); }
+    // Chainable exit the last Run left through (NO_EXIT: none), Chain makes
+    // it jump to the block it led to from then on
+    uint32_t LastExit() const { return exit; }
+    void Chain(uint32_t from, NativeBlock to);
+    // Every exit goes back to Run again: the blocks it led to were overwritten
+    void Unchain();
+
+private:
+    // Called from native code to run an operation with its interpreter handler
+    static void interpret(Chip8 *cpu, uint64_t ins, uint32_t opcode, Dispatch::Handler handler);
+    // Flips the pages of the current run of compiles to writable (up to
+    // offset to) or executable, the rest of the buffer is left alone. Frees
+    // it when the host refuses (W^X policy): no code can be generated then.
+    bool protect(bool write, uint32_t to = 0);
+
+    void emitOp(const MicroOp &op, uint16_t address);
+    void emitCallout(const MicroOp &op, uint16_t address);
+    // Flags test of a skip, returns the condition code of the taken way
+    uint8_t emitSkipTest(const MicroOp &op);
+    void emitExit();
+
+    // Picks the V registers the block keeps in r8-r11
+    void hostRegisters(const MicroOp *ops, uint16_t count);
+    // Copies them from and to the machine
+    void loadV();
+    void storeV();
+    // Instruction with Vx as its r/m operand, in memory or in its host register
+    void vop(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t v);
+
+    // Branches to the stubs leaving the block with pc (-1: already written)
+    // and the opcode of the last instruction, patched once they are emitted.
+    // Chained ones go on with the block at pc when there are cycles left.
+    void exitOn(uint8_t cc, int32_t pc, uint16_t opcode, bool chain);
+    void exitTo(int32_t pc, uint16_t opcode, bool chain);
+    // Same, working out pc with the test of the skip at index skip
+    void skipExitOn(uint8_t cc, int skip, uint16_t opcode);
+    // Branch to the instruction at index op of the block
+    void branchTo(uint8_t cc, int op);
+    void patch(uint32_t from, uint32_t to);
+
+    // Encoding helpers
+    void byte(uint8_t b) { code[used++] = b; }
+    void bytes(std::initializer_list<uint8_t> list) { for (auto b : list) byte(b); }
+    void imm16(uint16_t v) { byte(v); byte(v >> 8); }
+    void imm32(uint32_t v) { imm16(v); imm16(v >> 16); }
+    void imm64(uint64_t v) { imm32(v); imm32(v >> 32); }
+    // ModRM for [rbx + disp32] with the given reg field, followed by disp32
+    void mem(uint8_t reg, int32_t disp) { byte(0x80 | (reg << 3) | 3); imm32(disp); }
+
+    int32_t vreg(uint8_t reg) const { return dispV + reg; }
+
+private:
+    static const uint32_t CODE_SIZE = 1 << 20;
+    // Code of the longest instruction (FX65 with x = F) and its exits
+    static const uint32_t MAX_OP_SIZE = 512;
+    static const uint32_t HOST_REGISTERS = 4;
+    static const uint32_t MAX_SLOTS = 16384;
+    // Chainable exits of a block: a jump or call, or its last two skips
+    static const uint32_t MAX_BLOCK_SLOTS = 3;
+
+    struct Exit
+    {
+        uint32_t from;
+        int32_t pc;
+        uint16_t opcode;
+        int skip;
+        bool chain;
+    };
+    struct Branch
+    {
+        uint32_t from;
+        int to;
+    };
+    // Where a chainable exit jumps: the next block, or back out through Run
+    struct Slot
+    {
+        const uint8_t *target;
+        const uint8_t *unchained;
+    };
+
+    Chip8 &cpu;
+    uint8_t *code;
+    uint32_t used;
+    // Between the first compile of a run and Seal
+    bool writable;
+    // Pages written by the current run of compiles
+    uint32_t page;
+    uint32_t openFrom;
+    uint32_t openTo;
+    // Of the block being compiled: code offset of each instruction, pending
+    // branches and exits
+    std::vector<uint32_t> starts;
+    std::vector<Branch> branches;
+    std::vector<Exit> exits;
+    // Host register of each V register (-1: in memory), and the hosted ones
+    int8_t host[16];
+    std::vector<uint8_t> hosted;
+
+    std::vector<Slot> slots;
+    // Written by the exit stubs
+    uint32_t exit;
+    // Offset of the chained entry in every block, after the prologue
+    uint32_t bodyOffset;
+
+    // displacements from &V[0] (kept in rbx)
+    int32_t dispV;
+    int32_t dispI;
+    int32_t dispPC;
+    int32_t dispSP;
+    int32_t dispStack;
+    int32_t dispOpcode;
+    int32_t dispMemory;
+    int32_t dispKeyboard;
+    int32_t dispDelay;
+    int32_t dispSound;
+};
+
+#endif // _JIT_H_
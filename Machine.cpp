@@ -0,0 +1,46 @@
+#include <strings.h>
+
+#include "Chip8.h"
+#include "Extended.h"
+#include "Machine.h"
+#include "Rom.h"
+
+namespace
+{
+    const char *mode_names[] = { "chip8", "schip", "xochip" };
+}
+
+bool Machine::LoadROM(const char *filename)
+{
+    RomImage rom(filename, MaxROMSize());
+    return rom.Valid() && LoadROM(rom.Data(), rom.Size());
+}
+
+const char *MachineModeName(MachineMode mode)
+{
+    return mode_names[static_cast<int>(mode)];
+}
+
+bool MachineModeFromName(const char *name, MachineMode &mode)
+{
+    for (auto i=0u; i<sizeof(mode_names) / sizeof(mode_names[0]); ++i)
+    {
+        if (strcasecmp(name, mode_names[i]) == 0)
+        {
+            mode = static_cast<MachineMode>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::unique_ptr<Machine> CreateMachine(MachineMode mode)
+{
+    switch (mode)
+    {
+        case MachineMode::Chip8: return std::unique_ptr<Machine>(new Chip8());
+        case MachineMode::Schip: return std::unique_ptr<Machine>(new SuperChip8());
+        case MachineMode::XoChip: return std::unique_ptr<Machine>(new XoChip8());
+    }
+    return NULL;
+}
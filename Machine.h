@@ -0,0 +1,66 @@
+#ifndef _MACHINE_H_
+#define _MACHINE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "Screen.h"
+#include "Sink.h"
+#include "Snapshot.h"
+#include "Stats.h"
+
+// Emulated machine, as driven frame by frame by the scheduler, the emulation
+// thread and the frontends. Every call covers a whole frame or more, the
+// instruction loops behind them never go through a virtual call.
+class Machine
+{
+public:
+    virtual ~Machine() = default;
+
+    // Maps the file and loads it, false when it can't be read or doesn't fit
+    // (RomImage tells why)
+    bool LoadROM(const char *filename);
+    // Copies a program at 0x200, false when it doesn't fit
+    virtual bool LoadROM(const uint8_t *program, size_t size) = 0;
+    // Bytes available to programs
+    virtual size_t MaxROMSize() const = 0;
+    virtual void SetAudioSink(AudioSink *sink) = 0;
+    virtual void Seed(uint64_t seed) = 0;
+
+    // Runs instructions instructions, then one tick of the 60 Hz timers
+    virtual void RunFrame(uint32_t instructions) = 0;
+    // Instructions executed since power on
+    virtual uint64_t Cycle() const = 0;
+    // One bit per key, bit N for key N
+    virtual void SetKeys(uint16_t pressed) = 0;
+
+    // Copies the screen when it was drawn since the last call, false otherwise
+    virtual bool TakeScreen(Screen &screen) = 0;
+    virtual uint32_t ScreenWidth() const = 0;
+    virtual uint32_t ScreenHeight() const = 0;
+
+    // Machines without a snapshot format can't be rewound nor recorded
+    virtual bool Save(Snapshot &/*snapshot*/) const { return false; }
+    virtual bool Restore(const Snapshot &/*snapshot*/) { return false; }
+
+    virtual uint64_t UnknownOpcodes() const = 0;
+#ifdef CHIP8_STATS
+    // Executed instructions by operation and by address, NULL when not counted
+    virtual const CpuStats *Counters() const { return NULL; }
+#endif
+};
+
+// Instruction sets and screens: the original 64x32 machine and the extended
+// ones (see Extended.h)
+enum class MachineMode
+{
+    Chip8,
+    Schip,
+    XoChip
+};
+
+const char *MachineModeName(MachineMode mode);
+bool MachineModeFromName(const char *name, MachineMode &mode);
+std::unique_ptr<Machine> CreateMachine(MachineMode mode);
+
+#endif // _MACHINE_H_
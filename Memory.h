@@ -2,6 +2,8 @@
 #define _MEMORY_H_
 
 #include <stdio.h>
+#include <cstdint>
+#include <cstring>
 
 /* Memory Map:
 +---------------+= 0xFFF (4095) End of Chip-8 RAM
@@ -53,41 +55,48 @@ namespace
     };
 } // namespace
 
+// Gets notified when a byte flagged as code is overwritten,
+// so predecoded instructions can be discarded (self-modifying code).
+class CodeWatcher
+{
+public:
+    virtual ~CodeWatcher() = default;
+
+    virtual void CodeWritten(int address) = 0;
+};
+
+// Addresses wrap around the B bytes, I can run past the end of memory
 template <uint32_t B>
 class Memory
 {
+    static_assert((B & (B - 1)) == 0, "Addresses are wrapped with a mask");
+
 public:
-    Memory() : memory{0} 
+    Memory() : memory{0}, codeMap{0}, watcher(NULL)
     {
         LoadFontSet();
     }
    
     void Write(int address, uint8_t value)
     {
+        address &= B - 1;
         memory[address] = value;
+        if (codeMap[address >> 3] & (1 << (address & 7))) watcher->CodeWritten(address);
     }
 
     uint8_t Read(int address)
     {
-        return(memory[address]);
+        return(memory[address & (B - 1)]);
     }
 
-    bool loadAppInMemory(const char * filename)
-    {
-        printf("Loading: %s\n", filename);
-
-        // Open file
-        FILE * pFile = fopen(filename, "rb");
-        if (!pFile) return false;
-
-        fseek(pFile, 0, SEEK_END);
-        int length = ftell(pFile);
-        fseek(pFile, 0, SEEK_SET);
-        printf("Filesize: %d\n", length);
-
-        fread (memory + 0x200, length, 1, pFile);
-        fclose(pFile);
+    // Bytes available to programs, loaded at 0x200
+    static const uint32_t PROGRAM_SIZE = B - 0x200;
 
+    // Copies a program at 0x200, false when it doesn't fit
+    bool LoadProgram(const uint8_t *program, size_t size)
+    {
+        if (size > PROGRAM_SIZE) return false;
+        memcpy(memory + 0x200, program, size);
         return true;
     }
 
@@ -100,8 +109,21 @@ public:
         }
     }
 
+    // Code tracking: written addresses flagged as code are reported to the watcher
+    void SetCodeWatcher(CodeWatcher *w) { watcher = w; }
+    void MarkCode(int address)
+    {
+        address &= B - 1;
+        codeMap[address >> 3] |= 1 << (address & 7);
+    }
+    void ClearCodeMap() { memset(codeMap, 0, sizeof(codeMap)); }
+
+    const uint8_t *Data() const { return memory; }
+    // Replaces the whole memory without notifying the watcher: predecoded code must be flushed
+    void Restore(const uint8_t *from) { memcpy(memory, from, B); }
+
     uint8_t operator[](int idx)       { return memory[idx]; };
-    const uint8_t operator[](int idx) const { return memory[idx]; };
+    uint8_t operator[](int idx) const { return memory[idx]; };
 
 private:
 
@@ -112,6 +134,9 @@ private:
                             
 private:
     uint8_t memory[B]; 
+    // one bit per byte of memory, set when the byte belongs to a predecoded block
+    uint8_t codeMap[B / 8];
+    CodeWatcher *watcher;
 };
 
 #endif // _MEMORY_H_
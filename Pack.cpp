@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Machine.h"
+#include "Pack.h"
+#include "Rom.h"
+
+namespace
+{
+    struct Sorted
+    {
+        uint64_t hash;
+        const PackSource *source;
+    };
+
+    bool before(const Sorted &a, const Sorted &b)
+    {
+        return a.hash != b.hash ? a.hash < b.hash : a.source->name < b.source->name;
+    }
+}
+
+bool WriteRomPack(const char *filename, const std::vector<PackSource> &roms)
+{
+    std::vector<Sorted> sorted;
+    for (const auto &rom : roms) sorted.push_back({ RomHash(rom.data.data(), rom.data.size()), &rom });
+    std::sort(sorted.begin(), sorted.end(), before);
+
+    uint32_t count = sorted.size();
+    std::vector<uint32_t> byName(count);
+    for (uint32_t i=0; i<count; ++i) byName[i] = i;
+    std::sort(byName.begin(), byName.end(),
+              [&](uint32_t a, uint32_t b) { return sorted[a].source->name < sorted[b].source->name; });
+
+    // Names right after the tables, then the programs
+    uint64_t offset = sizeof(PackHeader) + uint64_t(count) * (sizeof(PackEntry) + sizeof(uint32_t));
+    std::vector<PackEntry> entries(count);
+    for (uint32_t i=0; i<count; ++i)
+    {
+        entries[i].name = offset;
+        offset += sorted[i].source->name.size() + 1;
+    }
+    std::vector<const PackSource *> programs;
+    for (uint32_t i=0; i<count; ++i)
+    {
+        const PackSource *source = sorted[i].source;
+        PackEntry &entry = entries[i];
+        entry.hash = sorted[i].hash;
+        entry.size = source->data.size();
+        entry.reserved = 0;
+        // Same content sorts next to each other
+        if (i > 0 && entry.hash == entries[i - 1].hash && source->data == sorted[i - 1].source->data)
+        {
+            entry.offset = entries[i - 1].offset;
+            continue;
+        }
+        entry.offset = offset;
+        offset += entry.size;
+        programs.push_back(source);
+    }
+    if (offset > UINT32_MAX) return false;
+
+    PackHeader header = { PackHeader::MAGIC, PackHeader::VERSION, count, 0, offset };
+    FILE *file = fopen(filename, "wb");
+    if (!file) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (count)
+    {
+        ok = ok && fwrite(entries.data(), sizeof(PackEntry), count, file) == count;
+        ok = ok && fwrite(byName.data(), sizeof(uint32_t), count, file) == count;
+    }
+    for (uint32_t i=0; i<count && ok; ++i) ok = fwrite(sorted[i].source->name.c_str(), sorted[i].source->name.size() + 1, 1, file) == 1;
+    for (const auto *program : programs)
+        if (ok && !program->data.empty()) ok = fwrite(program->data.data(), program->data.size(), 1, file) == 1;
+    return (fclose(file) == 0) && ok;
+}
+
+RomPack::RomPack(const char *filename)
+            : data(MAP_FAILED),
+              size(0),
+              base(NULL),
+              header(NULL),
+              entries(NULL),
+              byName(NULL)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= (off_t) sizeof(PackHeader))
+    {
+        size = st.st_size;
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) return;
+
+    base = static_cast<const char *>(data);
+    const PackHeader *candidate = static_cast<const PackHeader *>(data);
+    if (candidate->magic != PackHeader::MAGIC || candidate->version != PackHeader::VERSION || candidate->size != size) return;
+    if (sizeof(PackHeader) + uint64_t(candidate->count) * (sizeof(PackEntry) + sizeof(uint32_t)) > size) return;
+
+    header = candidate;
+    entries = reinterpret_cast<const PackEntry *>(header + 1);
+    byName = reinterpret_cast<const uint32_t *>(entries + header->count);
+    if (!check()) header = NULL;
+}
+
+RomPack::~RomPack()
+{
+    if (data != MAP_FAILED) munmap(data, size);
+}
+
+// Every offset in the file and both orders. Programs aren't hashed again,
+// that would read the whole pack in.
+bool RomPack::check() const
+{
+    for (uint32_t i=0; i<header->count; ++i)
+    {
+        const PackEntry &entry = entries[i];
+        if (uint64_t(entry.offset) + entry.size > size) return false;
+        if (entry.name >= size || !memchr(base + entry.name, 0, size - entry.name)) return false;
+        if (byName[i] >= header->count) return false;
+    }
+    // Names can only be compared once they all are known to be in the file
+    for (uint32_t i=1; i<header->count; ++i)
+    {
+        if (entries[i].hash < entries[i - 1].hash) return false;
+        if (strcmp(Name(byName[i - 1]), Name(byName[i])) > 0) return false;
+    }
+    return true;
+}
+
+int32_t RomPack::FindHash(uint64_t hash) const
+{
+    const PackEntry *end = entries + Count();
+    const PackEntry *found = std::lower_bound(entries, end, hash,
+                                              [](const PackEntry &entry, uint64_t hash) { return entry.hash < hash; });
+    return (found != end && found->hash == hash) ? found - entries : -1;
+}
+
+int32_t RomPack::FindName(const char *name) const
+{
+    const uint32_t *end = byName + Count();
+    const uint32_t *found = std::lower_bound(byName, end, name,
+                                             [this](uint32_t index, const char *name) { return strcmp(Name(index), name) < 0; });
+    return (found != end && strcmp(Name(*found), name) == 0) ? int32_t(*found) : -1;
+}
+
+int32_t RomPack::Find(const char *nameOrHash) const
+{
+    int32_t index = FindName(nameOrHash);
+    if (index >= 0 || strlen(nameOrHash) != 16) return index;
+
+    char *end;
+    uint64_t hash = strtoull(nameOrHash, &end, 16);
+    return *end == '\0' ? FindHash(hash) : -1;
+}
+
+bool RomPack::Load(uint32_t index, Machine &machine) const
+{
+    return index < Count() && machine.LoadROM(Data(index), entries[index].size);
+}
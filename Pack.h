@@ -0,0 +1,95 @@
+#ifndef _PACK_H_
+#define _PACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Machine;
+
+// ROM pack: many programs in one file, used straight from a read only
+// mapping. Layout, fields in host byte order like snapshots:
+//
+//   PackHeader
+//   PackEntry[count]     sorted by hash, then name
+//   uint32_t[count]      entry indices sorted by name
+//   names                NUL terminated
+//   programs             one copy per distinct content
+//
+// Offsets count from the start of the file. Everything is checked when the
+// pack is opened, so loading a program is a bounds free memcpy.
+struct PackHeader
+{
+    static const uint32_t MAGIC = 0x4B503843; // "C8PK"
+    static const uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t size;      // of the whole file
+};
+
+struct PackEntry
+{
+    uint64_t hash;      // RomHash of the program
+    uint32_t offset;
+    uint32_t size;
+    uint32_t name;      // offset of the name
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PackHeader) == 24, "PackHeader layout is part of the file format");
+static_assert(sizeof(PackEntry) == 24, "PackEntry layout is part of the file format");
+
+// Program to write in a pack
+struct PackSource
+{
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+// Programs with the same content are stored once. False when the file
+// can't be written or doesn't fit in 32 bit offsets.
+bool WriteRomPack(const char *filename, const std::vector<PackSource> &roms);
+
+// Read only mapping of a pack file
+class RomPack
+{
+public:
+    explicit RomPack(const char *filename);
+    ~RomPack();
+    RomPack (const RomPack &) = delete;
+    RomPack & operator=(const RomPack &) = delete;
+
+    // False when the file couldn't be mapped or isn't a valid pack
+    bool Valid() const { return header != NULL; }
+    uint32_t Count() const { return header ? header->count : 0; }
+
+    // Entries in hash order
+    const PackEntry &Entry(uint32_t index) const { return entries[index]; }
+    const char *Name(uint32_t index) const { return base + entries[index].name; }
+    const uint8_t *Data(uint32_t index) const { return reinterpret_cast<const uint8_t *>(base + entries[index].offset); }
+
+    // Binary searches, -1 when not found. A name lookup also accepts the
+    // hash in hexadecimal.
+    int32_t FindHash(uint64_t hash) const;
+    int32_t FindName(const char *name) const;
+    int32_t Find(const char *nameOrHash) const;
+
+    // Copies the program into the memory of the machine at 0x200
+    bool Load(uint32_t index, Machine &machine) const;
+
+private:
+    bool check() const;
+
+    void *data;
+    size_t size;
+    const char *base;
+    const PackHeader *header;
+    const PackEntry *entries;
+    const uint32_t *byName;
+};
+
+#endif // _PACK_H_
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "Memory.h"
+#include "Pack.h"
+#include "Rom.h"
+
+// Builds and inspects ROM packs (see Pack.h).
+// Usage: chip8-pack <pack file> <ROM files or directories...>  directories add their .c8 and .ch8 files
+//        chip8-pack --list <pack file>
+
+namespace
+{
+    // XO-CHIP has the most memory, the machine loading a program checks it fits
+    const size_t MAX_PROGRAM_SIZE = Memory<65536>::PROGRAM_SIZE;
+
+    bool isROM(const std::string &name)
+    {
+        size_t dot = name.find_last_of('.');
+        return dot != std::string::npos && (name.compare(dot, std::string::npos, ".c8") == 0 ||
+                                            name.compare(dot, std::string::npos, ".ch8") == 0);
+    }
+
+    bool addFile(const std::string &path, std::vector<PackSource> &roms)
+    {
+        RomImage rom(path.c_str(), MAX_PROGRAM_SIZE);
+        if (!rom.Valid())
+        {
+            printf("%s %s\n", path.c_str(), rom.Error());
+            return false;
+        }
+        roms.push_back({ path.substr(path.find_last_of('/') + 1), std::vector<uint8_t>(rom.Data(), rom.Data() + rom.Size()) });
+        return true;
+    }
+
+    bool addPath(const char *path, std::vector<PackSource> &roms)
+    {
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) return addFile(path, roms);
+
+        DIR *d = opendir(path);
+        if (!d) return false;
+        bool ok = true;
+        while (struct dirent *entry = readdir(d))
+            if (isROM(entry->d_name)) ok = addFile(std::string(path) + "/" + entry->d_name, roms) && ok;
+        closedir(d);
+        return ok;
+    }
+
+    int list(const char *filename)
+    {
+        RomPack pack(filename);
+        if (!pack.Valid())
+        {
+            printf("%s isn't a valid ROM pack\n", filename);
+            return 1;
+        }
+        printf("%-18s%8s  %s\n", "hash", "bytes", "name");
+        for (uint32_t i=0; i<pack.Count(); ++i)
+            printf("%016llx  %8u  %s\n", (unsigned long long) pack.Entry(i).hash, pack.Entry(i).size, pack.Name(i));
+        printf("%u ROMs\n", pack.Count());
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--list") == 0) return list(argv[2]);
+    if (argc < 3 || argv[1][0] == '-')
+    {
+        printf("Usage: %s <pack file> <ROM files or directories...>\n       %s --list <pack file>\n\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    std::vector<PackSource> roms;
+    bool ok = true;
+    for (int arg = 2; arg < argc; ++arg) ok = addPath(argv[arg], roms) && ok;
+    if (!ok) return 1;
+
+    // Names are keys of the pack
+    std::vector<std::string> names;
+    for (const auto &rom : roms) names.push_back(rom.name);
+    std::sort(names.begin(), names.end());
+    auto duplicate = std::adjacent_find(names.begin(), names.end());
+    if (duplicate != names.end())
+    {
+        printf("Two ROMs are named %s\n", duplicate->c_str());
+        return 1;
+    }
+
+    if (!WriteRomPack(argv[1], roms))
+    {
+        printf("Can't write %s\n", argv[1]);
+        return 1;
+    }
+    printf("%zu ROMs packed in %s\n", roms.size(), argv[1]);
+    return 0;
+}
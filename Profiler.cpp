@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Chip8.h"
+#include "Profiler.h"
+
+const int GuestProfiler::MAX_DEPTH;
+
+// Marks a stack entry whose call instruction was overwritten since
+static const uint16_t UNKNOWN_CALLEE = 0xFFFF;
+
+bool GuestProfiler::CallChain::operator==(const CallChain &other) const
+{
+    return depth == other.depth && std::equal(callee, callee + depth, other.callee);
+}
+
+size_t GuestProfiler::CallChainHash::operator()(const CallChain &chain) const
+{
+    size_t hash = chain.depth;
+    for (int i=0; i<chain.depth; ++i) hash = hash * 31 + chain.callee[i];
+    return hash;
+}
+
+GuestProfiler::GuestProfiler(uint32_t interval) 
+            : interval(interval),
+              pending(0),
+              samples(0)
+{
+}
+
+void GuestProfiler::Run(Chip8 &cpu, uint32_t cycles)
+{
+    if (interval == 0)
+    {
+        cpu.Run(cycles);
+        Sample(cpu);
+        return;
+    }
+
+    while (cycles)
+    {
+        uint32_t step = std::min(cycles, interval - pending);
+        cpu.Run(step);
+        cycles -= step;
+        pending += step;
+        if (pending == interval)
+        {
+            Sample(cpu);
+            pending = 0;
+        }
+    }
+}
+
+void GuestProfiler::Sample(const Chip8 &cpu)
+{
+    CallChain chain;
+    chain.depth = std::min<int>(cpu.sp, MAX_DEPTH);
+    for (int i=0; i<chain.depth; ++i)
+    {
+        uint16_t call = cpu.stack[i] & 0xFFF;
+        uint16_t opcode = cpu.memory[call] << 8 | cpu.memory[(call + 1) & 0xFFF];
+        chain.callee[i] = (opcode & 0xF000) == 0x2000 ? opcode & 0x0FFF : UNKNOWN_CALLEE;
+    }
+
+    ++chains[chain];
+    ++samples;
+}
+
+bool GuestProfiler::Write(const char *filename) const
+{
+    std::vector<std::string> lines;
+    for (const auto &entry : chains)
+    {
+        std::string line = "main";
+        char name[16];
+        for (int i=0; i<entry.first.depth; ++i)
+        {
+            uint16_t callee = entry.first.callee[i];
+            if (callee == UNKNOWN_CALLEE) snprintf(name, sizeof(name), ";sub_unknown");
+            else snprintf(name, sizeof(name), ";sub_%03X", callee);
+            line += name;
+        }
+        lines.push_back(line + " " + std::to_string(entry.second));
+    }
+    std::sort(lines.begin(), lines.end());
+
+    FILE *file = fopen(filename, "w");
+    if (!file) return false;
+    for (const auto &line : lines) fprintf(file, "%s\n", line.c_str());
+    return fclose(file) == 0;
+}
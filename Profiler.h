@@ -0,0 +1,59 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+class Chip8;
+
+// Sampling profiler of the guest program. A sample is the chain of
+// subroutines being run: every stack entry is the address of a 2NNN call,
+// so the callee of each level is read back from the opcode there.
+// Output is in folded stack format, one line per distinct chain with its
+// sample count, as read by flamegraph.pl and compatible tools:
+//   main;sub_2A0;sub_31C 1234
+//
+// The scheduler hands whole frames to it only when it is attached, so an
+// unattached profiler costs nothing.
+class GuestProfiler
+{
+public:
+    // interval: instructions between samples, 0 samples once per frame
+    explicit GuestProfiler(uint32_t interval);
+    ~GuestProfiler() = default;
+    GuestProfiler (const GuestProfiler &) = delete;
+    GuestProfiler & operator=(const GuestProfiler &) = delete;
+
+    // Runs cycles instructions of cpu, taking samples on the way
+    void Run(Chip8 &cpu, uint32_t cycles);
+    void Sample(const Chip8 &cpu);
+
+    uint64_t Samples() const { return samples; }
+    bool Write(const char *filename) const;
+
+private:
+    static const int MAX_DEPTH = 16;
+
+    struct CallChain
+    {
+        uint8_t depth;
+        uint16_t callee[MAX_DEPTH];
+
+        bool operator==(const CallChain &other) const;
+    };
+
+    struct CallChainHash
+    {
+        size_t operator()(const CallChain &chain) const;
+    };
+
+private:
+    uint32_t interval;
+    // instructions run since the last sample
+    uint32_t pending;
+    uint64_t samples;
+    std::unordered_map<CallChain, uint64_t, CallChainHash> chains;
+};
+
+#endif // _PROFILER_H_
@@ -0,0 +1,84 @@
+#include <strings.h>
+#include <vector>
+
+#include "Quirks.h"
+
+namespace
+{
+    const char *profile_names[] = { "legacy", "vip", "schip" };
+
+    // 00FB-00FF (scroll, low/high resolution, exit), 00CN (scroll down),
+    // FX30 (big font), FX75/FX85 (RPL flags)
+    bool isSchipOpcode(uint16_t opcode)
+    {
+        if (opcode >= 0x00FB && opcode <= 0x00FF) return true;
+        if ((opcode & 0xFFF0) == 0x00C0 && (opcode & 0x000F)) return true;
+        switch (opcode & 0xF0FF)
+        {
+            case 0xF030: case 0xF075: case 0xF085: return true;
+        }
+        return false;
+    }
+
+    // Instructions followed from the entry point before giving up
+    const int MAX_TRACED = 512;
+}
+
+const char *QuirkProfileName(QuirkProfile profile)
+{
+    return profile_names[static_cast<int>(profile)];
+}
+
+bool QuirkProfileFromName(const char *name, QuirkProfile &profile)
+{
+    for (size_t i=0; i<sizeof(profile_names) / sizeof(profile_names[0]); ++i)
+    {
+        if (strcasecmp(name, profile_names[i]) == 0)
+        {
+            profile = static_cast<QuirkProfile>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+QuirkProfile QuirkProfileForROM(const uint8_t *rom, size_t size)
+{
+    // Sprites are full of 00FF-like words, so only code reached from the entry
+    // point counts: jumps and calls are followed, conditional skips fall through.
+    // SUPER-CHIP programs switch to high resolution right at the start.
+    std::vector<bool> visited(size, false);
+    std::vector<size_t> returns;
+    size_t offset = 0;
+    for (auto traced=0; traced<MAX_TRACED && offset + 1 < size && !visited[offset]; ++traced)
+    {
+        visited[offset] = true;
+        uint16_t opcode = rom[offset] << 8 | rom[offset + 1];
+        if (isSchipOpcode(opcode)) return QuirkProfile::Schip;
+
+        size_t target = (opcode & 0x0FFF) - 0x200;
+        switch (opcode & 0xF000)
+        {
+            case 0x1000:
+                if ((opcode & 0x0FFF) < 0x200) return QuirkProfile::Legacy;
+                offset = target;
+                continue;
+            case 0x2000:
+                if ((opcode & 0x0FFF) < 0x200) return QuirkProfile::Legacy;
+                returns.push_back(offset + 2);
+                offset = target;
+                continue;
+            case 0xB000:
+                return QuirkProfile::Legacy;
+        }
+        if (opcode == 0x00EE)
+        {
+            if (returns.empty()) return QuirkProfile::Legacy;
+            offset = returns.back();
+            returns.pop_back();
+            continue;
+        }
+        offset += 2;
+    }
+    return QuirkProfile::Legacy;
+}
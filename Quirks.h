@@ -0,0 +1,78 @@
+#ifndef _QUIRKS_H_
+#define _QUIRKS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Behaviors that differ between Chip8 interpreters, as compile time policies.
+// The run loops and the instruction handlers are instantiated once per
+// profile, so no instruction ever checks a quirk at run time.
+//
+//   shiftVY     8XY6/8XYE shift VY into VX (COSMAC VIP) instead of VX in place
+//   loadStoreI  FX55/FX65 leave I pointing after the last register (I += X + 1)
+//   jumpVX      BXNN jumps to XNN + VX (CHIP-48/SCHIP) instead of NNN + V0
+//   addiVF      FX1E sets VF when I goes past 0xFFF (Amiga interpreter)
+
+// What this emulator has always done
+struct LegacyQuirks
+{
+    static constexpr bool shiftVY = false;
+    static constexpr bool loadStoreI = true;
+    static constexpr bool jumpVX = false;
+    static constexpr bool addiVF = true;
+};
+
+// Original COSMAC VIP interpreter
+struct VipQuirks
+{
+    static constexpr bool shiftVY = true;
+    static constexpr bool loadStoreI = true;
+    static constexpr bool jumpVX = false;
+    static constexpr bool addiVF = false;
+};
+
+// SUPER-CHIP 1.1 on the HP48
+struct SchipQuirks
+{
+    static constexpr bool shiftVY = false;
+    static constexpr bool loadStoreI = false;
+    static constexpr bool jumpVX = true;
+    static constexpr bool addiVF = false;
+};
+
+// Every profile, used to generate the instantiations and the run time selection
+#define CHIP8_QUIRK_PROFILES(X) X(Legacy) X(Vip) X(Schip)
+
+#define CHIP8_PROFILE_ENUMERATOR(name) name,
+enum class QuirkProfile
+{
+    CHIP8_QUIRK_PROFILES(CHIP8_PROFILE_ENUMERATOR)
+};
+#undef CHIP8_PROFILE_ENUMERATOR
+
+// Profiles are numbered 0 to QUIRK_PROFILE_COUNT - 1, files storing one check against it
+#define CHIP8_COUNT_PROFILE(name) + 1
+constexpr uint32_t QUIRK_PROFILE_COUNT = 0 CHIP8_QUIRK_PROFILES(CHIP8_COUNT_PROFILE);
+#undef CHIP8_COUNT_PROFILE
+
+// Run time copy of a profile, for code generated per block (JIT)
+struct QuirkFlags
+{
+    bool shiftVY;
+    bool loadStoreI;
+    bool jumpVX;
+    bool addiVF;
+
+    template <class Q>
+    static QuirkFlags Of() { return QuirkFlags{ Q::shiftVY, Q::loadStoreI, Q::jumpVX, Q::addiVF }; }
+};
+
+const char *QuirkProfileName(QuirkProfile profile);
+bool QuirkProfileFromName(const char *name, QuirkProfile &profile);
+
+// Guesses the profile a program loaded at 0x200 was written for: programs that
+// run SUPER-CHIP instructions from their entry point expect its quirks,
+// anything else gets the legacy behavior.
+QuirkProfile QuirkProfileForROM(const uint8_t *rom, size_t size);
+
+#endif // _QUIRKS_H_
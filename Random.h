@@ -0,0 +1,35 @@
+#ifndef _RANDOM_H_
+#define _RANDOM_H_
+
+#include <cstdint>
+
+// xorshift64* generator: a few cycles per number, good enough statistics for
+// games and a single 64 bit word of state, which makes runs reproducible from
+// a seed and lets snapshots carry it.
+class Xorshift
+{
+public:
+    explicit Xorshift(uint64_t seed = 1) { Seed(seed); }
+
+    // Zero is the only state the generator can't leave, it's replaced
+    void Seed(uint64_t seed) { state = seed ? seed : 0x9E3779B97F4A7C15ull; }
+
+    uint64_t Next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+
+    // The high bits are the best ones
+    uint8_t NextByte() { return Next() >> 56; }
+
+    uint64_t State() const { return state; }
+    void SetState(uint64_t s) { Seed(s); }
+
+private:
+    uint64_t state;
+};
+
+#endif // _RANDOM_H_
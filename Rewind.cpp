@@ -0,0 +1,208 @@
+#include <cstring>
+
+#include "Machine.h"
+#include "Rewind.h"
+#include "Scheduler.h"
+
+namespace
+{
+    const Snapshot zero_snapshot = Snapshot();
+
+    uint64_t load64(const uint8_t *p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    void put16(uint8_t *&out, uint16_t v)
+    {
+        memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
+    }
+
+    uint16_t get16(const uint8_t *&in)
+    {
+        uint16_t v;
+        memcpy(&v, in, sizeof(v));
+        in += sizeof(v);
+        return v;
+    }
+}
+
+RewindBuffer::RewindBuffer(uint32_t maxFrames, size_t capacity) 
+            : ring(capacity),
+              entries(maxFrames ? maxFrames : 1),
+              first(0),
+              count(0),
+              head(0),
+              used(0),
+              sinceKeyframe(0)
+{
+}
+
+void RewindBuffer::Clear()
+{
+    first = count = head = 0;
+    used = 0;
+    sinceKeyframe = 0;
+}
+
+double RewindBuffer::BytesPerSecond() const
+{
+    return count ? (double) UsedBytes() * Scheduler::FRAMES_PER_SECOND / count : 0.0;
+}
+
+// Tokens: bytes to skip (unchanged), literal length, literal XOR bytes.
+// A trailing unchanged run needs no token.
+size_t RewindBuffer::encode(const uint8_t *current, const uint8_t *base, uint8_t *out)
+{
+    const size_t n = sizeof(Snapshot);
+    uint8_t *o = out;
+    size_t i = 0;
+
+    while (i < n)
+    {
+        size_t start = i;
+        while (i + 8 <= n && load64(current + i) == load64(base + i)) i += 8;
+        while (i < n && current[i] == base[i]) ++i;
+        if (i == n) break;
+        size_t skip = i - start;
+
+        size_t literal = i;
+        while (i < n)
+        {
+            if (current[i] != base[i]) { ++i; continue; }
+            size_t j = i;
+            while (j < n && j - i < MIN_RUN && current[j] == base[j]) ++j;
+            if (j - i >= MIN_RUN || j == n) break;
+            i = j;
+        }
+
+        put16(o, skip);
+        put16(o, i - literal);
+        for (size_t k=literal; k<i; ++k) *o++ = current[k] ^ base[k];
+    }
+    return o - out;
+}
+
+void RewindBuffer::decode(const uint8_t *data, size_t size, const uint8_t *base, uint8_t *out)
+{
+    const uint8_t *end = data + size;
+    memcpy(out, base, sizeof(Snapshot));
+
+    size_t i = 0;
+    while (data < end)
+    {
+        i += get16(data);
+        uint16_t length = get16(data);
+        for (uint16_t k=0; k<length; ++k) out[i++] ^= *data++;
+    }
+}
+
+void RewindBuffer::dropOldest()
+{
+    used -= entry(0).size;
+    first = (first + 1) % entries.size();
+    --count;
+    // deltas can't be decoded without their keyframe
+    while (count && !entry(0).keyframe)
+    {
+        used -= entry(0).size;
+        first = (first + 1) % entries.size();
+        --count;
+    }
+}
+
+uint32_t RewindBuffer::allocate(size_t size)
+{
+    if (count == entries.size()) dropOldest();
+
+    for (;;)
+    {
+        if (count == 0)
+        {
+            head = 0;
+            return 0;
+        }
+
+        uint32_t tail = entry(0).offset;
+        // Live entries are either in [tail, head) or wrapped around in [tail, end) + [0, head)
+        if (entry(count - 1).offset >= tail)
+        {
+            if (ring.size() - head >= size) return head;
+            if (tail >= size)
+            {
+                head = 0;
+                return 0;
+            }
+        }
+        else if (tail - head >= size) return head;
+
+        dropOldest();
+    }
+}
+
+void RewindBuffer::push(const uint8_t *data, size_t size, bool keyframe)
+{
+    uint32_t offset = allocate(size);
+    memcpy(&ring[offset], data, size);
+
+    Entry &e = entry(count++);
+    e.offset = offset;
+    e.size = size;
+    e.keyframe = keyframe;
+    head = offset + size;
+    used += size;
+}
+
+void RewindBuffer::Record(const Machine &cpu)
+{
+    if (ring.size() < MAX_ENCODED || !cpu.Save(current)) return;
+    const uint8_t *now = reinterpret_cast<const uint8_t *>(&current);
+
+    if (count && sinceKeyframe < KEYFRAME_INTERVAL)
+    {
+        size_t size = encode(now, reinterpret_cast<const uint8_t *>(&keyframe), scratch);
+        allocate(size);
+        // Making room may drop the keyframe, and every delta with it
+        if (count)
+        {
+            push(scratch, size, false);
+            ++sinceKeyframe;
+            return;
+        }
+    }
+
+    keyframe = current;
+    push(scratch, encode(now, reinterpret_cast<const uint8_t *>(&zero_snapshot), scratch), true);
+    sinceKeyframe = 1;
+}
+
+bool RewindBuffer::StepBack(Snapshot &snapshot)
+{
+    if (count < 2) return false;
+
+    Entry dropped = entry(count - 1);
+    --count;
+    used -= dropped.size;
+    head = entry(count - 1).offset + entry(count - 1).size;
+
+    // The newest frame is now based on an older keyframe
+    if (dropped.keyframe)
+    {
+        uint32_t k = count - 1;
+        while (!entry(k).keyframe) --k;
+        const Entry &key = entry(k);
+        decode(&ring[key.offset], key.size, reinterpret_cast<const uint8_t *>(&zero_snapshot),
+               reinterpret_cast<uint8_t *>(&keyframe));
+        sinceKeyframe = count - k;
+    }
+    else --sinceKeyframe;
+
+    const Entry &newest = entry(count - 1);
+    if (newest.keyframe) snapshot = keyframe;
+    else decode(&ring[newest.offset], newest.size, reinterpret_cast<const uint8_t *>(&keyframe),
+                reinterpret_cast<uint8_t *>(&snapshot));
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef _REWIND_H_
+#define _REWIND_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Snapshot.h"
+
+class Machine;
+
+// Frame by frame history of the machine state, for rewinding.
+// Every frame is stored as the XOR against the last keyframe, run length
+// encoded: between two frames only a few registers, timers and screen rows
+// usually change. Keyframes (XOR against zero) are taken every
+// KEYFRAME_INTERVAL frames. Entries live in a fixed size byte ring, the oldest
+// ones are dropped when it is full. All memory is allocated up front.
+class RewindBuffer
+{
+public:
+    static const uint32_t KEYFRAME_INTERVAL = 60;
+
+    // Keeps at most maxFrames frames in at most capacity bytes
+    RewindBuffer(uint32_t maxFrames, size_t capacity);
+    ~RewindBuffer() = default;
+    RewindBuffer (const RewindBuffer &) = delete;
+    RewindBuffer & operator=(const RewindBuffer &) = delete;
+
+    // Called at the end of every frame
+    void Record(const Machine &cpu);
+    // Drops the newest frame and returns the one before it in snapshot.
+    // False when there is no history left to go back to.
+    bool StepBack(Snapshot &snapshot);
+    void Clear();
+
+    // History held, for sizing the buffer
+    uint32_t Frames() const { return count; }
+    size_t UsedBytes() const { return used + count * sizeof(Entry); }
+    size_t Capacity() const { return ring.size() + entries.size() * sizeof(Entry); }
+    // Average cost of one second (60 frames) of history
+    double BytesPerSecond() const;
+
+private:
+    struct Entry
+    {
+        uint32_t offset;
+        uint16_t size;
+        bool keyframe;
+    };
+
+    // RLE of the XOR between two snapshots, returns the encoded size
+    static size_t encode(const uint8_t *current, const uint8_t *base, uint8_t *out);
+    static void decode(const uint8_t *data, size_t size, const uint8_t *base, uint8_t *out);
+
+    // Returns the offset of size free bytes, dropping the oldest entries as needed
+    uint32_t allocate(size_t size);
+    void dropOldest();
+    Entry &entry(uint32_t i) { return entries[(first + i) % entries.size()]; }
+    void push(const uint8_t *data, size_t size, bool keyframe);
+
+private:
+    // Short runs of unchanged bytes are cheaper inside a literal than as a new token
+    static const size_t MIN_RUN = 4;
+    // A token (2 byte skip, 2 byte length) is only started after MIN_RUN unchanged bytes
+    static const size_t MAX_ENCODED = sizeof(Snapshot) + 4;
+
+    std::vector<uint8_t> ring;
+    std::vector<Entry> entries;
+    uint32_t first;
+    uint32_t count;
+    uint32_t head;
+    size_t used;
+    uint32_t sinceKeyframe;
+
+    // Last keyframe, base of the newer deltas
+    Snapshot keyframe;
+    Snapshot current;
+    uint8_t scratch[MAX_ENCODED];
+};
+
+#endif // _REWIND_H_
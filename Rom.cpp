@@ -0,0 +1,43 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Rom.h"
+
+uint64_t RomHash(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i=0; i<size; ++i) hash = (hash ^ data[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+RomImage::RomImage(const char *filename, size_t maxSize)
+            : data(MAP_FAILED),
+              size(0),
+              hash(0),
+              error("can't be opened")
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) error = "isn't a regular file";
+    else if (st.st_size == 0) error = "is empty";
+    else if ((size = st.st_size) > maxSize) error = "doesn't fit in memory";
+    else
+    {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) error = "can't be mapped";
+        else
+        {
+            hash = RomHash(static_cast<const uint8_t *>(data), size);
+            error = NULL;
+        }
+    }
+    close(fd);
+}
+
+RomImage::~RomImage()
+{
+    if (data != MAP_FAILED) munmap(data, size);
+}
@@ -0,0 +1,38 @@
+#ifndef _ROM_H_
+#define _ROM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// FNV-1a of the program bytes: identifies a ROM whatever its file name
+uint64_t RomHash(const uint8_t *data, size_t size);
+
+// Read only mapping of a program file, checked against the memory it has to
+// fit in before anything is copied. Nothing is printed, the caller reports
+// Error().
+class RomImage
+{
+public:
+    // maxSize: bytes available to programs, from 0x200 to the end of memory
+    RomImage(const char *filename, size_t maxSize);
+    ~RomImage();
+    RomImage (const RomImage &) = delete;
+    RomImage & operator=(const RomImage &) = delete;
+
+    bool Valid() const { return error == NULL; }
+    // Why the ROM can't be loaded, NULL when it can
+    const char *Error() const { return error; }
+
+    const uint8_t *Data() const { return Valid() ? static_cast<const uint8_t *>(data) : NULL; }
+    // Size of the file, even when it is too big
+    size_t Size() const { return size; }
+    uint64_t Hash() const { return hash; }
+
+private:
+    void *data;
+    size_t size;
+    uint64_t hash;
+    const char *error;
+};
+
+#endif // _ROM_H_
@@ -0,0 +1,45 @@
+#include <thread>
+
+#include "Machine.h"
+#include "Scheduler.h"
+
+const uint32_t Scheduler::MAX_LAG_FRAMES;
+
+namespace
+{
+    const std::chrono::nanoseconds frame_period(1000000000 / Scheduler::FRAMES_PER_SECOND);
+}
+
+Scheduler::Scheduler(Machine &cpu, uint32_t instructionsPerFrame) 
+            : cpu(cpu), 
+              instructionsPerFrame(instructionsPerFrame),
+              turbo(false),
+              frames(0),
+              deadline(Clock::now())
+{
+}
+
+void Scheduler::RunFrame()
+{
+    cpu.RunFrame(instructionsPerFrame);
+    ++frames;
+}
+
+void Scheduler::WaitNextFrame()
+{
+    if (turbo) return;
+
+    deadline += frame_period;
+    Clock::time_point now = Clock::now();
+    if (deadline + MAX_LAG_FRAMES * frame_period < now) 
+        deadline = now;
+    else 
+        std::this_thread::sleep_until(deadline);
+}
+
+void Scheduler::SetTurbo(bool on)
+{
+    // Back to real time from now on, not trying to catch up the skipped frames
+    if (turbo && !on) deadline = Clock::now();
+    turbo = on;
+}
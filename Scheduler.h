@@ -0,0 +1,44 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <chrono>
+#include <cstdint>
+
+class Machine;
+
+// Drives the CPU frame by frame: a fixed budget of instructions followed by
+// a single tick of the 60 Hz timers. Frames are paced against a monotonic
+// clock, unless turbo mode is on and they run as fast as possible.
+class Scheduler
+{
+public:
+    static const uint32_t DEFAULT_INSTRUCTIONS_PER_FRAME = 10;
+    static const uint32_t FRAMES_PER_SECOND = 60;
+
+    explicit Scheduler(Machine &cpu, uint32_t instructionsPerFrame = DEFAULT_INSTRUCTIONS_PER_FRAME);
+    ~Scheduler() = default;
+
+    void RunFrame();
+    // Sleeps until the next frame is due, returns straight away in turbo mode
+    void WaitNextFrame();
+
+    void SetInstructionsPerFrame(uint32_t ipf) { instructionsPerFrame = ipf; }
+    uint32_t InstructionsPerFrame() const { return instructionsPerFrame; }
+    void SetTurbo(bool on);
+    bool Turbo() const { return turbo; }
+    uint64_t Frames() const { return frames; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // Falling behind more than this (slow host, debugger...) drops the late frames
+    static const uint32_t MAX_LAG_FRAMES = 5;
+
+    Machine &cpu;
+    uint32_t instructionsPerFrame;
+    bool turbo;
+    uint64_t frames;
+    Clock::time_point deadline;
+};
+
+#endif // _SCHEDULER_H_
@@ -0,0 +1,52 @@
+#ifndef _SCREEN_H_
+#define _SCREEN_H_
+
+#include <cstdint>
+#include <cstring>
+#include "Display.h"
+
+// Copy of a machine screen, as handed over to the renderer. Sized for the
+// biggest mode (two 128x64 planes), only the rows of the actual resolution are
+// copied, so a 64x32 screen costs the same as before.
+struct Screen
+{
+    static const uint32_t MAX_WIDTH = 128;
+    static const uint32_t MAX_HEIGHT = 64;
+    static const uint32_t MAX_PLANES = 2;
+
+    Screen() : width(64), height(32), planes(1), rows{{0}} {}
+
+    template <uint32_t W, uint32_t H>
+    void Capture(const Display<W, H> *from, uint32_t count)
+    {
+        static_assert(W <= MAX_WIDTH && H <= MAX_HEIGHT, "Screen too small for the display");
+        width = W;
+        height = H;
+        planes = count;
+        for (uint32_t p=0; p<count; ++p) memcpy(rows[p], from[p].Rows(), W / 64 * H * sizeof(uint64_t));
+    }
+
+    uint32_t Words() const { return width / 64; }
+    // Row y of plane, Words() words
+    const uint64_t *Row(uint32_t plane, uint32_t y) const { return rows[plane] + y * Words(); }
+
+    // One bit per row that differs from other, in any plane
+    uint64_t Diff(const Screen &other) const
+    {
+        if (width != other.width || height != other.height || planes != other.planes)
+            return ~0ull >> (64 - height);
+
+        uint64_t dirty = 0;
+        for (uint32_t p=0; p<planes; ++p)
+            for (uint32_t y=0; y<height; ++y)
+                if (memcmp(Row(p, y), other.Row(p, y), Words() * sizeof(uint64_t)) != 0) dirty |= 1ull << y;
+        return dirty;
+    }
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t planes;
+    uint64_t rows[MAX_PLANES][MAX_WIDTH / 64 * MAX_HEIGHT];
+};
+
+#endif // _SCREEN_H_
@@ -0,0 +1,26 @@
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include <cstdint>
+
+// Audio output of the Chip8 core. Frontends (SDL, headless runners...) plug
+// their own implementation, the core never depends on any of them. Frames
+// are pulled by the frontends instead (Machine::TakeScreen).
+
+class AudioSink
+{
+public:
+    virtual ~AudioSink() = default;
+
+    // Called when the sound timer starts or stops running, not on every
+    // frame in between: implementations can stay cheap and lock free
+    virtual void StartBeep() = 0;
+    virtual void StopBeep() = 0;
+    // XO-CHIP (F002, FX3A): from now on the beep plays the 128 one bit
+    // samples of pattern (most significant bit first) in a loop, at
+    // 4000 * 2^((pitch - 64) / 48) samples per second. Called when either
+    // changes. Sinks without pattern playback keep their tone.
+    virtual void SetPattern(const uint8_t * /*pattern*/, uint8_t /*pitch*/) {}
+};
+
+#endif // _SINK_H_
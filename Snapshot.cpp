@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Snapshot.h"
+
+const Snapshot *SnapshotView(const void *data, size_t size)
+{
+    if (data == NULL || size < sizeof(Snapshot)) return NULL;
+    const Snapshot *snapshot = static_cast<const Snapshot *>(data);
+    return snapshot->Valid() ? snapshot : NULL;
+}
+
+uint64_t SnapshotHash(const Snapshot &snapshot)
+{
+    Snapshot copy = snapshot;
+    copy.drawF = 0;
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&copy);
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i=0; i<sizeof(Snapshot); ++i) hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+bool SaveSnapshot(const Snapshot &snapshot, const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file) return false;
+    bool ok = fwrite(&snapshot, sizeof(Snapshot), 1, file) == 1;
+    return (fclose(file) == 0) && ok;
+}
+
+bool LoadSnapshot(const char *filename, Snapshot &snapshot)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file) return false;
+    bool ok = fread(&snapshot, sizeof(Snapshot), 1, file) == 1;
+    fclose(file);
+    return ok && snapshot.Valid();
+}
+
+MappedSnapshot::MappedSnapshot(const char *filename) 
+            : data(MAP_FAILED),
+              size(0),
+              snapshot(NULL)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(Snapshot))
+    {
+        size = st.st_size;
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) snapshot = SnapshotView(data, size);
+    }
+    close(fd);
+}
+
+MappedSnapshot::~MappedSnapshot()
+{
+    if (data != MAP_FAILED) munmap(data, size);
+}
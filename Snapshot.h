@@ -0,0 +1,81 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Complete machine state in a fixed binary layout. It is written to disk as is
+// and can be used straight from a memory mapped file, nothing gets parsed.
+// Fields are in host byte order: a snapshot from a host with a different
+// endianness fails the magic check and is rejected.
+struct Snapshot
+{
+    static const uint32_t MAGIC = 0x38504843; // "CHP8"
+    static const uint32_t VERSION = 2;
+
+    // header
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // sizeof(Snapshot)
+    uint32_t reserved;
+
+    uint64_t display[32];
+    uint8_t memory[4096];
+    uint16_t stack[16];
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint16_t sp;
+    uint8_t V[16];
+    uint8_t keyboard[16];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t drawF;
+    uint8_t padding[5];
+    // since version 2
+    uint64_t cycle;
+    uint64_t random;    // generator state
+
+    // Header matches this build and the stack pointer indexes the stack.
+    // pc, I and the return addresses on the stack may hold anything: every
+    // engine wraps them to memory when it uses them.
+    bool Valid() const
+    {
+        return magic == MAGIC && version == VERSION && size == sizeof(Snapshot) && sp < 16;
+    }
+};
+
+static_assert(sizeof(Snapshot) == 4464, "Snapshot layout is part of the file format");
+static_assert(offsetof(Snapshot, display) == 16, "Snapshot layout is part of the file format");
+static_assert(offsetof(Snapshot, memory) == 272, "Snapshot layout is part of the file format");
+
+// Returns the snapshot held in data (a memory mapped file for instance),
+// or NULL when it is too short or not a valid snapshot
+const Snapshot *SnapshotView(const void *data, size_t size);
+
+// FNV-1a of the machine state, for comparing runs. drawF is left out:
+// it only tells whether the screen was presented yet.
+uint64_t SnapshotHash(const Snapshot &snapshot);
+
+bool SaveSnapshot(const Snapshot &snapshot, const char *filename);
+bool LoadSnapshot(const char *filename, Snapshot &snapshot);
+
+// Read only mapping of a snapshot file
+class MappedSnapshot
+{
+public:
+    explicit MappedSnapshot(const char *filename);
+    ~MappedSnapshot();
+    MappedSnapshot (const MappedSnapshot &) = delete;
+    MappedSnapshot & operator=(const MappedSnapshot &) = delete;
+
+    // NULL when the file couldn't be mapped or isn't a valid snapshot
+    const Snapshot *Get() const { return snapshot; }
+
+private:
+    void *data;
+    size_t size;
+    const Snapshot *snapshot;
+};
+
+#endif // _SNAPSHOT_H_
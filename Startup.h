@@ -0,0 +1,52 @@
+#ifndef _STARTUP_H_
+#define _STARTUP_H_
+
+#include <stdio.h>
+#include <chrono>
+#include <cstdint>
+
+// Time spent in each phase of the start up, up to the first frame on screen.
+// Every Mark ends the phase running since the previous one (or since the
+// timer was created).
+class StartupTimer
+{
+public:
+    StartupTimer() : start(Clock::now()), last(start), count(0) {}
+
+    void Mark(const char *phase)
+    {
+        Clock::time_point now = Clock::now();
+        if (count < MAX_PHASES)
+        {
+            phases[count].name = phase;
+            phases[count].ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+            ++count;
+        }
+        last = now;
+    }
+
+    void Print() const
+    {
+        printf("Startup:\n");
+        for (uint32_t i=0; i<count; ++i) printf("  %-14s%10.2f ms\n", phases[i].name, phases[i].ns / 1e6);
+        printf("  %-14s%10.2f ms\n", "total",
+               std::chrono::duration_cast<std::chrono::nanoseconds>(last - start).count() / 1e6);
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    static const uint32_t MAX_PHASES = 16;
+
+    struct Phase
+    {
+        const char *name;
+        uint64_t ns;
+    };
+
+    Clock::time_point start;
+    Clock::time_point last;
+    Phase phases[MAX_PHASES];
+    uint32_t count;
+};
+
+#endif // _STARTUP_H_
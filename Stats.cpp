@@ -0,0 +1,55 @@
+#include "Stats.h"
+
+namespace
+{
+    void writeTiming(FILE *file, const char *name, const Timing &timing, const char *separator)
+    {
+        fprintf(file, "    \"%s\": {\"calls\": %lu, \"ns\": %lu, \"avg_ns\": %.1f, \"max_ns\": %lu}%s\n", name,
+                (unsigned long) timing.calls, (unsigned long) timing.ns,
+                timing.calls ? (double) timing.ns / timing.calls : 0.0, (unsigned long) timing.max, separator);
+    }
+}
+
+void WriteStatsJSON(FILE *file, const CpuStats *cpu, uint64_t unknownOpcodes, const FrameStats *frames)
+{
+    fprintf(file, "{\n  \"unknown_opcodes\": %lu", (unsigned long) unknownOpcodes);
+
+    if (cpu)
+    {
+        uint64_t total = 0;
+        for (auto count : cpu->ops) total += count;
+        fprintf(file, ",\n  \"instructions\": %lu,\n  \"ops\": {", (unsigned long) total);
+
+        const char *separator = "\n";
+        for (uint32_t op=0; op<OP_COUNT; ++op)
+        {
+            if (!cpu->ops[op]) continue;
+            fprintf(file, "%s    \"%s\": %lu", separator, OpName(op), (unsigned long) cpu->ops[op]);
+            separator = ",\n";
+        }
+        fprintf(file, "\n  },\n  \"addresses\": {");
+
+        separator = "\n";
+        for (uint32_t pc=0; pc<4096; ++pc)
+        {
+            if (!cpu->addresses[pc]) continue;
+            fprintf(file, "%s    \"0x%03X\": %lu", separator, pc, (unsigned long) cpu->addresses[pc]);
+            separator = ",\n";
+        }
+        fprintf(file, "\n  }");
+    }
+
+    if (frames)
+    {
+        fprintf(file, ",\n  \"frames\": {\n    \"presented\": %lu,\n", (unsigned long) frames->frames);
+        fprintf(file, "    \"instructions_per_frame\": {\"avg\": %.1f, \"min\": %lu, \"max\": %lu},\n",
+                frames->frames ? (double) frames->instructions / frames->frames : 0.0,
+                (unsigned long) (frames->frames ? frames->minInstructions : 0), (unsigned long) frames->maxInstructions);
+        writeTiming(file, "update_pixels", frames->updatePixels, ",");
+        writeTiming(file, "render_texture", frames->render, ",");
+        writeTiming(file, "delay", frames->delay, "");
+        fprintf(file, "  }");
+    }
+
+    fprintf(file, "\n}\n");
+}
@@ -0,0 +1,95 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include "Dispatch.h"
+
+// Hot path instrumentation. Only built with -DCHIP8_STATS=ON: otherwise
+// CHIP8_STAT() expands to nothing and none of the counters exist.
+#ifdef CHIP8_STATS
+#define CHIP8_STAT(statement) statement
+#else
+#define CHIP8_STAT(statement)
+#endif
+
+// What the CPU executed: every instruction, by operation and by address
+struct CpuStats
+{
+    CpuStats() { Reset(); }
+
+    void Reset() { memset(this, 0, sizeof(*this)); }
+
+    void Count(uint16_t pc, uint8_t op, uint64_t times = 1)
+    {
+        ops[op] += times;
+        addresses[pc & 0xFFF] += times;
+    }
+
+    uint64_t ops[OP_COUNT];
+    uint64_t addresses[4096];
+};
+
+// Calls, total and worst time of a piece of code
+struct Timing
+{
+    Timing() : calls(0), ns(0), max(0) {}
+
+    void Add(uint64_t elapsed)
+    {
+        ++calls;
+        ns += elapsed;
+        if (elapsed > max) max = elapsed;
+    }
+
+    uint64_t calls;
+    uint64_t ns;
+    uint64_t max;
+};
+
+// Adds the lifetime of the scope to a Timing
+class ScopedTiming
+{
+public:
+    explicit ScopedTiming(Timing &timing) : timing(timing), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTiming()
+    {
+        timing.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    Timing &timing;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Frontend side: what it took to present the frames
+struct FrameStats
+{
+    FrameStats() : frames(0), instructions(0), minInstructions(UINT64_MAX), maxInstructions(0) {}
+
+    // A frame was presented, instructions executed since the previous one
+    void Presented(uint64_t executed)
+    {
+        ++frames;
+        instructions += executed;
+        if (executed < minInstructions) minInstructions = executed;
+        if (executed > maxInstructions) maxInstructions = executed;
+    }
+
+    uint64_t frames;
+    uint64_t instructions;
+    uint64_t minInstructions;
+    uint64_t maxInstructions;
+
+    Timing updatePixels;
+    Timing render;
+    Timing delay;
+};
+
+// Writes the counters as a JSON object. Any of the sections can be NULL.
+// Only the addresses that were executed are listed.
+void WriteStatsJSON(FILE *file, const CpuStats *cpu, uint64_t unknownOpcodes, const FrameStats *frames);
+
+#endif // _STATS_H_
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint32_t threads)
+            : task(NULL),
+              generation(0),
+              busy(0),
+              stopping(false)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t i=0; i<threads; ++i) queues.emplace_back(new Queue);
+    for (uint32_t i=1; i<threads; ++i) workers.emplace_back(&ThreadPool::worker, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    started.notify_all();
+    for (auto &thread : workers) thread.join();
+}
+
+void ThreadPool::ParallelFor(uint32_t count, uint32_t grain, const Task &job)
+{
+    if (count == 0) return;
+    grain = std::max(1u, grain);
+
+    // Dealt round robin: every thread starts on its own share
+    uint32_t next = 0;
+    for (uint32_t begin=0; begin<count; begin+=grain)
+    {
+        Queue &queue = *queues[next++ % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.ranges.push_back(Range{ begin, std::min(count, begin + grain) });
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        task = &job;
+        busy = workers.size();
+        ++generation;
+    }
+    started.notify_all();
+
+    runRanges(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [this] { return busy == 0; });
+    task = NULL;
+}
+
+bool ThreadPool::take(uint32_t self, Range &range)
+{
+    {
+        Queue &own = *queues[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.ranges.empty())
+        {
+            range = own.ranges.front();
+            own.ranges.pop_front();
+            return true;
+        }
+    }
+
+    for (uint32_t i=1; i<queues.size(); ++i)
+    {
+        Queue &victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.ranges.empty())
+        {
+            range = victim.ranges.back();
+            victim.ranges.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runRanges(uint32_t self)
+{
+    Range range;
+    while (take(self, range)) (*task)(range.begin, range.end);
+}
+
+void ThreadPool::worker(uint32_t self)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            started.wait(guard, [this, seen] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        runRanges(self);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--busy == 0) finished.notify_one();
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running parallel loops. Every thread has its own
+// queue of index ranges and steals from the back of the others once it runs
+// dry, so a few slow ranges don't leave the other cores idle.
+class ThreadPool
+{
+public:
+    typedef std::function<void(uint32_t begin, uint32_t end)> Task;
+
+    // threads counts the calling thread, 0 is one per hardware thread
+    explicit ThreadPool(uint32_t threads = 0);
+    ~ThreadPool();
+    ThreadPool (const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    uint32_t Threads() const { return queues.size(); }
+
+    // Runs job over [0, count) in ranges of at most grain indices and
+    // returns once all of them are done. The calling thread works too.
+    void ParallelFor(uint32_t count, uint32_t grain, const Task &job);
+
+private:
+    struct Range
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Range> ranges;
+    };
+
+    // Front of its own queue, else the back of another one
+    bool take(uint32_t self, Range &range);
+    void runRanges(uint32_t self);
+    void worker(uint32_t self);
+
+private:
+    // Queue 0 belongs to the thread calling ParallelFor
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable started;
+    std::condition_variable finished;
+    const Task *task;
+    uint64_t generation;
+    // Workers still running ranges of the current loop
+    uint32_t busy;
+    bool stopping;
+};
+
+#endif // _THREAD_POOL_H_
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <chrono>
+
+#include "Chip8.h"
+#include "Chip8Ops.h"
+#include "Trace.h"
+
+Tracer::Tracer(uint32_t capacity)
+      : file(NULL),
+        header{},
+        stopping(false),
+        failed(false),
+        head(0),
+        limit(0),
+        stalls(0),
+        written(0),
+        flushed(0)
+{
+    uint32_t size = 1;
+    while (size < capacity) size <<= 1;
+    mask = size - 1;
+    ring.reset(new TraceRecord[size]);
+}
+
+Tracer::~Tracer()
+{
+    Close();
+}
+
+bool Tracer::Open(const char *filename, uint64_t romHash, QuirkProfile quirks, uint64_t startCycle)
+{
+    Close();
+    file = fopen(filename, "wb");
+    if (!file) return false;
+
+    header = TraceHeader{};
+    header.magic = TraceHeader::MAGIC;
+    header.version = TraceHeader::VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    header.romHash = romHash;
+    header.startCycle = startCycle;
+    header.quirks = static_cast<uint32_t>(quirks);
+    failed = fwrite(&header, sizeof(header), 1, file) != 1;
+
+    head = 0;
+    limit = mask + 1;
+    stalls = 0;
+    written.store(0);
+    flushed.store(0);
+    stopping.store(false);
+    writer = std::thread(&Tracer::writeLoop, this);
+    return true;
+}
+
+bool Tracer::Close()
+{
+    if (!file) return true;
+
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+
+    header.records = head;
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) failed = true;
+    if (fclose(file) != 0) failed = true;
+    file = NULL;
+    return !failed;
+}
+
+void Tracer::waitForRoom()
+{
+    ++stalls;
+    while (head - flushed.load(std::memory_order_acquire) > mask) std::this_thread::yield();
+    limit = flushed.load(std::memory_order_acquire) + mask + 1;
+}
+
+// Writes the ring out in contiguous runs, naps when it is empty
+void Tracer::writeLoop()
+{
+    uint64_t done = 0;
+    for (;;)
+    {
+        bool last = stopping.load(std::memory_order_acquire);
+        uint64_t available = written.load(std::memory_order_acquire);
+        while (done < available)
+        {
+            uint64_t start = done & mask;
+            uint64_t count = std::min<uint64_t>(available - done, mask + 1 - start);
+            if (fwrite(&ring[start], sizeof(TraceRecord), count, file) != count) failed = true;
+            done += count;
+            flushed.store(done, std::memory_order_release);
+        }
+        if (last) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+uint8_t TracedRegister(uint8_t op, uint8_t x)
+{
+    switch (op)
+    {
+        case OP_Set: case OP_Add: case OP_Setr: case OP_Or: case OP_And: case OP_Xor: case OP_Addr:
+        case OP_Sub: case OP_Shr: case OP_Subb: case OP_Shl: case OP_Rand: case OP_Getdelay: case OP_Waitkey:
+        case OP_Pop:
+            return x;
+    }
+    return TraceRecord::NO_REGISTER;
+}
+
+// Trace mode: interpreted through the handler table, one record per instruction
+template <class Q>
+void Chip8::runTraced(uint32_t cycles)
+{
+    const Instruction *table = DecodeTable();
+    const Dispatch::Handler *handlers = Dispatch::Handlers<Q>();
+    for (; cycles; --cycles)
+    {
+        uint16_t at = pc;
+        decodeOpcode();
+        const Instruction &ins = table[opcode];
+        CHIP8_STAT(stats.Count(pc, ins.op));
+        handlers[ins.op](*this, ins);
+        uint8_t reg = TracedRegister(ins.op, ins.x);
+        tracer->Record(at, opcode, I, reg, V[reg & 0xF]);
+    }
+}
+
+#define CHIP8_INSTANTIATE(name) template void Chip8::runTraced<name##Quirks>(uint32_t cycles);
+CHIP8_QUIRK_PROFILES(CHIP8_INSTANTIATE)
+#undef CHIP8_INSTANTIATE
@@ -0,0 +1,108 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdio.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include "Quirks.h"
+
+// Binary execution trace: one fixed size record per instruction executed.
+// File layout, fields in host byte order like snapshots:
+//
+//   TraceHeader
+//   TraceRecord[records]   in execution order, from cycle startCycle on
+//
+// Decoded by chip8-trace.
+struct TraceHeader
+{
+    static const uint32_t MAGIC = 0x52543843; // "C8TR"
+    static const uint16_t VERSION = 1;
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint64_t romHash;       // RomHash of the program traced
+    uint64_t startCycle;    // instructions run before the first record
+    uint64_t records;       // written when the trace is closed, 0 if it never was
+    uint32_t quirks;        // QuirkProfile
+    uint32_t reserved;
+};
+
+struct TraceRecord
+{
+    static const uint8_t NO_REGISTER = 0xFF;
+
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;         // after the instruction
+    uint8_t reg;        // V register the instruction writes, NO_REGISTER when none
+    uint8_t value;      // its value after the instruction
+};
+
+static_assert(sizeof(TraceHeader) == 40, "TraceHeader layout is part of the file format");
+static_assert(sizeof(TraceRecord) == 8, "TraceRecord layout is part of the file format");
+
+// Writes a trace file. Records go from the emulation thread into a lock-free
+// single producer, single consumer ring, and a background thread writes them
+// out. When the disk can't keep up the emulation waits for room in the ring:
+// the trace never loses records.
+class Tracer
+{
+public:
+    // 8 MB of records
+    static const uint32_t DEFAULT_CAPACITY = 1 << 20;
+
+    // capacity: records in the ring, rounded up to a power of two
+    explicit Tracer(uint32_t capacity = DEFAULT_CAPACITY);
+    ~Tracer();
+    Tracer (const Tracer &) = delete;
+    Tracer & operator=(const Tracer &) = delete;
+
+    // Creates the file and starts the writer thread
+    bool Open(const char *filename, uint64_t romHash, QuirkProfile quirks, uint64_t startCycle);
+    // Writes what is left in the ring and the record count. False when
+    // anything failed to be written.
+    bool Close();
+    bool IsOpen() const { return file != NULL; }
+
+    // Called by the emulation thread only
+    void Record(uint16_t pc, uint16_t opcode, uint16_t I, uint8_t reg, uint8_t value)
+    {
+        if (head == limit) waitForRoom();
+        ring[head & mask] = TraceRecord{ pc, opcode, I, reg, value };
+        written.store(++head, std::memory_order_release);
+    }
+
+    uint64_t Records() const { return head; }
+    // Times the emulation had to wait for the writer thread
+    uint64_t Stalls() const { return stalls; }
+
+private:
+    void waitForRoom();
+    void writeLoop();
+
+    uint32_t mask;
+    std::unique_ptr<TraceRecord[]> ring;
+    FILE *file;
+    TraceHeader header;
+    std::thread writer;
+    std::atomic<bool> stopping;
+    bool failed;
+
+    // Emulation thread side
+    uint64_t head;
+    // head can go up to there before the writer has to catch up
+    uint64_t limit;
+    uint64_t stalls;
+
+    // Records made available to the writer, and written by it
+    alignas(64) std::atomic<uint64_t> written;
+    alignas(64) std::atomic<uint64_t> flushed;
+};
+
+// Register an instruction writes, NO_REGISTER when none
+uint8_t TracedRegister(uint8_t op, uint8_t x);
+
+#endif // _TRACE_H_
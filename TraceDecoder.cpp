@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "Analysis.h"
+#include "Dispatch.h"
+#include "Quirks.h"
+#include "Trace.h"
+
+// Renders an execution trace (see Trace.h) as annotated disassembly: the
+// register written, I when it changes, where jumps went and whether skips
+// were taken.
+// Usage: chip8-trace [--from N] [--count N] <trace file>
+// --from skips the first N records, --count stops after N of them.
+
+namespace
+{
+    const size_t CHUNK = 4096;
+
+    // What happened, known from the record and the next one (NULL at the end of the trace)
+    std::string effect(const TraceRecord &record, const TraceRecord *next, uint16_t previousI)
+    {
+        std::string text;
+        char part[32];
+        auto add = [&]() { text += (text.empty() ? "" : "  ") + std::string(part); };
+        if (record.reg != TraceRecord::NO_REGISTER)
+        {
+            snprintf(part, sizeof(part), "V%X = 0x%02X", record.reg, record.value);
+            add();
+        }
+        if (record.I != previousI)
+        {
+            snprintf(part, sizeof(part), "I = 0x%03X", record.I);
+            add();
+        }
+        if (!next) return text;
+
+        switch (Decode(record.opcode).op)
+        {
+            case OP_Jeq: case OP_Jneq: case OP_Jeqr: case OP_Jneqr: case OP_Jkey: case OP_Jnkey:
+                snprintf(part, sizeof(part), "%s", next->pc == record.pc + 4 ? "skipped" : "not skipped");
+                add();
+                break;
+            case OP_Ret: case OP_Jumpv0:
+                snprintf(part, sizeof(part), "-> 0x%03X", next->pc);
+                add();
+                break;
+            case OP_Waitkey:
+                snprintf(part, sizeof(part), "waiting for a key");
+                if (next->pc == record.pc) add();
+                break;
+        }
+        return text;
+    }
+
+    bool readHeader(FILE *file, TraceHeader &header, uint64_t &records)
+    {
+        struct stat st;
+        if (fread(&header, sizeof(header), 1, file) != 1 || fstat(fileno(file), &st) != 0) return false;
+        if (header.magic != TraceHeader::MAGIC || header.version != TraceHeader::VERSION ||
+            header.recordSize != sizeof(TraceRecord) || header.quirks >= QUIRK_PROFILE_COUNT)
+            return false;
+        // Unclosed traces (the program died) end where the writer stopped
+        uint64_t found = (st.st_size - sizeof(header)) / sizeof(TraceRecord);
+        records = header.records ? std::min(header.records, found) : found;
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t from = 0;
+    uint64_t count = UINT64_MAX;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        if (strcmp(argv[arg], "--from") == 0) from = strtoull(argv[arg + 1], NULL, 0);
+        else if (strcmp(argv[arg], "--count") == 0) count = strtoull(argv[arg + 1], NULL, 0);
+        else break;
+    }
+
+    if (arg + 1 != argc)
+    {
+        printf("Usage: %s [--from N] [--count N] <trace file>\n\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[arg], "rb");
+    if (!file)
+    {
+        printf("Can't open %s\n", argv[arg]);
+        return 1;
+    }
+
+    TraceHeader header;
+    uint64_t records;
+    if (!readHeader(file, header, records))
+    {
+        printf("%s isn't a trace\n", argv[arg]);
+        fclose(file);
+        return 1;
+    }
+    printf("ROM %016llx, %s quirks, %llu records from cycle %llu%s\n", (unsigned long long) header.romHash,
+           QuirkProfileName(static_cast<QuirkProfile>(header.quirks)), (unsigned long long) records, (unsigned long long) header.startCycle,
+           header.records ? "" : " (trace not closed)");
+
+    // I before the first record shown is unknown: start from the one before it
+    uint16_t previousI = 0;
+    if (from > 0 && from <= records)
+    {
+        TraceRecord before;
+        fseek(file, sizeof(header) + (from - 1) * sizeof(TraceRecord), SEEK_SET);
+        if (fread(&before, sizeof(before), 1, file) == 1) previousI = before.I;
+    }
+    uint64_t end = from + std::min(count, records > from ? records - from : 0);
+
+    // One record of look ahead, for the control flow
+    std::vector<TraceRecord> chunk(CHUNK + 1);
+    uint64_t index = from;
+    size_t buffered = 0;
+    while (index < end)
+    {
+        size_t wanted = std::min<uint64_t>(CHUNK + 1 - buffered, records - index - buffered);
+        buffered += fread(&chunk[buffered], sizeof(TraceRecord), wanted, file);
+        if (buffered == 0) break;
+
+        size_t shown = std::min<uint64_t>(buffered == CHUNK + 1 ? CHUNK : buffered, end - index);
+        for (size_t i=0; i<shown; ++i, ++index)
+        {
+            const TraceRecord &record = chunk[i];
+            const TraceRecord *next = i + 1 < buffered ? &chunk[i + 1] : NULL;
+            std::string annotation = effect(record, next, previousI);
+            printf("%12llu  %03X  %04X  %-*s%s\n", (unsigned long long) (header.startCycle + index), record.pc,
+                   record.opcode, annotation.empty() ? 0 : 18, Disassemble(record.opcode).c_str(), annotation.c_str());
+            previousI = record.I;
+        }
+        // The look ahead record starts the next chunk
+        memmove(&chunk[0], &chunk[shown], (buffered - shown) * sizeof(TraceRecord));
+        buffered -= shown;
+    }
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef _TRIPLE_BUFFER_H_
+#define _TRIPLE_BUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer triple buffer.
+// The producer always owns a back slot to write into, the consumer always owns
+// a front slot to read from, and completed values are swapped through the
+// middle slot. Neither side ever waits for the other; the consumer just skips
+// the values it was too slow to see.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(1), back(0), front(2) {}
+    TripleBuffer (const TripleBuffer &) = delete;
+    TripleBuffer & operator=(const TripleBuffer &) = delete;
+
+    // Producer side
+    T &Back() { return slots[back]; }
+    void Publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Consumer side: returns true when a newer value than Front() was published
+    bool Consume()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T &Front() const { return slots[front]; }
+
+private:
+    static const uint8_t INDEX = 0x3;
+    static const uint8_t FRESH = 0x4;
+
+    T slots[3];
+    // index of the middle slot, FRESH when it holds an unread value
+    alignas(64) std::atomic<uint8_t> middle;
+    alignas(64) uint8_t back;
+    alignas(64) uint8_t front;
+};
+
+#endif // _TRIPLE_BUFFER_H_